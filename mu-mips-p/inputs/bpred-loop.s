@@ -0,0 +1,14 @@
+# Predictor test, assembled into bpred-loop.in.
+# One branch, taken 999 times and then not taken as the loop ends.
+# Cold predictors miss: nottaken every taken pass (999); bimodal,
+# tournament and btb the first pass and the exit (2); gshare once for
+# each new value of its 12-bit history while it fills with taken
+# branches, once more to train the all-taken entry, and the exit (14).
+# Ends with $t0 = 1000.
+	addiu	$t0, $zero, 0
+	addiu	$t1, $zero, 1000
+loop:
+	addiu	$t0, $t0, 1
+	bne	$t0, $t1, loop
+	addiu	$v0, $zero, 10
+	syscall
@@ -0,0 +1,27 @@
+# Cache test, assembled into cache-walk.in; run with 1 KB, 2-way, 16-byte
+# line LRU write-back caches (32 sets, so addresses 512 bytes apart
+# share a set).
+# Two passes load 64 words: 16 line misses, then 112 hits. A store to
+# the first line hits and dirties it; loads 4 KB and 8 KB further on
+# fill its set and evict it (one writeback), and loading it again misses
+# and evicts the 4 KB line. Data: 132 accesses, 113 hits, 19 misses,
+# 2 evictions, 1 writeback. The 19 instructions span 5 text lines.
+	li	$s0, 0x10010000
+	addiu	$t2, $zero, 2
+pass:
+	addiu	$t0, $zero, 0
+loop:
+	addu	$t1, $s0, $t0
+	lw	$t3, 0($t1)
+	addu	$s1, $s1, $t3
+	addiu	$t0, $t0, 4
+	slti	$t4, $t0, 256
+	bne	$t4, $zero, loop
+	addiu	$t2, $t2, -1
+	bgtz	$t2, pass
+	sw	$t2, 0($s0)
+	lw	$t5, 4096($s0)
+	lw	$t6, 8192($s0)
+	lw	$t7, 0($s0)
+	addiu	$v0, $zero, 10
+	syscall
@@ -0,0 +1,44 @@
+# Branch test for ELF programs, assembled by a MIPS toolchain:
+#   llvm-mc -triple=mipsel-unknown-linux -filetype=obj, then linked at
+#   0x00400000 into elf-branch.elf
+# Branch offsets count from PC + 4; every delay slot holds a nop.
+# Ends with $s0 = 110, $s1 = 110, $s2 = 0 (1 if a branch went wrong).
+	.set	noreorder
+	.text
+	.globl	__start
+__start:
+	addiu	$t0, $zero, 0		# sum
+	addiu	$t1, $zero, 10		# i
+loop:
+	addu	$t0, $t0, $t1
+	addiu	$t1, $t1, -1
+	bgtz	$t1, loop		# backward, taken 9 times
+	nop
+	beq	$t0, $zero, fail	# forward, not taken
+	nop
+	addiu	$t2, $zero, 55
+	bne	$t0, $t2, fail		# forward, not taken
+	nop
+	addu	$a0, $t0, $zero
+	jal	double
+	nop
+	addu	$s0, $v0, $zero
+	lui	$t3, 0x1001
+	sw	$s0, 0($t3)
+	lw	$s1, 0($t3)
+	bltz	$s1, fail		# not taken
+	nop
+	bgez	$s1, done		# forward, taken
+	nop
+fail:
+	addiu	$s2, $zero, 1
+done:
+	addiu	$v0, $zero, 10
+	syscall
+	nop
+double:
+	blez	$a0, fail		# not taken
+	nop
+	addu	$v0, $a0, $a0
+	jr	$ra
+	nop
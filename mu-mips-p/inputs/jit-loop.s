@@ -0,0 +1,51 @@
+# Hot loop for comparing translated code with the interpreter, assembled
+# into jit-loop.in (branch offsets count from the branch itself).
+# 300 outer passes over a 16-word array with loads, stores, mult/div, a
+# call, and a store into its own text: every pass rewrites the word at
+# "patch" (0x00400090) to add 1 on even passes and 3 on odd ones.
+# Ends with $s1 = 300 and $s6 = 600.
+	li	$s0, 0x10010000		# array
+	li	$s7, 0x00400090		# address of "patch"
+	li	$a1, 0x26D60001		# addiu $s6, $s6, 1
+	li	$a2, 0x26D60003		# addiu $s6, $s6, 3
+	addiu	$s1, $zero, 0
+	addiu	$s2, $zero, 300
+outer:
+	addiu	$t0, $zero, 0
+inner:
+	sll	$t1, $t0, 2
+	addu	$t1, $t1, $s0
+	lw	$t2, 0($t1)
+	addu	$t2, $t2, $t0
+	addu	$t2, $t2, $s1
+	sw	$t2, 0($t1)
+	addu	$s3, $s3, $t2
+	addiu	$t0, $t0, 1
+	slti	$t3, $t0, 16
+	bne	$t3, $zero, inner
+	addiu	$t4, $s1, 7
+	mult	$s3, $t4
+	mflo	$t5
+	div	$t5, $t4
+	mfhi	$t6
+	addu	$s4, $s4, $t6
+	sb	$t5, 64($s0)
+	lb	$t7, 64($s0)
+	addu	$s4, $s4, $t7
+	jal	leaf
+	andi	$t8, $s1, 1
+	beq	$t8, $zero, even
+	sw	$a2, 0($s7)
+	beq	$zero, $zero, patch
+even:
+	sw	$a1, 0($s7)
+patch:
+	addiu	$s6, $s6, 1
+	addiu	$s1, $s1, 1
+	bne	$s1, $s2, outer
+	addiu	$v0, $zero, 10
+	syscall
+leaf:
+	xor	$s5, $s5, $t5
+	sll	$s5, $s5, 1
+	jr	$ra
@@ -0,0 +1,17 @@
+# Hazard test, assembled into load-use.in.
+# One load is used by the very next instruction: with forwarding that
+# costs exactly one bubble. The second load has an independent
+# instruction between it and its use, so it costs none.
+# Without forwarding four pairs wait two cycles each for writeback
+# (lui/ori, addiu/sw, lw/addu, addiu/addu): 8 data stalls.
+# Ends with $t2 = 42 and $t5 = 22.
+	li	$s0, 0x10010000
+	addiu	$t0, $zero, 21
+	sw	$t0, 0($s0)
+	lw	$t1, 0($s0)
+	addu	$t2, $t1, $t1		# load-use: one bubble
+	lw	$t3, 0($s0)
+	addiu	$t4, $zero, 1
+	addu	$t5, $t3, $t4		# load two back: no bubble
+	addiu	$v0, $zero, 10
+	syscall
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mem.h"
+#include "mu-bpred.h"
+
+const char *BPRED_NAMES[] = { "nottaken", "bimodal", "gshare", "tournament", "btb" };
+
+static bpred_ctx_t BPRED_DEFAULT;
+__thread bpred_ctx_t *BPRED_CTX = &BPRED_DEFAULT;
+
+#define BPRED_PHT_MASK (BPRED_PHT_ENTRIES - 1)
+
+#define BPRED_BIMODAL_PHT (BPRED_CTX->bimodal_pht)
+#define BPRED_GSHARE_PHT  (BPRED_CTX->gshare_pht)
+#define BPRED_CHOOSER        (BPRED_CTX->chooser)
+#define BPRED_HISTORY        (BPRED_CTX->history)
+#define BPRED_BTB_TABLE     (BPRED_CTX->btb)
+#define BPRED_RAS               (BPRED_CTX->ras)
+#define BPRED_RAS_TOP        (BPRED_CTX->ras_top)
+
+static void bpred_train(uint8_t *counter, int taken)
+{
+	if (taken && *counter < 3) {
+		(*counter)++;
+	}else if (!taken && *counter > 0) {
+		(*counter)--;
+	}
+}
+
+/***************************************************************/
+/* Map a predictor name to BPRED_*, -1 if unknown                                  */
+/***************************************************************/
+int bpred_lookup_kind(const char *name)
+{
+	int i;
+	for (i = 0; i < BPRED_KINDS; i++) {
+		if (strcmp(name, BPRED_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/***************************************************************/
+/* Select a predictor and start it cold                                                           */
+/***************************************************************/
+void bpred_init(int kind)
+{
+	int i;
+
+	BPRED_KIND = kind;
+	/* weakly not-taken; the chooser weakly prefers bimodal */
+	memset(BPRED_BIMODAL_PHT, 1, sizeof(BPRED_BIMODAL_PHT));
+	memset(BPRED_GSHARE_PHT, 1, sizeof(BPRED_GSHARE_PHT));
+	memset(BPRED_CHOOSER, 1, sizeof(BPRED_CHOOSER));
+	BPRED_HISTORY = 0;
+	for (i = 0; i < BPRED_BTB_ENTRIES; i++) {
+		BPRED_BTB_TABLE[i].pc = MEM_TLB_INVALID;
+	}
+	BPRED_RAS_TOP = 0;
+	memset(&BPRED_STATS, 0, sizeof(BPRED_STATS));
+}
+
+/***************************************************************/
+/* Direction of a conditional branch whose target the BTB knows          */
+/***************************************************************/
+static int bpred_direction(uint32_t pc)
+{
+	uint32_t local = (pc >> 2) & BPRED_PHT_MASK;
+	uint32_t global = ((pc >> 2) ^ BPRED_HISTORY) & BPRED_PHT_MASK;
+
+	switch (BPRED_KIND) {
+		case BPRED_BIMODAL:
+			return BPRED_BIMODAL_PHT[local] >= 2;
+		case BPRED_GSHARE:
+			return BPRED_GSHARE_PHT[global] >= 2;
+		case BPRED_TOURNAMENT:
+			return BPRED_CHOOSER[local] >= 2 ? BPRED_GSHARE_PHT[global] >= 2 : BPRED_BIMODAL_PHT[local] >= 2;
+		default:
+			return 1;
+	}
+}
+
+/***************************************************************/
+/* Next PC to fetch after the branch or jump at pc                                  */
+/***************************************************************/
+uint32_t bpred_predict(uint32_t pc, const decoded_inst_t *inst)
+{
+	bpred_btb_entry_t *e = &BPRED_BTB_TABLE[(pc >> 2) & (BPRED_BTB_ENTRIES - 1)];
+
+	if (BPRED_KIND == BPRED_NOTTAKEN) {
+		return pc + 4;
+	}
+	if (inst->op == OP_JR && inst->rs == 31 && BPRED_RAS_TOP > 0) {
+		BPRED_RAS_TOP--;
+		return BPRED_RAS[BPRED_RAS_TOP % BPRED_RAS_ENTRIES];
+	}
+	if (inst->op == OP_JAL || inst->op == OP_JALR) {
+		BPRED_RAS[BPRED_RAS_TOP % BPRED_RAS_ENTRIES] = pc + 4;
+		BPRED_RAS_TOP++;
+	}
+	if (e->pc != pc) {
+		return pc + 4;
+	}
+	if ((inst->flags & DEC_JUMP) || bpred_direction(pc)) {
+		return e->target;
+	}
+	return pc + 4;
+}
+
+/***************************************************************/
+/* Train on a resolved branch or jump and count the outcome                    */
+/***************************************************************/
+void bpred_update(uint32_t pc, const decoded_inst_t *inst, int taken, uint32_t target, uint32_t predicted, uint32_t penalty)
+{
+	uint32_t actual = taken ? target : pc + 4;
+	uint32_t local = (pc >> 2) & BPRED_PHT_MASK;
+	uint32_t global = ((pc >> 2) ^ BPRED_HISTORY) & BPRED_PHT_MASK;
+	bpred_btb_entry_t *e = &BPRED_BTB_TABLE[(pc >> 2) & (BPRED_BTB_ENTRIES - 1)];
+	int bimodal, gshare;
+
+	if (inst->flags & DEC_BRANCH) {
+		BPRED_STATS.cond++;
+		BPRED_STATS.cond_correct += actual == predicted;
+
+		bimodal = BPRED_BIMODAL_PHT[local] >= 2;
+		gshare = BPRED_GSHARE_PHT[global] >= 2;
+		if (bimodal != gshare) {
+			bpred_train(&BPRED_CHOOSER[local], gshare == taken);
+		}
+		bpred_train(&BPRED_BIMODAL_PHT[local], taken);
+		bpred_train(&BPRED_GSHARE_PHT[global], taken);
+		BPRED_HISTORY = ((BPRED_HISTORY << 1) | taken) & BPRED_PHT_MASK;
+	}else {
+		BPRED_STATS.jumps++;
+		BPRED_STATS.jumps_correct += actual == predicted;
+	}
+	if (actual != predicted) {
+		BPRED_STATS.mispredicts++;
+		BPRED_STATS.penalty += penalty;
+	}
+
+	if (taken) {
+		e->pc = pc;
+		e->target = target;
+	}else if (BPRED_KIND == BPRED_BTB && e->pc == pc) {
+		/* the BTB is the whole predictor: forget branches that fell through */
+		e->pc = MEM_TLB_INVALID;
+	}
+}
+
+/***************************************************************/
+/* Checkpoint the predictor as little-endian words                                   */
+/***************************************************************/
+void bpred_save(FILE *fp)
+{
+	int i;
+
+	ckpt_put(fp, BPRED_KIND);
+	fwrite(BPRED_BIMODAL_PHT, sizeof(BPRED_BIMODAL_PHT), 1, fp);
+	fwrite(BPRED_GSHARE_PHT, sizeof(BPRED_GSHARE_PHT), 1, fp);
+	fwrite(BPRED_CHOOSER, sizeof(BPRED_CHOOSER), 1, fp);
+	ckpt_put(fp, BPRED_HISTORY);
+	for (i = 0; i < BPRED_BTB_ENTRIES; i++) {
+		ckpt_put(fp, BPRED_BTB_TABLE[i].pc);
+		ckpt_put(fp, BPRED_BTB_TABLE[i].target);
+	}
+	for (i = 0; i < BPRED_RAS_ENTRIES; i++) {
+		ckpt_put(fp, BPRED_RAS[i]);
+	}
+	ckpt_put(fp, BPRED_RAS_TOP);
+	ckpt_put(fp, BPRED_STATS.cond);
+	ckpt_put(fp, BPRED_STATS.cond_correct);
+	ckpt_put(fp, BPRED_STATS.jumps);
+	ckpt_put(fp, BPRED_STATS.jumps_correct);
+	ckpt_put(fp, BPRED_STATS.mispredicts);
+	ckpt_put(fp, BPRED_STATS.penalty);
+}
+
+/***************************************************************/
+/* Restore a predictor saved by bpred_save(); -1 if the file is short    */
+/***************************************************************/
+int bpred_load(FILE *fp)
+{
+	int i, ok = 1;
+	uint32_t kind = ckpt_get(fp, &ok);
+
+	if (!ok || kind >= BPRED_KINDS) {
+		return -1;
+	}
+	bpred_init(kind);
+	if (fread(BPRED_BIMODAL_PHT, sizeof(BPRED_BIMODAL_PHT), 1, fp) != 1 ||
+		fread(BPRED_GSHARE_PHT, sizeof(BPRED_GSHARE_PHT), 1, fp) != 1 ||
+		fread(BPRED_CHOOSER, sizeof(BPRED_CHOOSER), 1, fp) != 1) {
+		return -1;
+	}
+	BPRED_HISTORY = ckpt_get(fp, &ok) & BPRED_PHT_MASK;
+	for (i = 0; i < BPRED_BTB_ENTRIES; i++) {
+		BPRED_BTB_TABLE[i].pc = ckpt_get(fp, &ok);
+		BPRED_BTB_TABLE[i].target = ckpt_get(fp, &ok);
+	}
+	for (i = 0; i < BPRED_RAS_ENTRIES; i++) {
+		BPRED_RAS[i] = ckpt_get(fp, &ok);
+	}
+	BPRED_RAS_TOP = ckpt_get(fp, &ok);
+	BPRED_STATS.cond = ckpt_get(fp, &ok);
+	BPRED_STATS.cond_correct = ckpt_get(fp, &ok);
+	BPRED_STATS.jumps = ckpt_get(fp, &ok);
+	BPRED_STATS.jumps_correct = ckpt_get(fp, &ok);
+	BPRED_STATS.mispredicts = ckpt_get(fp, &ok);
+	BPRED_STATS.penalty = ckpt_get(fp, &ok);
+	return ok ? 0 : -1;
+}
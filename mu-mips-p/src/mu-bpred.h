@@ -0,0 +1,72 @@
+#ifndef MU_BPRED_H
+#define MU_BPRED_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-decode.h"
+
+/******************************************************************************/
+/* Branch prediction                                                                                                                               */
+/******************************************************************************/
+/* IF() asks for the next PC of every branch or jump it fetches; EX() reports
+ * the outcome and redirects the pipeline when the guess was wrong. Every
+ * predictor but BPRED_NOTTAKEN finds taken targets in a direct-mapped BTB
+ * and return addresses (JR $ra) on a return address stack. Direction
+ * tables hold 2-bit saturating counters and are trained at resolution. */
+#define BPRED_NOTTAKEN     0	/* always fall through */
+#define BPRED_BIMODAL      1	/* per-PC counters */
+#define BPRED_GSHARE        2	/* counters indexed by PC ^ global history */
+#define BPRED_TOURNAMENT 3	/* per-PC chooser between bimodal and gshare */
+#define BPRED_BTB              4	/* taken whenever the BTB hits */
+#define BPRED_KINDS           5
+
+#define BPRED_PHT_BITS      12
+#define BPRED_PHT_ENTRIES (1 << BPRED_PHT_BITS)
+#define BPRED_BTB_ENTRIES 512
+#define BPRED_RAS_ENTRIES 16
+
+typedef struct {
+	uint32_t cond;               /* conditional branches resolved */
+	uint32_t cond_correct;   /* ... with the right next PC */
+	uint32_t jumps;              /* J, JAL, JR, JALR resolved */
+	uint32_t jumps_correct;
+	uint32_t mispredicts;      /* redirects, either kind */
+	uint32_t penalty;            /* cycles lost to them */
+} bpred_stats_t;
+
+typedef struct {
+	uint32_t pc;	/* MEM_TLB_INVALID when empty */
+	uint32_t target;
+} bpred_btb_entry_t;
+
+/* one simulator instance's predictor; BPRED_CTX is per thread, like MEM_CTX */
+typedef struct {
+	int kind;
+	bpred_stats_t stats;
+	uint8_t bimodal_pht[BPRED_PHT_ENTRIES];
+	uint8_t gshare_pht[BPRED_PHT_ENTRIES];
+	uint8_t chooser[BPRED_PHT_ENTRIES];	/* >= 2 picks gshare */
+	uint32_t history;
+	bpred_btb_entry_t btb[BPRED_BTB_ENTRIES];
+	uint32_t ras[BPRED_RAS_ENTRIES];
+	uint32_t ras_top;	/* pushes minus pops; wraps over the oldest */
+} bpred_ctx_t;
+
+extern __thread bpred_ctx_t *BPRED_CTX;
+extern const char *BPRED_NAMES[];
+
+#define BPRED_KIND   (BPRED_CTX->kind)
+#define BPRED_STATS (BPRED_CTX->stats)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int bpred_lookup_kind(const char *name);
+void bpred_init(int kind);
+uint32_t bpred_predict(uint32_t pc, const decoded_inst_t *inst);
+void bpred_update(uint32_t pc, const decoded_inst_t *inst, int taken, uint32_t target, uint32_t predicted, uint32_t penalty);
+void bpred_save(FILE *fp);
+int bpred_load(FILE *fp);
+
+#endif
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-cache.h"
+
+const char *CACHE_POLICY_NAMES[] = { "lru", "plru", "random" };
+
+static int cache_is_pow2(uint32_t x)
+{
+	return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t cache_log2(uint32_t x)
+{
+	uint32_t n = 0;
+	while (x > 1) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Set the geometry and policies and start empty. Sizes must be powers */
+/* of two; returns -1 (leaving the cache disabled) if they are not.     */
+/***************************************************************/
+int cache_configure(cache_t *c, uint32_t size, uint32_t assoc, uint32_t line, int policy, int write_back, uint32_t hit_latency, uint32_t miss_latency, uint32_t mshrs)
+{
+	cache_disable(c);
+	if (!cache_is_pow2(size) || !cache_is_pow2(assoc) || !cache_is_pow2(line) ||
+		line < 4 || assoc > CACHE_MAX_ASSOC || size < assoc * line ||
+		policy < 0 || policy >= CACHE_POLICIES || hit_latency == 0 || miss_latency < hit_latency ||
+		mshrs > CACHE_MAX_MSHRS) {
+		return -1;
+	}
+	c->size = size;
+	c->assoc = assoc;
+	c->line = line;
+	c->policy = policy;
+	c->write_back = write_back;
+	c->hit_latency = hit_latency;
+	c->miss_latency = miss_latency;
+	c->mshrs = mshrs;
+	c->sets = size / (assoc * line);
+	c->line_shift = cache_log2(line);
+
+	c->tags = malloc(c->sets * assoc * sizeof(uint32_t));
+	c->stamps = malloc(c->sets * assoc * sizeof(uint32_t));
+	c->plru = malloc(c->sets * sizeof(uint32_t));
+	c->dirty = malloc(c->sets * assoc);
+	c->mshr_busy = malloc((mshrs > 0 ? mshrs : 1) * sizeof(uint32_t));
+	if (c->tags == NULL || c->stamps == NULL || c->plru == NULL || c->dirty == NULL || c->mshr_busy == NULL) {
+		error_fatal("Out of memory allocating a %u byte cache\n", size);
+	}
+	c->enabled = 1;
+	cache_flush(c);
+	return 0;
+}
+
+/***************************************************************/
+/* Turn the model off: every access takes no extra time                      */
+/***************************************************************/
+void cache_disable(cache_t *c)
+{
+	free(c->tags);
+	free(c->stamps);
+	free(c->plru);
+	free(c->dirty);
+	free(c->mshr_busy);
+	c->tags = NULL;
+	c->stamps = NULL;
+	c->plru = NULL;
+	c->dirty = NULL;
+	c->mshr_busy = NULL;
+	c->enabled = 0;
+	memset(&c->stats, 0, sizeof(c->stats));
+}
+
+/***************************************************************/
+/* Invalidate every line and clear the counters                                         */
+/***************************************************************/
+void cache_flush(cache_t *c)
+{
+	uint32_t i;
+
+	memset(&c->stats, 0, sizeof(c->stats));
+	if (!c->enabled) {
+		return;
+	}
+	for (i = 0; i < c->sets * c->assoc; i++) {
+		c->tags[i] = CACHE_INVALID;
+	}
+	memset(c->stamps, 0, c->sets * c->assoc * sizeof(uint32_t));
+	memset(c->plru, 0, c->sets * sizeof(uint32_t));
+	memset(c->dirty, 0, c->sets * c->assoc);
+	memset(c->mshr_busy, 0, (c->mshrs > 0 ? c->mshrs : 1) * sizeof(uint32_t));
+	c->clock = 1;
+}
+
+/***************************************************************/
+/* Replacement state: record a use of way, or pick the way to evict      */
+/***************************************************************/
+static void cache_touch(cache_t *c, uint32_t set, uint32_t way)
+{
+	uint32_t node = 1, bit, level, levels;
+
+	if (c->policy == CACHE_LRU) {
+		c->stamps[set * c->assoc + way] = c->clock++;
+	}else if (c->policy == CACHE_PLRU) {
+		/* point every node on the path away from way */
+		levels = cache_log2(c->assoc);
+		for (level = 0; level < levels; level++) {
+			bit = (way >> (levels - 1 - level)) & 1;
+			if (bit) {
+				c->plru[set] &= ~(1u << node);
+			}else {
+				c->plru[set] |= 1u << node;
+			}
+			node = 2 * node + bit;
+		}
+	}
+}
+
+static uint32_t cache_victim(cache_t *c, uint32_t set)
+{
+	const uint32_t *tags = c->tags + set * c->assoc;
+	const uint32_t *stamps = c->stamps + set * c->assoc;
+	uint32_t way, best = 0, node = 1, level, levels;
+
+	for (way = 0; way < c->assoc; way++) {
+		if (tags[way] == CACHE_INVALID) {
+			return way;
+		}
+	}
+	switch (c->policy) {
+		case CACHE_LRU:
+			for (way = 1; way < c->assoc; way++) {
+				if (stamps[way] < stamps[best]) {
+					best = way;
+				}
+			}
+			return best;
+		case CACHE_PLRU:
+			levels = cache_log2(c->assoc);
+			for (level = 0; level < levels; level++) {
+				node = 2 * node + ((c->plru[set] >> node) & 1);
+			}
+			return node - c->assoc;
+		default:
+			/* xorshift32 */
+			c->clock ^= c->clock << 13;
+			c->clock ^= c->clock >> 17;
+			c->clock ^= c->clock << 5;
+			return c->clock & (c->assoc - 1);
+	}
+}
+
+/***************************************************************/
+/* Send bytes at address to the level below at cycle now and return     */
+/* how long it takes                                                                                        */
+/***************************************************************/
+static uint32_t cache_below(cache_t *c, uint32_t address, uint32_t bytes, int write, uint32_t now)
+{
+	c->stats.bytes += bytes;
+	if (c->next != NULL && c->next->enabled) {
+		return cache_access(c->next, address, write, now);
+	}
+	if (c->dram != NULL && c->dram->enabled) {
+		return dram_access(c->dram, address, bytes, now);
+	}
+	return c->miss_latency - c->hit_latency;
+}
+
+/***************************************************************/
+/* Fetch the line at address from below once an MSHR is free. Returns  */
+/* the cycles spent waiting and filling.                                                        */
+/***************************************************************/
+static uint32_t cache_fill(cache_t *c, uint32_t address, uint32_t now)
+{
+	uint32_t i, *mshr = NULL, wait = 0, fill;
+
+	if (c->mshrs > 0) {
+		mshr = &c->mshr_busy[0];
+		for (i = 1; i < c->mshrs; i++) {
+			if ((int32_t)(c->mshr_busy[i] - *mshr) < 0) {
+				mshr = &c->mshr_busy[i];
+			}
+		}
+		if ((int32_t)(*mshr - now) > 0) {
+			wait = *mshr - now;
+			c->stats.mshr_wait += wait;
+		}
+	}
+	fill = cache_below(c, address & ~(c->line - 1), c->line, 0, now + wait);
+	if (mshr != NULL) {
+		*mshr = now + wait + fill;
+	}
+	return wait + fill;
+}
+
+/***************************************************************/
+/* Look up address at cycle now, filling the line on a miss. Returns   */
+/* the latency.                                                                                              */
+/***************************************************************/
+uint32_t cache_access(cache_t *c, uint32_t address, int write, uint32_t now)
+{
+	uint32_t tag = address >> c->line_shift;
+	uint32_t set = tag & (c->sets - 1);
+	uint32_t *tags = c->tags + set * c->assoc;
+	uint32_t way, latency = c->hit_latency;
+
+	c->stats.accesses++;
+	for (way = 0; way < c->assoc; way++) {
+		if (tags[way] == tag) {
+			c->stats.hits++;
+			cache_touch(c, set, way);
+			if (write && c->write_back) {
+				c->dirty[set * c->assoc + way] = 1;
+			}else if (write) {
+				cache_below(c, address, 4, 1, now);
+			}
+			c->stats.latency += latency;
+			return latency;
+		}
+	}
+
+	c->stats.misses++;
+	if (write && !c->write_back) {
+		/* no write-allocate: the store goes to the write buffer */
+		cache_below(c, address, 4, 1, now);
+		c->stats.latency += latency;
+		return latency;
+	}
+	way = cache_victim(c, set);
+	if (tags[way] != CACHE_INVALID) {
+		c->stats.evictions++;
+		if (c->dirty[set * c->assoc + way]) {
+			c->stats.writebacks++;
+			cache_below(c, tags[way] << c->line_shift, c->line, 1, now);
+		}
+	}
+	tags[way] = tag;
+	c->dirty[set * c->assoc + way] = write && c->write_back;
+	cache_touch(c, set, way);
+	latency += cache_fill(c, address, now + c->hit_latency);
+	c->stats.latency += latency;
+	return latency;
+}
+
+/***************************************************************/
+/* Report the counters, one line for rdump or one JSON object            */
+/***************************************************************/
+void cache_print(const cache_t *c, uint32_t cycles)
+{
+	if (!c->enabled) {
+		return;
+	}
+	printf("# %s (%uB %u-way %uB %s %s)\t: accesses %u, misses %u (%.2f%%), evictions %u, writebacks %u, AMAT %.2f, %.3f B/cycle\n",
+		c->name, c->size, c->assoc, c->line, CACHE_POLICY_NAMES[c->policy], c->write_back ? "wb" : "wt",
+		c->stats.accesses, c->stats.misses,
+		c->stats.accesses > 0 ? 100.0 * c->stats.misses / c->stats.accesses : 0.0,
+		c->stats.evictions, c->stats.writebacks,
+		c->stats.accesses > 0 ? (double)c->stats.latency / c->stats.accesses : 0.0,
+		cycles > 0 ? (double)c->stats.bytes / cycles : 0.0);
+	if (c->mshrs > 0 && c->stats.mshr_wait > 0) {
+		printf("# %s MSHRs (%u)\t: misses waited %u cycles for a free MSHR\n", c->name, c->mshrs, c->stats.mshr_wait);
+	}
+}
+
+void cache_print_json(const cache_t *c, FILE *fp)
+{
+	if (!c->enabled) {
+		fprintf(fp, "null");
+		return;
+	}
+	fprintf(fp, "{ \"size\": %u, \"assoc\": %u, \"line\": %u, \"policy\": \"%s\", \"write_back\": %s, \"mshrs\": %u, "
+		"\"accesses\": %u, \"hits\": %u, \"misses\": %u, \"evictions\": %u, \"writebacks\": %u, "
+		"\"mshr_wait\": %u, \"latency\": %llu, \"bytes\": %llu }",
+		c->size, c->assoc, c->line, CACHE_POLICY_NAMES[c->policy], c->write_back ? "true" : "false", c->mshrs,
+		c->stats.accesses, c->stats.hits, c->stats.misses, c->stats.evictions, c->stats.writebacks,
+		c->stats.mshr_wait, (unsigned long long)c->stats.latency, (unsigned long long)c->stats.bytes);
+}
+
+/***************************************************************/
+/* Checkpoint the configuration, contents and counters as                 */
+/* little-endian words                                                                                   */
+/***************************************************************/
+void cache_save(const cache_t *c, FILE *fp)
+{
+	uint32_t i;
+
+	ckpt_put(fp, c->enabled);
+	if (!c->enabled) {
+		return;
+	}
+	ckpt_put(fp, c->size);
+	ckpt_put(fp, c->assoc);
+	ckpt_put(fp, c->line);
+	ckpt_put(fp, c->policy);
+	ckpt_put(fp, c->write_back);
+	ckpt_put(fp, c->hit_latency);
+	ckpt_put(fp, c->miss_latency);
+	ckpt_put(fp, c->mshrs);
+	ckpt_put(fp, c->clock);
+	for (i = 0; i < c->sets * c->assoc; i++) {
+		ckpt_put(fp, c->tags[i]);
+		ckpt_put(fp, c->stamps[i]);
+	}
+	for (i = 0; i < c->sets; i++) {
+		ckpt_put(fp, c->plru[i]);
+	}
+	fwrite(c->dirty, c->sets * c->assoc, 1, fp);
+	for (i = 0; i < c->mshrs; i++) {
+		ckpt_put(fp, c->mshr_busy[i]);
+	}
+	ckpt_put(fp, c->stats.accesses);
+	ckpt_put(fp, c->stats.hits);
+	ckpt_put(fp, c->stats.misses);
+	ckpt_put(fp, c->stats.evictions);
+	ckpt_put(fp, c->stats.writebacks);
+	ckpt_put(fp, c->stats.mshr_wait);
+	ckpt_put(fp, c->stats.latency & 0xFFFFFFFF);
+	ckpt_put(fp, c->stats.latency >> 32);
+	ckpt_put(fp, c->stats.bytes & 0xFFFFFFFF);
+	ckpt_put(fp, c->stats.bytes >> 32);
+}
+
+/***************************************************************/
+/* Restore a cache saved by cache_save(); -1 if the file is short or bad */
+/***************************************************************/
+int cache_load(cache_t *c, FILE *fp)
+{
+	uint32_t i, size, assoc, line, policy, write_back, hit, miss, mshrs;
+	int ok = 1;
+
+	cache_disable(c);
+	if (!ckpt_get(fp, &ok)) {
+		return ok ? 0 : -1;
+	}
+	size = ckpt_get(fp, &ok);
+	assoc = ckpt_get(fp, &ok);
+	line = ckpt_get(fp, &ok);
+	policy = ckpt_get(fp, &ok);
+	write_back = ckpt_get(fp, &ok);
+	hit = ckpt_get(fp, &ok);
+	miss = ckpt_get(fp, &ok);
+	mshrs = ckpt_get(fp, &ok);
+	if (!ok || cache_configure(c, size, assoc, line, policy, write_back, hit, miss, mshrs) != 0) {
+		return -1;
+	}
+	c->clock = ckpt_get(fp, &ok);
+	for (i = 0; i < c->sets * c->assoc; i++) {
+		c->tags[i] = ckpt_get(fp, &ok);
+		c->stamps[i] = ckpt_get(fp, &ok);
+	}
+	for (i = 0; i < c->sets; i++) {
+		c->plru[i] = ckpt_get(fp, &ok);
+	}
+	if (fread(c->dirty, c->sets * c->assoc, 1, fp) != 1) {
+		ok = 0;
+	}
+	for (i = 0; i < c->mshrs; i++) {
+		c->mshr_busy[i] = ckpt_get(fp, &ok);
+	}
+	c->stats.accesses = ckpt_get(fp, &ok);
+	c->stats.hits = ckpt_get(fp, &ok);
+	c->stats.misses = ckpt_get(fp, &ok);
+	c->stats.evictions = ckpt_get(fp, &ok);
+	c->stats.writebacks = ckpt_get(fp, &ok);
+	c->stats.mshr_wait = ckpt_get(fp, &ok);
+	c->stats.latency = ckpt_get(fp, &ok);
+	c->stats.latency |= (uint64_t)ckpt_get(fp, &ok) << 32;
+	c->stats.bytes = ckpt_get(fp, &ok);
+	c->stats.bytes |= (uint64_t)ckpt_get(fp, &ok) << 32;
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,82 @@
+#ifndef MU_CACHE_H
+#define MU_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-dram.h"
+
+/******************************************************************************/
+/* Cache timing model                                                                                                                             */
+/******************************************************************************/
+/* Caches only track which lines are resident; data always comes from the
+ * functional memory in mu-mem. cache_access() returns the latency of one
+ * access in cycles. Write-back caches allocate on a store miss; write-through
+ * caches do not, and their stores go straight to a write buffer at hit
+ * latency. Tags, LRU stamps and dirty bits live in separate arrays laid out
+ * set by set, so a lookup only walks the assoc tags of one set.
+ *
+ * Levels chain through next (another cache) or dram: a miss costs the hit
+ * latency plus whatever the level below takes, and dirty victims and
+ * write-through stores are sent down without adding to it. The last level
+ * charges miss_latency when nothing is behind it. Each miss holds one of
+ * mshrs miss registers until its fill returns; when all are busy the miss
+ * waits for the first to free (0 means unlimited). */
+#define CACHE_LRU       0
+#define CACHE_PLRU     1	/* tree pseudo-LRU */
+#define CACHE_RANDOM 2
+#define CACHE_POLICIES 3
+
+#define CACHE_INVALID 0xFFFFFFFF	/* tag of an empty way */
+#define CACHE_MAX_ASSOC 32	/* PLRU keeps assoc - 1 tree bits in a word */
+#define CACHE_MAX_MSHRS 64
+
+typedef struct {
+	uint32_t accesses;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;       /* valid lines replaced */
+	uint32_t writebacks;     /* dirty lines replaced (write-back only) */
+	uint32_t mshr_wait;      /* cycles misses waited for a free MSHR */
+	uint64_t latency;          /* cycles summed over all accesses */
+	uint64_t bytes;            /* moved to and from the level below */
+} cache_stats_t;
+
+typedef struct cache cache_t;
+
+struct cache {
+	const char *name;
+	int enabled;
+	uint32_t size, assoc, line;	/* bytes, ways, bytes */
+	int policy;                              /* CACHE_* */
+	int write_back;                        /* else write-through, no write-allocate */
+	uint32_t hit_latency, miss_latency;
+	uint32_t mshrs;
+	cache_t *next;                          /* level below, or NULL */
+	dram_t *dram;                          /* DRAM below when next is NULL */
+
+	uint32_t sets, line_shift;
+	uint32_t *tags;                       /* sets * assoc, line address or CACHE_INVALID */
+	uint32_t *stamps;                   /* LRU: last use of each way */
+	uint32_t *plru;                       /* PLRU: tree bits of each set */
+	uint8_t *dirty;                       /* sets * assoc */
+	uint32_t clock;                       /* LRU time / random state */
+	uint32_t *mshr_busy;              /* mshrs, cycle each register frees */
+	cache_stats_t stats;
+};
+
+extern const char *CACHE_POLICY_NAMES[];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int cache_configure(cache_t *c, uint32_t size, uint32_t assoc, uint32_t line, int policy, int write_back, uint32_t hit_latency, uint32_t miss_latency, uint32_t mshrs);
+void cache_disable(cache_t *c);
+void cache_flush(cache_t *c);
+uint32_t cache_access(cache_t *c, uint32_t address, int write, uint32_t now);
+void cache_print(const cache_t *c, uint32_t cycles);
+void cache_print_json(const cache_t *c, FILE *fp);
+void cache_save(const cache_t *c, FILE *fp);
+int cache_load(cache_t *c, FILE *fp);
+
+#endif
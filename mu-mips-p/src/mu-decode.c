@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-decode.h"
+
+decoded_inst_t DECODE_BUBBLE = { .flags = DEC_VALID | DEC_BUBBLE };
+
+/* mnemonics, indexed by OP_* */
+const char *DECODE_OP_NAMES[OP_COUNT] = {
+	"invalid",
+	"sll", "srl", "sra", "jr", "jalr", "syscall",
+	"mfhi", "mthi", "mflo", "mtlo", "mult", "multu", "div", "divu",
+	"add", "addu", "sub", "subu", "and", "or", "xor", "nor", "slt",
+	"bltz", "bgez", "j", "jal", "beq", "bne", "blez", "bgtz",
+	"addi", "addiu", "slti", "andi", "ori", "xori", "lui",
+	"lb", "lh", "lw", "sb", "sh", "sw"
+};
+
+static decode_ctx_t DECODE_DEFAULT;
+__thread decode_ctx_t *DECODE_CTX = &DECODE_DEFAULT;
+
+#define DECODE_CACHE               (DECODE_CTX->cache)
+#define DECODE_BASE                 (DECODE_CTX->base)
+#define DECODE_WORDS              (DECODE_CTX->words)
+#define DECODE_SCRATCH_RING  (DECODE_CTX->scratch_ring)
+#define DECODE_SCRATCH_NEXT  (DECODE_CTX->scratch_next)
+#define DECODE_EX_HANDLERS   (DECODE_CTX->ex_handlers)
+#define DECODE_MEM_HANDLERS (DECODE_CTX->mem_handlers)
+
+/* R-type function field -> OP_* */
+static const uint8_t DECODE_R_OPS[64] = {
+	[0x00] = OP_SLL, [0x02] = OP_SRL, [0x03] = OP_SRA,
+	[0x08] = OP_JR, [0x09] = OP_JALR, [0x0C] = OP_SYSCALL,
+	[0x10] = OP_MFHI, [0x11] = OP_MTHI, [0x12] = OP_MFLO, [0x13] = OP_MTLO,
+	[0x18] = OP_MULT, [0x19] = OP_MULTU, [0x1A] = OP_DIV, [0x1B] = OP_DIVU,
+	[0x20] = OP_ADD, [0x21] = OP_ADDU, [0x22] = OP_SUB, [0x23] = OP_SUBU,
+	[0x24] = OP_AND, [0x25] = OP_OR, [0x26] = OP_XOR, [0x27] = OP_NOR,
+	[0x2A] = OP_SLT,
+};
+
+/* I/J-type opcode -> OP_* (0x01 is resolved on rt) */
+static const uint8_t DECODE_I_OPS[64] = {
+	[0x02] = OP_J, [0x03] = OP_JAL, [0x04] = OP_BEQ, [0x05] = OP_BNE,
+	[0x06] = OP_BLEZ, [0x07] = OP_BGTZ,
+	[0x08] = OP_ADDI, [0x09] = OP_ADDIU, [0x0A] = OP_SLTI,
+	[0x0C] = OP_ANDI, [0x0D] = OP_ORI, [0x0E] = OP_XORI, [0x0F] = OP_LUI,
+	[0x20] = OP_LB, [0x21] = OP_LH, [0x23] = OP_LW,
+	[0x28] = OP_SB, [0x29] = OP_SH, [0x2B] = OP_SW,
+};
+
+/***************************************************************/
+/* Install the EX/MEM handler tables used by the threaded core           */
+/***************************************************************/
+void decode_set_handlers(const stage_handler_t *ex, const stage_handler_t *mem)
+{
+	DECODE_EX_HANDLERS = ex;
+	DECODE_MEM_HANDLERS = mem;
+}
+
+/***************************************************************/
+/* Decode one instruction word                                                                                  */
+/***************************************************************/
+void decode_inst(uint32_t ir, decoded_inst_t *d)
+{
+	uint32_t immediate = ir & 0x0000FFFF;
+	uint32_t simm = (immediate & 0x8000) ? (immediate | 0xFFFF0000) : immediate;
+
+	memset(d, 0, sizeof(*d));
+	d->IR = ir;
+	d->opcode = (ir & 0xFC000000) >> 26;
+	d->function = ir & 0x0000003F;
+	d->rs = (ir & 0x03E00000) >> 21;
+	d->rt = (ir & 0x001F0000) >> 16;
+	d->rd = (ir & 0x0000F800) >> 11;
+	d->sa = (ir & 0x000007C0) >> 6;
+	d->imm = simm;
+	d->target = (ir & 0x03FFFFFF) << 2;
+	d->flags = DEC_VALID;
+
+	if (d->opcode == 0x00) {
+		d->op = DECODE_R_OPS[d->function];
+	}
+	else if (d->opcode == 0x01) {
+		d->op = d->rt == 0x00 ? OP_BLTZ : d->rt == 0x01 ? OP_BGEZ : OP_INVALID;
+	}
+	else {
+		d->op = DECODE_I_OPS[d->opcode];
+	}
+
+	switch (d->op) {
+		case OP_SLL:
+		case OP_SRL:
+		case OP_SRA:
+			d->dest = d->rd;
+			d->flags |= DEC_READS_RT;
+			break;
+		case OP_JR:
+			d->flags |= DEC_JUMP | DEC_READS_RS;
+			break;
+		case OP_JALR:
+			d->dest = d->rd;
+			d->flags |= DEC_JUMP | DEC_READS_RS;
+			break;
+		case OP_SYSCALL:
+			break;
+		case OP_MFHI:
+		case OP_MFLO:
+			d->dest = d->rd;
+			d->flags |= DEC_HILO;
+			break;
+		case OP_MTHI:
+		case OP_MTLO:
+			d->flags |= DEC_HILO | DEC_READS_RS;
+			break;
+		case OP_MULT:
+		case OP_MULTU:
+		case OP_DIV:
+		case OP_DIVU:
+			d->flags |= DEC_HILO | DEC_READS_RS | DEC_READS_RT;
+			break;
+		case OP_ADD:
+		case OP_ADDU:
+		case OP_SUB:
+		case OP_SUBU:
+		case OP_AND:
+		case OP_OR:
+		case OP_XOR:
+		case OP_NOR:
+		case OP_SLT:
+			d->dest = d->rd;
+			d->flags |= DEC_READS_RS | DEC_READS_RT;
+			break;
+		case OP_BLTZ:
+		case OP_BGEZ:
+		case OP_BLEZ:
+		case OP_BGTZ:
+			d->flags |= DEC_BRANCH | DEC_READS_RS;
+			break;
+		case OP_J:
+			d->flags |= DEC_JUMP;
+			break;
+		case OP_JAL:
+			d->dest = 31;
+			d->flags |= DEC_JUMP;
+			break;
+		case OP_BEQ:
+		case OP_BNE:
+			d->flags |= DEC_BRANCH | DEC_READS_RS | DEC_READS_RT;
+			break;
+		case OP_ADDI:
+		case OP_ADDIU:
+		case OP_SLTI:
+			d->dest = d->rt;
+			d->flags |= DEC_READS_RS;
+			break;
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+			d->imm = immediate;
+			d->dest = d->rt;
+			d->flags |= DEC_READS_RS;
+			break;
+		case OP_LUI:
+			d->imm = immediate;
+			d->dest = d->rt;
+			break;
+		case OP_LB:
+		case OP_LH:
+		case OP_LW:
+			d->dest = d->rt;
+			d->flags |= DEC_LOAD | DEC_READS_RS;
+			break;
+		case OP_SB:
+		case OP_SH:
+		case OP_SW:
+			d->flags |= DEC_STORE | DEC_READS_RS | DEC_READS_RT;
+			break;
+		default:
+			d->flags |= DEC_UNIMPL;
+			break;
+	}
+
+	if (DECODE_EX_HANDLERS != NULL) {
+		d->exec = DECODE_EX_HANDLERS[d->op];
+		d->mem = DECODE_MEM_HANDLERS[d->op];
+	}
+}
+
+/***************************************************************/
+/* Decode every word of the program image starting at base                    */
+/***************************************************************/
+void decode_program(uint32_t base, uint32_t num_words)
+{
+	uint32_t i;
+
+	free(DECODE_CACHE);
+	DECODE_CACHE = NULL;
+	DECODE_GENERATION++;
+	DECODE_BASE = base;
+	DECODE_WORDS = 0;
+	if (num_words == 0) {
+		return;
+	}
+	DECODE_CACHE = malloc(num_words * sizeof(decoded_inst_t));
+	if (DECODE_CACHE == NULL) {
+		error_fatal("Out of memory decoding %u instructions\n", num_words);
+	}
+	for (i = 0; i < num_words; i++) {
+		decode_inst(mem_read_32(base + 4 * i), &DECODE_CACHE[i]);
+	}
+	DECODE_WORDS = num_words;
+	MEM_TEXT_WRITE_HOOK = decode_invalidate;
+}
+
+/***************************************************************/
+/* Return the decoded instruction at pc                                                              */
+/***************************************************************/
+const decoded_inst_t *decode_fetch(uint32_t pc)
+{
+	uint32_t i = (pc - DECODE_BASE) >> 2;
+	decoded_inst_t *d;
+
+	if (pc >= DECODE_BASE && i < DECODE_WORDS && (pc & 3) == 0) {
+		d = &DECODE_CACHE[i];
+		if (!(d->flags & DEC_VALID)) {
+			decode_inst(mem_read_32(pc), d);
+		}
+		return d;
+	}
+	return decode_scratch(mem_read_32(pc));
+}
+
+/***************************************************************/
+/* Decode a word that has no slot in the program cache                        */
+/***************************************************************/
+const decoded_inst_t *decode_scratch(uint32_t ir)
+{
+	decoded_inst_t *d = &DECODE_SCRATCH_RING[DECODE_SCRATCH_NEXT];
+
+	DECODE_SCRATCH_NEXT = (DECODE_SCRATCH_NEXT + 1) % DECODE_SCRATCH;
+	decode_inst(ir, d);
+	return d;
+}
+
+/***************************************************************/
+/* A store hit the text region: drop the records it overlaps                     */
+/***************************************************************/
+void decode_invalidate(uint32_t address, int size)
+{
+	uint32_t a, last = (address + size - 1) & ~3;
+
+	DECODE_GENERATION++;
+	for (a = address & ~3; a <= last; a += 4) {
+		if (a >= DECODE_BASE && ((a - DECODE_BASE) >> 2) < DECODE_WORDS) {
+			DECODE_CACHE[(a - DECODE_BASE) >> 2].flags &= ~DEC_VALID;
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef MU_DECODE_H
+#define MU_DECODE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Pre-decoded instructions                                                                                                                        */
+/******************************************************************************/
+/* Every text word of the loaded program is decoded once by load_program() and
+ * the pipeline latches carry a pointer to the record instead of the raw IR.
+ * Stores into the text region clear DEC_VALID and the word is decoded again
+ * the next time it is fetched. */
+
+#define DEC_VALID       0x0001  /* record matches memory */
+#define DEC_BUBBLE     0x0002  /* pipeline bubble, not a fetched instruction */
+#define DEC_LOAD         0x0004
+#define DEC_STORE       0x0008
+#define DEC_BRANCH     0x0010  /* conditional branch */
+#define DEC_JUMP         0x0020  /* J, JAL, JR, JALR */
+#define DEC_READS_RS 0x0040
+#define DEC_READS_RT 0x0080
+#define DEC_UNIMPL     0x0100  /* opcode/function EX() does not handle */
+#define DEC_HILO         0x0200  /* reads or writes HI/LO: the mult/div unit */
+
+/* one value per instruction EX() implements; indexes the handler tables */
+enum {
+	OP_INVALID,
+	OP_SLL, OP_SRL, OP_SRA, OP_JR, OP_JALR, OP_SYSCALL,
+	OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO, OP_MULT, OP_MULTU, OP_DIV, OP_DIVU,
+	OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_NOR, OP_SLT,
+	OP_BLTZ, OP_BGEZ, OP_J, OP_JAL, OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ,
+	OP_ADDI, OP_ADDIU, OP_SLTI, OP_ANDI, OP_ORI, OP_XORI, OP_LUI,
+	OP_LB, OP_LH, OP_LW, OP_SB, OP_SH, OP_SW,
+	OP_COUNT
+};
+
+struct CPU_Pipeline_Reg_Struct;
+typedef void (*stage_handler_t)(struct CPU_Pipeline_Reg_Struct *reg);
+
+typedef struct decoded_inst_struct {
+	uint32_t IR;
+	uint32_t imm;          /* sign- or zero-extended as the opcode requires */
+	uint32_t target;       /* J/JAL: 26-bit target field << 2 */
+	uint8_t opcode;
+	uint8_t function;
+	uint8_t rs, rt, rd, sa;
+	uint8_t dest;           /* register written back, 0 if none */
+	uint8_t op;              /* OP_* */
+	uint16_t flags;
+	stage_handler_t exec;  /* EX handler for the threaded core */
+	stage_handler_t mem;  /* MEM handler for the threaded core, NULL if none */
+} decoded_inst_t;
+
+extern decoded_inst_t DECODE_BUBBLE;
+extern const char *DECODE_OP_NAMES[OP_COUNT];
+
+/* fetches outside the loaded program are decoded into a small ring that
+ * outlives any instruction still in flight */
+#define DECODE_SCRATCH 64
+
+/* one simulator instance's records; DECODE_CTX is per thread, like MEM_CTX */
+typedef struct {
+	decoded_inst_t *cache;	/* records for the loaded program, indexed by (PC - base) / 4 */
+	uint32_t base;
+	uint32_t words;
+	decoded_inst_t scratch_ring[DECODE_SCRATCH];
+	int scratch_next;
+	uint32_t generation;	/* bumped whenever records are rebuilt or invalidated */
+	uint32_t branch_bias;	/* DECODE_BRANCH_BIAS */
+	const stage_handler_t *ex_handlers;	/* threaded-core handlers, bound into each record */
+	const stage_handler_t *mem_handlers;
+} decode_ctx_t;
+
+extern __thread decode_ctx_t *DECODE_CTX;
+
+#define DECODE_GENERATION (DECODE_CTX->generation)
+
+/* Where a taken branch goes. Hex and raw programs keep the lab rule,
+ * PC + (offset << 2); ELF programs come from a MIPS toolchain, which
+ * counts the offset from PC + 4, so load_program() sets a bias of 4 for
+ * them. Neither has delay slots: an ELF program runs as MARS runs it with
+ * delayed branching off. */
+#define DECODE_BRANCH_BIAS (DECODE_CTX->branch_bias)
+#define DECODE_BRANCH_TARGET(pc, imm) ((pc) + DECODE_BRANCH_BIAS + ((imm) << 2))
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void decode_set_handlers(const stage_handler_t *ex, const stage_handler_t *mem);
+void decode_inst(uint32_t ir, decoded_inst_t *d);
+void decode_program(uint32_t base, uint32_t num_words);
+const decoded_inst_t *decode_fetch(uint32_t pc);
+const decoded_inst_t *decode_scratch(uint32_t ir);
+void decode_invalidate(uint32_t address, int size);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-decode.h"
+#include "mu-disasm.h"
+
+const char *DISASM_REG_NAMES[32] = {
+	"$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+	"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+	"$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+	"$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"
+};
+
+/***************************************************************/
+/* Static target of a branch or J/JAL at pc; 0 for anything else        */
+/* (JR/JALR jump to a register)                                                                  */
+/***************************************************************/
+int disasm_target(const decoded_inst_t *d, uint32_t pc, uint32_t *target)
+{
+	if (d->flags & DEC_BRANCH) {
+		*target = DECODE_BRANCH_TARGET(pc, d->imm);
+		return 1;
+	}
+	if (d->op == OP_J || d->op == OP_JAL) {
+		*target = (pc & 0xF0000000) | d->target;
+		return 1;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Write the assembly for d at pc into buf. A branch or jump target is  */
+/* printed as label when one is given, as an address otherwise.          */
+/***************************************************************/
+void disasm(const decoded_inst_t *d, uint32_t pc, const char *label, char *buf, size_t len)
+{
+	const char *name = DECODE_OP_NAMES[d->op];
+	const char *rs = DISASM_REG_NAMES[d->rs], *rt = DISASM_REG_NAMES[d->rt], *rd = DISASM_REG_NAMES[d->rd];
+	char where[32] = "";
+	uint32_t target;
+
+	if (disasm_target(d, pc, &target)) {
+		if (label != NULL) {
+			snprintf(where, sizeof(where), "%s", label);
+		}else {
+			snprintf(where, sizeof(where), "0x%08x", target);
+		}
+	}
+
+	switch (d->op) {
+		case OP_SLL:
+			if (d->IR == 0) {
+				snprintf(buf, len, "nop");
+				break;
+			}
+			/* fall through */
+		case OP_SRL:
+		case OP_SRA:
+			snprintf(buf, len, "%s %s, %s, %u", name, rd, rt, d->sa);
+			break;
+		case OP_JR:
+		case OP_MTHI:
+		case OP_MTLO:
+			snprintf(buf, len, "%s %s", name, rs);
+			break;
+		case OP_JALR:
+			if (d->rd == 31) {
+				snprintf(buf, len, "%s %s", name, rs);
+			}else {
+				snprintf(buf, len, "%s %s, %s", name, rd, rs);
+			}
+			break;
+		case OP_SYSCALL:
+			snprintf(buf, len, "%s", name);
+			break;
+		case OP_MFHI:
+		case OP_MFLO:
+			snprintf(buf, len, "%s %s", name, rd);
+			break;
+		case OP_MULT:
+		case OP_MULTU:
+		case OP_DIV:
+		case OP_DIVU:
+			snprintf(buf, len, "%s %s, %s", name, rs, rt);
+			break;
+		case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+		case OP_AND: case OP_OR: case OP_XOR: case OP_NOR: case OP_SLT:
+			snprintf(buf, len, "%s %s, %s, %s", name, rd, rs, rt);
+			break;
+		case OP_BLTZ:
+		case OP_BGEZ:
+		case OP_BLEZ:
+		case OP_BGTZ:
+			snprintf(buf, len, "%s %s, %s", name, rs, where);
+			break;
+		case OP_BEQ:
+		case OP_BNE:
+			snprintf(buf, len, "%s %s, %s, %s", name, rs, rt, where);
+			break;
+		case OP_J:
+		case OP_JAL:
+			snprintf(buf, len, "%s %s", name, where);
+			break;
+		case OP_ADDI:
+		case OP_ADDIU:
+		case OP_SLTI:
+			snprintf(buf, len, "%s %s, %s, %d", name, rt, rs, (int32_t)d->imm);
+			break;
+		case OP_ANDI:
+		case OP_ORI:
+		case OP_XORI:
+			snprintf(buf, len, "%s %s, %s, 0x%x", name, rt, rs, d->imm);
+			break;
+		case OP_LUI:
+			snprintf(buf, len, "%s %s, 0x%x", name, rt, d->IR & 0xFFFF);
+			break;
+		case OP_LB: case OP_LH: case OP_LW:
+		case OP_SB: case OP_SH: case OP_SW:
+			snprintf(buf, len, "%s %s, %d(%s)", name, rt, (int32_t)d->imm, rs);
+			break;
+		default:
+			snprintf(buf, len, ".word 0x%08x", d->IR);
+			break;
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef MU_DISASM_H
+#define MU_DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mu-decode.h"
+
+/******************************************************************************/
+/* Disassembler                                                                                                                                        */
+/******************************************************************************/
+/* Renders a decoded instruction in MIPS assembly with conventional register
+ * names ($t0, $sp, ...). Branch and jump targets are computed the way EX()
+ * computes them: PC + (imm << 2) for branches, the PC's top four bits and
+ * the 26-bit field for J/JAL. Words EX() does not handle print as .word. */
+#define DISASM_LEN 64	/* longest line disasm() writes, with room for a label */
+
+extern const char *DISASM_REG_NAMES[32];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int disasm_target(const decoded_inst_t *d, uint32_t pc, uint32_t *target);
+void disasm(const decoded_inst_t *d, uint32_t pc, const char *label, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-dram.h"
+
+static int dram_is_pow2(uint32_t x)
+{
+	return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t dram_log2(uint32_t x)
+{
+	uint32_t n = 0;
+	while (x > 1) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Set the organisation and timings and close every row. Returns -1     */
+/* (leaving the model disabled) for a bad geometry.                              */
+/***************************************************************/
+int dram_configure(dram_t *d, uint32_t banks, uint32_t row, uint32_t t_hit, uint32_t t_empty, uint32_t t_conflict)
+{
+	dram_disable(d);
+	if (!dram_is_pow2(banks) || !dram_is_pow2(row) || row < 64 ||
+		t_hit == 0 || t_empty < t_hit || t_conflict < t_empty) {
+		return -1;
+	}
+	d->banks = banks;
+	d->row = row;
+	d->t_hit = t_hit;
+	d->t_empty = t_empty;
+	d->t_conflict = t_conflict;
+	d->row_shift = dram_log2(row);
+	d->bank_bits = dram_log2(banks);
+	d->open_row = malloc(banks * sizeof(uint32_t));
+	d->busy_until = malloc(banks * sizeof(uint32_t));
+	if (d->open_row == NULL || d->busy_until == NULL) {
+		error_fatal("Out of memory allocating %u DRAM banks\n", banks);
+	}
+	d->enabled = 1;
+	dram_flush(d);
+	return 0;
+}
+
+void dram_disable(dram_t *d)
+{
+	free(d->open_row);
+	free(d->busy_until);
+	d->open_row = NULL;
+	d->busy_until = NULL;
+	d->enabled = 0;
+	memset(&d->stats, 0, sizeof(d->stats));
+}
+
+/***************************************************************/
+/* Close every row, free every bank and clear the counters                   */
+/***************************************************************/
+void dram_flush(dram_t *d)
+{
+	uint32_t i;
+
+	memset(&d->stats, 0, sizeof(d->stats));
+	for (i = 0; d->enabled && i < d->banks; i++) {
+		d->open_row[i] = DRAM_NO_ROW;
+		d->busy_until[i] = 0;
+	}
+}
+
+/***************************************************************/
+/* Serve a burst of bytes at address requested at cycle now. Returns     */
+/* the cycles until the data is back, waiting for the bank included.     */
+/***************************************************************/
+uint32_t dram_access(dram_t *d, uint32_t address, uint32_t bytes, uint32_t now)
+{
+	uint32_t bank = (address >> d->row_shift) & (d->banks - 1);
+	uint32_t row = address >> (d->row_shift + d->bank_bits);
+	uint32_t wait = 0, service;
+
+	if ((int32_t)(d->busy_until[bank] - now) > 0) {
+		wait = d->busy_until[bank] - now;
+	}
+	if (d->open_row[bank] == row) {
+		d->stats.row_hits++;
+		service = d->t_hit;
+	}else if (d->open_row[bank] == DRAM_NO_ROW) {
+		d->stats.row_empty++;
+		service = d->t_empty;
+	}else {
+		d->stats.row_conflicts++;
+		service = d->t_conflict;
+	}
+	d->open_row[bank] = row;
+	d->busy_until[bank] = now + wait + service;
+
+	d->stats.accesses++;
+	d->stats.bytes += bytes;
+	d->stats.latency += wait + service;
+	return wait + service;
+}
+
+/***************************************************************/
+/* Report AMAT, row-buffer behaviour and bandwidth over cycles             */
+/***************************************************************/
+void dram_print(const dram_t *d, uint32_t cycles)
+{
+	if (!d->enabled) {
+		return;
+	}
+	printf("# DRAM (%u banks, %uB rows)\t: accesses %u, row hits %u, empty %u, conflicts %u, AMAT %.2f, %.3f B/cycle\n",
+		d->banks, d->row, d->stats.accesses, d->stats.row_hits, d->stats.row_empty, d->stats.row_conflicts,
+		d->stats.accesses > 0 ? (double)d->stats.latency / d->stats.accesses : 0.0,
+		cycles > 0 ? (double)d->stats.bytes / cycles : 0.0);
+}
+
+void dram_print_json(const dram_t *d, FILE *fp)
+{
+	if (!d->enabled) {
+		fprintf(fp, "null");
+		return;
+	}
+	fprintf(fp, "{ \"banks\": %u, \"row\": %u, \"accesses\": %u, \"row_hits\": %u, \"row_empty\": %u, \"row_conflicts\": %u, "
+		"\"bytes\": %llu, \"latency\": %llu }",
+		d->banks, d->row, d->stats.accesses, d->stats.row_hits, d->stats.row_empty, d->stats.row_conflicts,
+		(unsigned long long)d->stats.bytes, (unsigned long long)d->stats.latency);
+}
+
+/***************************************************************/
+/* Checkpoint the model as little-endian words                                        */
+/***************************************************************/
+void dram_save(const dram_t *d, FILE *fp)
+{
+	uint32_t i;
+
+	ckpt_put(fp, d->enabled);
+	if (!d->enabled) {
+		return;
+	}
+	ckpt_put(fp, d->banks);
+	ckpt_put(fp, d->row);
+	ckpt_put(fp, d->t_hit);
+	ckpt_put(fp, d->t_empty);
+	ckpt_put(fp, d->t_conflict);
+	for (i = 0; i < d->banks; i++) {
+		ckpt_put(fp, d->open_row[i]);
+		ckpt_put(fp, d->busy_until[i]);
+	}
+	ckpt_put(fp, d->stats.accesses);
+	ckpt_put(fp, d->stats.row_hits);
+	ckpt_put(fp, d->stats.row_empty);
+	ckpt_put(fp, d->stats.row_conflicts);
+	ckpt_put(fp, d->stats.bytes & 0xFFFFFFFF);
+	ckpt_put(fp, d->stats.bytes >> 32);
+	ckpt_put(fp, d->stats.latency & 0xFFFFFFFF);
+	ckpt_put(fp, d->stats.latency >> 32);
+}
+
+/***************************************************************/
+/* Restore a model saved by dram_save(); -1 if the file is short or bad  */
+/***************************************************************/
+int dram_load(dram_t *d, FILE *fp)
+{
+	uint32_t i, banks, row, t_hit, t_empty, t_conflict;
+	int ok = 1;
+
+	dram_disable(d);
+	if (!ckpt_get(fp, &ok)) {
+		return ok ? 0 : -1;
+	}
+	banks = ckpt_get(fp, &ok);
+	row = ckpt_get(fp, &ok);
+	t_hit = ckpt_get(fp, &ok);
+	t_empty = ckpt_get(fp, &ok);
+	t_conflict = ckpt_get(fp, &ok);
+	if (!ok || dram_configure(d, banks, row, t_hit, t_empty, t_conflict) != 0) {
+		return -1;
+	}
+	for (i = 0; i < d->banks; i++) {
+		d->open_row[i] = ckpt_get(fp, &ok);
+		d->busy_until[i] = ckpt_get(fp, &ok);
+	}
+	d->stats.accesses = ckpt_get(fp, &ok);
+	d->stats.row_hits = ckpt_get(fp, &ok);
+	d->stats.row_empty = ckpt_get(fp, &ok);
+	d->stats.row_conflicts = ckpt_get(fp, &ok);
+	d->stats.bytes = ckpt_get(fp, &ok);
+	d->stats.bytes |= (uint64_t)ckpt_get(fp, &ok) << 32;
+	d->stats.latency = ckpt_get(fp, &ok);
+	d->stats.latency |= (uint64_t)ckpt_get(fp, &ok) << 32;
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,47 @@
+#ifndef MU_DRAM_H
+#define MU_DRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* DRAM timing model                                                                                                                           */
+/******************************************************************************/
+/* Open-page DRAM behind the last cache level. Consecutive rows are spread
+ * across the banks; each bank keeps one row open and serves one request at a
+ * time. A request to the open row costs t_hit, to a closed bank t_empty, and
+ * to a bank with another row open t_conflict (precharge + activate). */
+#define DRAM_NO_ROW 0xFFFFFFFF
+
+typedef struct {
+	uint32_t accesses;
+	uint32_t row_hits;
+	uint32_t row_empty;
+	uint32_t row_conflicts;
+	uint64_t bytes;            /* transferred either way */
+	uint64_t latency;         /* cycles summed over all accesses, queueing included */
+} dram_stats_t;
+
+typedef struct {
+	int enabled;
+	uint32_t banks, row;                        /* count, bytes per row */
+	uint32_t t_hit, t_empty, t_conflict;
+	uint32_t row_shift, bank_bits;
+	uint32_t *open_row;                        /* per bank, DRAM_NO_ROW when closed */
+	uint32_t *busy_until;                      /* per bank, cycle it becomes free */
+	dram_stats_t stats;
+} dram_t;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int dram_configure(dram_t *d, uint32_t banks, uint32_t row, uint32_t t_hit, uint32_t t_empty, uint32_t t_conflict);
+void dram_disable(dram_t *d);
+void dram_flush(dram_t *d);
+uint32_t dram_access(dram_t *d, uint32_t address, uint32_t bytes, uint32_t now);
+void dram_print(const dram_t *d, uint32_t cycles);
+void dram_print_json(const dram_t *d, FILE *fp);
+void dram_save(const dram_t *d, FILE *fp);
+int dram_load(dram_t *d, FILE *fp);
+
+#endif
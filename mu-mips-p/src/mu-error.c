@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "mu-error.h"
+
+__thread jmp_buf *ERROR_JMP;
+__thread int ERROR_SILENT;
+
+static __thread char ERROR_MESSAGE[ERROR_LEN];
+
+/***************************************************************/
+/* Keep the message, less its line break, and print it unless silent   */
+/***************************************************************/
+static void error_keep(const char *fmt, va_list ap)
+{
+	size_t len;
+
+	vsnprintf(ERROR_MESSAGE, sizeof(ERROR_MESSAGE), fmt, ap);
+	len = strlen(ERROR_MESSAGE);
+	if (len > 0 && ERROR_MESSAGE[len - 1] == '\n') {
+		ERROR_MESSAGE[len - 1] = '\0';
+	}
+	if (!ERROR_SILENT) {
+		printf("Error: %s\n", ERROR_MESSAGE);
+	}
+}
+
+void error_report(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	error_keep(fmt, ap);
+	va_end(ap);
+}
+
+void error_fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	error_keep(fmt, ap);
+	va_end(ap);
+	if (ERROR_JMP != NULL) {
+		longjmp(*ERROR_JMP, 1);
+	}
+	exit(-1);
+}
+
+/***************************************************************/
+/* The last message reported on this thread, "" if none                        */
+/***************************************************************/
+const char *error_last()
+{
+	return ERROR_MESSAGE;
+}
+
+void error_clear()
+{
+	ERROR_MESSAGE[0] = '\0';
+}
@@ -0,0 +1,28 @@
+#ifndef MU_ERROR_H
+#define MU_ERROR_H
+
+#include <setjmp.h>
+
+/******************************************************************************/
+/* Error reporting                                                                                                                                  */
+/******************************************************************************/
+/* error_report() prints "Error: <message>" the way the simulator always
+ * has and keeps the message as the calling thread's last error.
+ * error_fatal() is for conditions a simulation cannot continue from, such
+ * as running out of memory: after reporting it jumps back to ERROR_JMP,
+ * the recovery point a library call sets for its duration, or exits the
+ * process when there is none. ERROR_SILENT keeps messages off stdout. */
+#define ERROR_LEN 256
+
+extern __thread jmp_buf *ERROR_JMP;	/* NULL outside library calls */
+extern __thread int ERROR_SILENT;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void error_report(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void error_fatal(const char *fmt, ...) __attribute__((format(printf, 1, 2), noreturn));
+const char *error_last();
+void error_clear();
+
+#endif
@@ -0,0 +1,666 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "mu-mips.h"
+
+static jit_ctx_t JIT_DEFAULT;
+__thread jit_ctx_t *JIT_CTX = &JIT_DEFAULT;
+
+#define JIT_FAILED           (JIT_CTX->failed)
+#define JIT_CODE              (JIT_CTX->code)
+#define JIT_CODE_USED    (JIT_CTX->code_used)
+#define JIT_TABLE             (JIT_CTX->table)
+#define JIT_ENTRIES          (JIT_CTX->entries)
+#define JIT_BLOCKS          (JIT_CTX->blocks)
+#define JIT_NUM_BLOCKS (JIT_CTX->num_blocks)
+#define JIT_GENERATION  (JIT_CTX->generation)
+#define JIT_REMAINING     (JIT_CTX->remaining)
+
+/* host code a block can take: the longest sequence one word translates
+ * to, a store with its early exit, for every word and the block's end */
+#define JIT_WORD_BYTES   96
+#define JIT_BLOCK_BYTES ((JIT_BLOCK_LEN + 1) * JIT_WORD_BYTES)
+
+/* the entry and exit stubs open the code buffer; blocks follow */
+#define JIT_EXIT       (JIT_CODE + 6)
+#define JIT_STUBS     16
+
+typedef struct {
+	const decoded_inst_t *inst;
+	uint32_t cost;	/* 1, plus the load-use stall behind the previous word of the block */
+} jit_inst_t;
+
+struct jit_block_struct {
+	uint32_t pc;
+	uint32_t length;	/* words */
+	int branch;	/* the last word is a branch or jump */
+	const uint8_t *code;
+	jit_block_t *link[2];	/* successor last reached falling through / taking the branch */
+	jit_inst_t insts[JIT_BLOCK_LEN];
+};
+
+typedef void (*jit_enter_t)(CPU_State *state, const uint8_t *code);
+
+/***************************************************************/
+/* x86-64 encoding. Guest state lives at [rbx]; eax, ecx and edx are    */
+/* scratch, and edi/esi carry helper arguments.                                     */
+/***************************************************************/
+#define X_EAX 0
+#define X_ECX 1
+#define X_EDX 2
+#define X_ESI 6
+#define X_EDI 7
+
+#define X_CC_E    0x4
+#define X_CC_NE  0x5
+#define X_CC_S    0x8
+#define X_CC_NS  0x9
+#define X_CC_L    0xC
+#define X_CC_LE  0xE
+#define X_CC_G   0xF
+
+#define X_REG(r) (offsetof(CPU_State, REGS) + 4 * (r))
+#define X_HI        offsetof(CPU_State, HI)
+#define X_LO       offsetof(CPU_State, LO)
+#define X_PC       offsetof(CPU_State, PC)
+
+static uint8_t *x_byte(uint8_t *p, uint8_t b)
+{
+	*p = b;
+	return p + 1;
+}
+
+static uint8_t *x_u32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+static uint8_t *x_u64(uint8_t *p, uint64_t v)
+{
+	memcpy(p, &v, 8);
+	return p + 8;
+}
+
+/* opcode reg, [rbx + disp]; for the /digit forms reg is the digit */
+static uint8_t *x_mem(uint8_t *p, uint8_t opcode, int reg, uint32_t disp)
+{
+	p = x_byte(p, opcode);
+	p = x_byte(p, 0x83 | reg << 3);
+	return x_u32(p, disp);
+}
+
+/* mov dword [rbx + disp], imm */
+static uint8_t *x_mem_imm(uint8_t *p, uint32_t disp, uint32_t imm)
+{
+	p = x_mem(p, 0xC7, 0, disp);
+	return x_u32(p, imm);
+}
+
+/* mov reg, imm */
+static uint8_t *x_imm(uint8_t *p, int reg, uint32_t imm)
+{
+	p = x_byte(p, 0xB8 + reg);
+	return x_u32(p, imm);
+}
+
+/* mov reg64, imm64 */
+static uint8_t *x_imm64(uint8_t *p, int reg, uint64_t imm)
+{
+	p = x_byte(p, 0x48);
+	p = x_byte(p, 0xB8 + reg);
+	return x_u64(p, imm);
+}
+
+/* opcode dst, src between registers (mov 0x89, test 0x85, xor 0x31) */
+static uint8_t *x_rr(uint8_t *p, uint8_t opcode, int dst, int src)
+{
+	p = x_byte(p, opcode);
+	return x_byte(p, 0xC0 | src << 3 | dst);
+}
+
+/* 0x81 /digit: add 0, or 1, and 4, xor 6, cmp 7 */
+static uint8_t *x_alu_imm(uint8_t *p, int digit, int reg, uint32_t imm)
+{
+	p = x_byte(p, 0x81);
+	p = x_byte(p, 0xC0 | digit << 3 | reg);
+	return x_u32(p, imm);
+}
+
+/* 0xC1 /digit: shl 4, shr 5, sar 7 */
+static uint8_t *x_shift(uint8_t *p, int digit, int reg, uint8_t n)
+{
+	p = x_byte(p, 0xC1);
+	p = x_byte(p, 0xC0 | digit << 3 | reg);
+	return x_byte(p, n);
+}
+
+/* setcc on the low byte of reg, then zero-extend it */
+static uint8_t *x_setcc(uint8_t *p, int cc, int reg)
+{
+	p = x_byte(p, 0x0F);
+	p = x_byte(p, 0x90 | cc);
+	p = x_byte(p, 0xC0 | reg);
+	p = x_byte(p, 0x0F);
+	p = x_byte(p, 0xB6);
+	return x_byte(p, 0xC0 | reg << 3 | reg);
+}
+
+static uint8_t *x_call(uint8_t *p, uint64_t fn)
+{
+	p = x_imm64(p, X_EAX, fn);
+	p = x_byte(p, 0xFF);
+	return x_byte(p, 0xD0);
+}
+
+static uint8_t *x_rel32(uint8_t *p, const uint8_t *target)
+{
+	return x_u32(p, (uint32_t)(target - (p + 4)));
+}
+
+/***************************************************************/
+/* Called from translated code. Loads and stores count their memory   */
+/* region like stats_retire() would; a store says whether it wrote text */
+/* the blocks were translated from.                                                      */
+/***************************************************************/
+static uint32_t jit_lb(uint32_t address)
+{
+	stats_access(address);
+	return (int32_t)(int8_t)mem_read_8(address);
+}
+
+static uint32_t jit_lh(uint32_t address)
+{
+	stats_access(address);
+	return (int32_t)(int16_t)mem_read_16(address);
+}
+
+static uint32_t jit_lw(uint32_t address)
+{
+	stats_access(address);
+	return mem_read_32(address);
+}
+
+static uint32_t jit_sb(uint32_t address, uint32_t value)
+{
+	stats_access(address);
+	mem_write_8(address, value & 0xFF);
+	return DECODE_GENERATION != JIT_GENERATION;
+}
+
+static uint32_t jit_sh(uint32_t address, uint32_t value)
+{
+	stats_access(address);
+	mem_write_16(address, value & 0xFFFF);
+	return DECODE_GENERATION != JIT_GENERATION;
+}
+
+static uint32_t jit_sw(uint32_t address, uint32_t value)
+{
+	stats_access(address);
+	mem_write_32(address, value);
+	return DECODE_GENERATION != JIT_GENERATION;
+}
+
+/* anything without a translation of its own runs through its EX
+ * handler, the way fast_step() runs it */
+static void jit_interpret(const decoded_inst_t *inst, uint32_t pc)
+{
+	CPU_Pipeline_Reg r;
+
+	r.PC = pc;
+	r.inst = inst;
+	r.A = CURRENT_STATE.REGS[inst->rs];
+	r.B = CURRENT_STATE.REGS[inst->rt];
+	r.imm = inst->imm;
+	r.ALUOutput = 0;
+	r.LMD = 0;
+	NEXT_STATE = CURRENT_STATE;
+	inst->exec(&r);
+	if (inst->dest != 0) {
+		NEXT_STATE.REGS[inst->dest] = r.ALUOutput;
+	}
+	CURRENT_STATE = NEXT_STATE;
+}
+
+static int jit_reads(const decoded_inst_t *inst, uint8_t reg)
+{
+	return ((inst->flags & DEC_READS_RS) && inst->rs == reg) ||
+		((inst->flags & DEC_READS_RT) && inst->rt == reg);
+}
+
+/***************************************************************/
+/* The first k words of b have run and CURRENT_STATE.PC is set. Charge */
+/* them as fast_step() would; taken and target describe the branch or  */
+/* jump ending b. Returns the code to continue with, NULL to go back to */
+/* jit_run().                                                                                                    */
+/***************************************************************/
+static const uint8_t *jit_block_end(jit_block_t *b, uint32_t k, uint32_t taken, uint32_t target)
+{
+	const decoded_inst_t *last = b->insts[k - 1].inst;
+	uint32_t i, cost, load_use, predicted, pc = b->pc + 4 * (k - 1);
+	int mispredicted = FALSE;
+	jit_entry_t *e;
+	jit_block_t *next;
+
+	BRANCH_TAKEN = FALSE;
+	if (k == b->length && b->branch) {
+		predicted = bpred_predict(pc, last);
+		if (taken) {
+			BRANCH_TAKEN = TRUE;
+			BRANCH_TARGET = target;
+			STATS_TAKEN += (last->flags & DEC_BRANCH) != 0;
+		}
+		bpred_update(pc, last, BRANCH_TAKEN, BRANCH_TARGET, predicted, FAST_BRANCH_PENALTY);
+		mispredicted = CURRENT_STATE.PC != predicted;
+	}
+	for (i = 0; i < k; i++) {
+		load_use = b->insts[i].cost - 1;
+		if (i == 0 && FAST_LOAD_DEST != 0 && jit_reads(b->insts[0].inst, FAST_LOAD_DEST)) {
+			load_use += FAST_LOAD_USE_STALL;
+		}
+		cost = 1 + load_use;
+		STALL_LOAD_USE += load_use;
+		if (i == k - 1 && mispredicted) {
+			cost += FAST_BRANCH_PENALTY;
+			STALL_CONTROL += FAST_BRANCH_PENALTY;
+		}
+		CYCLE_COUNT += cost;
+		ESTIMATED_CYCLES += cost;
+		stats_retire_op(b->pc + 4 * i, b->insts[i].inst->op, CYCLE_COUNT);
+	}
+	INSTRUCTION_COUNT += k;
+	FAST_LOAD_DEST = (last->flags & DEC_LOAD) ? last->dest : 0;
+	JIT_REMAINING -= k;
+
+	if (k < b->length || !RUN_FLAG || DECODE_GENERATION != JIT_GENERATION) {
+		return NULL;
+	}
+	next = b->link[taken != 0];
+	if (next == NULL || next->pc != CURRENT_STATE.PC) {
+		e = JIT_TABLE + ((CURRENT_STATE.PC >> 2) & (JIT_TABLE_SIZE - 1));
+		while (e->visits != 0 && e->pc != CURRENT_STATE.PC) {
+			e = e + 1 < JIT_TABLE + JIT_TABLE_SIZE ? e + 1 : JIT_TABLE;
+		}
+		if (e->visits == 0 || e->block == NULL) {
+			return NULL;
+		}
+		next = e->block;
+		b->link[taken != 0] = next;
+	}
+	return next->length <= JIT_REMAINING ? next->code : NULL;
+}
+
+/***************************************************************/
+/* Translate one word that is not the last of its block. A store leaves */
+/* the rel32 of its early exit in *exit.                                                      */
+/***************************************************************/
+static uint8_t *jit_word(uint8_t *p, const decoded_inst_t *inst, uint32_t pc, uint8_t **exit)
+{
+	static const uint8_t rr[OP_COUNT] = {
+		[OP_ADD] = 0x03, [OP_ADDU] = 0x03, [OP_SUB] = 0x2B, [OP_SUBU] = 0x2B,
+		[OP_AND] = 0x23, [OP_OR] = 0x0B, [OP_XOR] = 0x33, [OP_NOR] = 0x0B, [OP_SLT] = 0x3B,
+	};
+	static const uint8_t ri[OP_COUNT] = {
+		[OP_ADDI] = 0, [OP_ADDIU] = 0, [OP_ORI] = 1, [OP_ANDI] = 4, [OP_XORI] = 6, [OP_SLTI] = 7,
+	};
+	uint32_t d = inst->dest;
+	uint64_t fn;
+
+	*exit = NULL;
+	switch (inst->op) {
+		case OP_SLL:
+		case OP_SRL:
+		case OP_SRA:
+			if (d != 0) {
+				p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rt));
+				p = x_shift(p, inst->op == OP_SLL ? 4 : inst->op == OP_SRL ? 5 : 7, X_EAX, inst->sa);
+				p = x_mem(p, 0x89, X_EAX, X_REG(d));
+			}
+			break;
+		case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+		case OP_AND: case OP_OR: case OP_XOR: case OP_NOR: case OP_SLT:
+			if (d != 0) {
+				p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+				p = x_mem(p, rr[inst->op], X_EAX, X_REG(inst->rt));
+				if (inst->op == OP_NOR) {
+					p = x_byte(p, 0xF7);
+					p = x_byte(p, 0xD0 | X_EAX);
+				}else if (inst->op == OP_SLT) {
+					p = x_setcc(p, X_CC_L, X_EAX);
+				}
+				p = x_mem(p, 0x89, X_EAX, X_REG(d));
+			}
+			break;
+		case OP_ADDI: case OP_ADDIU: case OP_SLTI:
+		case OP_ANDI: case OP_ORI: case OP_XORI:
+			if (d != 0) {
+				p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+				p = x_alu_imm(p, ri[inst->op], X_EAX, inst->imm);
+				if (inst->op == OP_SLTI) {
+					p = x_setcc(p, X_CC_L, X_EAX);
+				}
+				p = x_mem(p, 0x89, X_EAX, X_REG(d));
+			}
+			break;
+		case OP_LUI:
+			if (d != 0) {
+				p = x_mem_imm(p, X_REG(d), inst->imm << 16);
+			}
+			break;
+		case OP_MFHI:
+		case OP_MFLO:
+			if (d != 0) {
+				p = x_mem(p, 0x8B, X_EAX, inst->op == OP_MFHI ? X_HI : X_LO);
+				p = x_mem(p, 0x89, X_EAX, X_REG(d));
+			}
+			break;
+		case OP_MTHI:
+		case OP_MTLO:
+			p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+			p = x_mem(p, 0x89, X_EAX, inst->op == OP_MTHI ? X_HI : X_LO);
+			break;
+		case OP_MULT:
+		case OP_MULTU:
+			/* imul/mul dword [rt]: edx:eax = eax * rt */
+			p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+			p = x_mem(p, 0xF7, inst->op == OP_MULT ? 5 : 4, X_REG(inst->rt));
+			p = x_mem(p, 0x89, X_EAX, X_LO);
+			p = x_mem(p, 0x89, X_EDX, X_HI);
+			break;
+		case OP_LB:
+		case OP_LH:
+		case OP_LW:
+			fn = inst->op == OP_LB ? (uintptr_t)jit_lb : inst->op == OP_LH ? (uintptr_t)jit_lh : (uintptr_t)jit_lw;
+			p = x_mem(p, 0x8B, X_EDI, X_REG(inst->rs));
+			p = x_alu_imm(p, 0, X_EDI, inst->imm);
+			p = x_call(p, fn);
+			if (d != 0) {
+				p = x_mem(p, 0x89, X_EAX, X_REG(d));
+			}
+			break;
+		case OP_SB:
+		case OP_SH:
+		case OP_SW:
+			fn = inst->op == OP_SB ? (uintptr_t)jit_sb : inst->op == OP_SH ? (uintptr_t)jit_sh : (uintptr_t)jit_sw;
+			p = x_mem(p, 0x8B, X_EDI, X_REG(inst->rs));
+			p = x_alu_imm(p, 0, X_EDI, inst->imm);
+			p = x_mem(p, 0x8B, X_ESI, X_REG(inst->rt));
+			p = x_call(p, fn);
+			p = x_rr(p, 0x85, X_EAX, X_EAX);
+			p = x_byte(p, 0x0F);
+			p = x_byte(p, 0x80 | X_CC_NE);
+			*exit = p;
+			p = x_u32(p, 0);
+			break;
+		default:
+			p = x_imm64(p, X_EDI, (uintptr_t)inst);
+			p = x_imm(p, X_ESI, pc);
+			p = x_call(p, (uintptr_t)jit_interpret);
+			break;
+	}
+	return p;
+}
+
+/***************************************************************/
+/* Translate the branch or jump ending a block: edx = taken, ecx =      */
+/* target, CURRENT_STATE.PC = the next PC                                                 */
+/***************************************************************/
+static uint8_t *jit_branch(uint8_t *p, const decoded_inst_t *inst, uint32_t pc)
+{
+	uint32_t target = DECODE_BRANCH_TARGET(pc, inst->imm);
+	int cc;
+
+	switch (inst->op) {
+		case OP_J:
+		case OP_JAL:
+			target = (pc & 0xF0000000) | inst->target;
+			p = x_imm(p, X_EDX, 1);
+			p = x_imm(p, X_ECX, target);
+			if (inst->dest != 0) {
+				p = x_mem_imm(p, X_REG(inst->dest), pc + 4);
+			}
+			return x_mem_imm(p, X_PC, target);
+		case OP_JR:
+		case OP_JALR:
+			p = x_mem(p, 0x8B, X_ECX, X_REG(inst->rs));
+			p = x_imm(p, X_EDX, 1);
+			if (inst->dest != 0) {
+				p = x_mem_imm(p, X_REG(inst->dest), pc + 4);
+			}
+			return x_mem(p, 0x89, X_ECX, X_PC);
+		case OP_BEQ:
+		case OP_BNE:
+			p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+			p = x_mem(p, 0x3B, X_EAX, X_REG(inst->rt));
+			cc = inst->op == OP_BEQ ? X_CC_E : X_CC_NE;
+			break;
+		default:
+			/* BLTZ, BGEZ, BLEZ, BGTZ compare rs with zero */
+			p = x_mem(p, 0x8B, X_EAX, X_REG(inst->rs));
+			p = x_rr(p, 0x85, X_EAX, X_EAX);
+			cc = inst->op == OP_BLTZ ? X_CC_S : inst->op == OP_BGEZ ? X_CC_NS : inst->op == OP_BLEZ ? X_CC_LE : X_CC_G;
+			break;
+	}
+	/* next = taken ? target : pc + 4, by cmovne */
+	p = x_setcc(p, cc, X_EDX);
+	p = x_imm(p, X_EAX, pc + 4);
+	p = x_imm(p, X_ECX, target);
+	p = x_rr(p, 0x85, X_EDX, X_EDX);
+	p = x_byte(p, 0x0F);
+	p = x_byte(p, 0x45);
+	p = x_byte(p, 0xC0 | X_EAX << 3 | X_ECX);
+	return x_mem(p, 0x89, X_EAX, X_PC);
+}
+
+/* hand the first k words of b to jit_block_end() and go where it says */
+static uint8_t *jit_end(uint8_t *p, jit_block_t *b, uint32_t k)
+{
+	p = x_imm64(p, X_EDI, (uintptr_t)b);
+	p = x_imm(p, X_ESI, k);
+	p = x_call(p, (uintptr_t)jit_block_end);
+	p = x_byte(p, 0x48);
+	p = x_rr(p, 0x85, X_EAX, X_EAX);
+	p = x_byte(p, 0x0F);
+	p = x_byte(p, 0x80 | X_CC_E);
+	p = x_rel32(p, JIT_EXIT);
+	p = x_byte(p, 0xFF);
+	return x_byte(p, 0xE0);
+}
+
+/***************************************************************/
+/* Translate the block at pc; NULL if its first word can't be in one   */
+/***************************************************************/
+static jit_block_t *jit_translate(uint32_t pc)
+{
+	jit_block_t *b = &JIT_BLOCKS[JIT_NUM_BLOCKS];
+	uint8_t *start = JIT_CODE + JIT_CODE_USED, *p = start;
+	uint8_t *exits[JIT_BLOCK_LEN];
+	const decoded_inst_t *inst, *prev = NULL;
+	uint32_t at, n = 0, i, end = PROGRAM_BASE + 4 * PROGRAM_SIZE;
+
+	memset(b, 0, sizeof(*b));
+	b->pc = pc;
+	for (at = pc; n < JIT_BLOCK_LEN && at < end; at += 4) {
+		inst = decode_fetch(at);
+		if (inst->op == OP_INVALID || inst->op == OP_SYSCALL) {
+			break;
+		}
+		b->insts[n].inst = inst;
+		b->insts[n].cost = 1;
+		if (prev != NULL && (prev->flags & DEC_LOAD) && prev->dest != 0 && jit_reads(inst, prev->dest)) {
+			b->insts[n].cost += FAST_LOAD_USE_STALL;
+		}
+		n++;
+		if (inst->flags & (DEC_BRANCH | DEC_JUMP)) {
+			p = jit_branch(p, inst, at);
+			exits[n - 1] = NULL;
+			b->branch = TRUE;
+			break;
+		}
+		p = jit_word(p, inst, at, &exits[n - 1]);
+		prev = inst;
+	}
+	if (n == 0) {
+		return NULL;
+	}
+	b->length = n;
+	if (!b->branch) {
+		p = x_mem_imm(p, X_PC, pc + 4 * n);
+		p = x_rr(p, 0x31, X_EDX, X_EDX);
+		p = x_rr(p, 0x31, X_ECX, X_ECX);
+	}
+	p = jit_end(p, b, n);
+
+	/* a store that wrote text leaves the block right behind it */
+	for (i = 0; i < n; i++) {
+		if (exits[i] == NULL) {
+			continue;
+		}
+		x_rel32(exits[i], p);
+		p = x_mem_imm(p, X_PC, pc + 4 * (i + 1));
+		p = x_rr(p, 0x31, X_EDX, X_EDX);
+		p = x_rr(p, 0x31, X_ECX, X_ECX);
+		p = jit_end(p, b, i + 1);
+	}
+
+	b->code = start;
+	JIT_CODE_USED = (p - JIT_CODE + 15) & ~(size_t)15;
+	JIT_NUM_BLOCKS++;
+	return b;
+}
+
+/***************************************************************/
+/* Make the code buffer writable (to translate into it) or executable;  */
+/* if the host won't, give up on translation for this instance              */
+/***************************************************************/
+static int jit_writable(int writable)
+{
+	if (mprotect(JIT_CODE, JIT_CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+		jit_free();
+		JIT_FAILED = TRUE;
+		return -1;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Map the code buffer and write the stubs: entry pushes rbx, points it */
+/* at the state and jumps to the block; exit pops it and returns             */
+/***************************************************************/
+static int jit_init()
+{
+#if defined(__x86_64__)
+	static const uint8_t stubs[] = {
+		0x53, 0x48, 0x89, 0xFB, 0xFF, 0xE6,	/* push rbx; mov rbx, rdi; jmp rsi */
+		0x5B, 0xC3	/* pop rbx; ret */
+	};
+	void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	JIT_CODE = code == MAP_FAILED ? NULL : code;
+	JIT_TABLE = calloc(JIT_TABLE_SIZE, sizeof(jit_entry_t));
+	JIT_BLOCKS = malloc(JIT_MAX_BLOCKS * sizeof(jit_block_t));
+	if (JIT_CODE != NULL && JIT_TABLE != NULL && JIT_BLOCKS != NULL) {
+		memcpy(JIT_CODE, stubs, sizeof(stubs));
+		jit_flush();
+		return jit_writable(FALSE);
+	}
+#endif
+	jit_free();
+	JIT_FAILED = TRUE;
+	return -1;
+}
+
+/***************************************************************/
+/* Forget every translation                                                                                        */
+/***************************************************************/
+void jit_flush()
+{
+	if (JIT_CODE == NULL) {
+		return;
+	}
+	memset(JIT_TABLE, 0, JIT_TABLE_SIZE * sizeof(jit_entry_t));
+	JIT_ENTRIES = 0;
+	JIT_NUM_BLOCKS = 0;
+	JIT_CODE_USED = JIT_STUBS;
+	JIT_GENERATION = DECODE_GENERATION;
+}
+
+void jit_free()
+{
+	if (JIT_CODE != NULL) {
+		munmap(JIT_CODE, JIT_CODE_SIZE);
+	}
+	free(JIT_TABLE);
+	free(JIT_BLOCKS);
+	JIT_CODE = NULL;
+	JIT_TABLE = NULL;
+	JIT_BLOCKS = NULL;
+}
+
+/***************************************************************/
+/* Run translated blocks from CURRENT_STATE.PC, retiring at most             */
+/* max_instructions. Returns how many retired: 0 when the block there */
+/* is not translated (yet), is longer than that or can't be charged        */
+/* exactly, so fast_step() should take the next word.                              */
+/***************************************************************/
+uint32_t jit_run(uint32_t max_instructions)
+{
+	uint32_t pc = CURRENT_STATE.PC;
+	jit_entry_t *e;
+
+	if (!JIT_ON || JIT_FAILED || TRACE_ON || ICACHE.enabled || DCACHE.enabled ||
+		CYCLE_COUNT == 0 || STATS_LAST_RETIRE != CYCLE_COUNT) {
+		return 0;
+	}
+	if ((pc & 3) != 0 || pc < PROGRAM_BASE || (pc - PROGRAM_BASE) / 4 >= PROGRAM_SIZE) {
+		return 0;
+	}
+	if (JIT_CODE == NULL && jit_init() != 0) {
+		return 0;
+	}
+	if (JIT_GENERATION != DECODE_GENERATION || JIT_ENTRIES >= JIT_TABLE_SIZE / 2) {
+		jit_flush();
+	}
+
+	e = JIT_TABLE + ((pc >> 2) & (JIT_TABLE_SIZE - 1));
+	while (e->visits != 0 && e->pc != pc) {
+		e = e + 1 < JIT_TABLE + JIT_TABLE_SIZE ? e + 1 : JIT_TABLE;
+	}
+	if (e->visits == 0) {
+		e->pc = pc;
+		JIT_ENTRIES++;
+	}
+	if (e->block == NULL) {
+		if (e->visits > JIT_HOT || ++e->visits < JIT_HOT) {
+			return 0;
+		}
+		if (JIT_NUM_BLOCKS == JIT_MAX_BLOCKS || JIT_CODE_USED + JIT_BLOCK_BYTES > JIT_CODE_SIZE) {
+			jit_flush();
+			return 0;
+		}
+		if (jit_writable(TRUE) != 0) {
+			return 0;
+		}
+		e->block = jit_translate(pc);
+		if (jit_writable(FALSE) != 0) {
+			return 0;
+		}
+		if (e->block == NULL) {
+			e->visits = JIT_HOT + 1;
+			return 0;
+		}
+	}
+	if (e->block->length > max_instructions) {
+		return 0;
+	}
+
+	JIT_REMAINING = max_instructions;
+	((jit_enter_t)JIT_CODE)(&CURRENT_STATE, e->block->code);
+	NEXT_STATE = CURRENT_STATE;
+	return max_instructions - JIT_REMAINING;
+}
@@ -0,0 +1,75 @@
+#ifndef MU_JIT_H
+#define MU_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Basic-block translator                                                                                                                       */
+/******************************************************************************/
+/* Fast mode runs hot blocks of the loaded text as x86-64 code instead of
+ * stepping fast_step() once per word. A block starts where control lands
+ * and runs to the first branch or jump (included), SYSCALL or invalid word
+ * (left to the interpreter), or JIT_BLOCK_LEN words. The code works on
+ * CURRENT_STATE in place and calls back into C for loads, stores and the
+ * rarer ALU operations, so memory, HI/LO and the handlers stay exactly
+ * the interpreter's. At the end of a block jit_block_end() charges the
+ * block the cycles fast_step() would (predictor, load-use stalls,
+ * profile) and hands back the next block's code, so hot loops run from
+ * block to block without returning to C's dispatch loop; each block
+ * remembers the successor it went to last on either side of its branch.
+ *
+ * Blocks are found by guest PC in an open-addressed table that also
+ * counts how often an untranslated PC starts a block; it is translated
+ * on its JIT_HOT-th visit. Any store into text invalidates every block
+ * (DECODE_GENERATION moves on): a block that made the store leaves right
+ * after it and the cache is flushed before anything else runs. The
+ * interpreter takes over whenever a block can't be charged exactly as
+ * fast_step() would: while tracing, with an L1 cache model on, on the
+ * very first cycle, and on hosts other than x86-64.
+ *
+ * The code buffer is never writable and executable at once: it is
+ * read/execute while blocks run and made writable only while a block is
+ * translated into it. If the host refuses either mapping the instance
+ * stays on the interpreter. */
+#define JIT_BLOCK_LEN  32	/* longest block, in words */
+#define JIT_MAX_BLOCKS 4096	/* blocks translated between flushes */
+#define JIT_TABLE_SIZE  8192	/* lookup table entries, a power of two */
+#define JIT_CODE_SIZE (4 << 20)	/* bytes of host code between flushes */
+#define JIT_HOT            8	/* visits before a block is translated */
+
+typedef struct jit_block_struct jit_block_t;
+
+typedef struct {
+	uint32_t pc;
+	uint32_t visits;	/* before translation; past JIT_HOT when it can't be */
+	jit_block_t *block;
+} jit_entry_t;
+
+/* one simulator instance's translations; JIT_CTX is per thread, like
+ * MEM_CTX. Nothing is allocated until fast mode first runs. */
+typedef struct {
+	int on;	/* jit command; off falls back to fast_step() */
+	int failed;	/* no executable memory for this instance */
+	uint8_t *code;
+	size_t code_used;
+	jit_entry_t *table;
+	uint32_t entries;
+	jit_block_t *blocks;
+	uint32_t num_blocks;
+	uint32_t generation;	/* DECODE_GENERATION the blocks were translated from */
+	uint32_t remaining;	/* instructions jit_run() may still retire */
+} jit_ctx_t;
+
+extern __thread jit_ctx_t *JIT_CTX;
+
+#define JIT_ON (JIT_CTX->on)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+uint32_t jit_run(uint32_t max_instructions);
+void jit_flush();
+void jit_free();
+
+#endif
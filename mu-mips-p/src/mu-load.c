@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-load.h"
+
+const char *LOAD_FORMAT_NAMES[] = { "hex", "raw", "ELF" };
+
+/* ELF32 header and program header field offsets */
+#define ELF_EI_CLASS     4
+#define ELF_EI_DATA       5
+#define ELF_E_MACHINE  18
+#define ELF_E_ENTRY       24
+#define ELF_E_PHOFF       28
+#define ELF_E_PHENTSIZE 42
+#define ELF_E_PHNUM      44
+#define ELF_EHDR_SIZE    52
+#define ELF_P_TYPE         0
+#define ELF_P_OFFSET     4
+#define ELF_P_VADDR       8
+#define ELF_P_FILESZ      16
+#define ELF_P_MEMSZ      20
+#define ELF_P_FLAGS       24
+#define ELF_PHDR_SIZE    32
+
+#define ELF_CLASS32       1
+#define ELF_DATA2LSB     1
+#define ELF_EM_MIPS      8
+#define ELF_PT_LOAD      1
+#define ELF_PF_X            1
+
+/* A parsed program file. Each file is read and parsed once; every
+ * instance, on any thread, that loads it copies the segments from here
+ * into its own memory. An entry is reused only while the file keeps the
+ * same identity, size and modification time, and lives until exit. */
+typedef struct {
+	uint32_t index;	/* program header number, for -v */
+	uint32_t vaddr, filesz, memsz, flags;
+	const uint8_t *data;
+} load_segment_t;
+
+typedef struct load_shared_struct {
+	char *file;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	load_image_t image;
+	uint8_t *data;	/* the file; NULL once parsed if the segments do not point into it */
+	uint8_t *words;	/* decoded words of a hex file */
+	load_segment_t *segments;
+	uint32_t num_segments;
+	struct load_shared_struct *next;
+} load_shared_t;
+
+static load_shared_t *LOAD_SHARED;
+static pthread_mutex_t LOAD_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static uint16_t load_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/***************************************************************/
+/* Append a segment; -1 if out of memory. Parsing runs under                */
+/* LOAD_LOCK, so errors here are returned rather than fatal.               */
+/***************************************************************/
+static int load_add_segment(load_shared_t *shared, uint32_t index, uint32_t vaddr, const uint8_t *data,
+	uint32_t filesz, uint32_t memsz, uint32_t flags)
+{
+	load_segment_t *seg = realloc(shared->segments, (shared->num_segments + 1) * sizeof(load_segment_t));
+
+	if (seg == NULL) {
+		error_report("Out of memory loading %s\n", shared->file);
+		return -1;
+	}
+	shared->segments = seg;
+	seg = &shared->segments[shared->num_segments++];
+	seg->index = index;
+	seg->vaddr = vaddr;
+	seg->data = data;
+	seg->filesz = filesz;
+	seg->memsz = memsz;
+	seg->flags = flags;
+	return 0;
+}
+
+/***************************************************************/
+/* Echo every word of a loaded range (verbosity 2)                                    */
+/***************************************************************/
+static void load_log_words(uint32_t address, uint32_t len)
+{
+	uint32_t a;
+	for (a = address; a - address < len; a += 4) {
+		printf("writing 0x%08x into address 0x%08x (%d)\n", mem_read_32(a), a, a);
+	}
+}
+
+/***************************************************************/
+/* Return the value of a hex digit, -1 for anything else                          */
+/***************************************************************/
+static int load_hex_digit(uint8_t c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+static int load_is_space(uint8_t c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/***************************************************************/
+/* TRUE if the file is plain text, which is parsed as hex words. A        */
+/* binary image almost always holds a control or high byte.                   */
+/***************************************************************/
+static int load_is_text(const uint8_t *p, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i++) {
+		if ((p[i] < 0x20 || p[i] > 0x7E) && !load_is_space(p[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/***************************************************************/
+/* One hex word per line, optionally 0x-prefixed                                       */
+/***************************************************************/
+static int load_hex(const char *file, const uint8_t *p, size_t size, load_shared_t *shared)
+{
+	/* every word takes at least one digit and one separator */
+	uint8_t *words = malloc((size / 2 + 1) * 4);
+	load_image_t *image = &shared->image;
+	uint32_t n = 0, line = 1, value;
+	size_t i = 0;
+	int d, digits;
+
+	if (words == NULL) {
+		error_report("Out of memory loading %s\n", file);
+		return -1;
+	}
+	while (i < size) {
+		if (load_is_space(p[i])) {
+			line += p[i] == '\n';
+			i++;
+			continue;
+		}
+		if (p[i] == '0' && i + 1 < size && (p[i + 1] | 0x20) == 'x') {
+			i += 2;
+		}
+		value = 0;
+		digits = 0;
+		while (i < size && (d = load_hex_digit(p[i])) >= 0) {
+			if (value >> 28) {
+				error_report("%s:%u: word does not fit in 32 bits\n", file, line);
+				free(words);
+				return -1;
+			}
+			value = (value << 4) | d;
+			digits++;
+			i++;
+		}
+		if (digits == 0 || (i < size && !load_is_space(p[i]))) {
+			error_report("%s:%u: malformed hex word\n", file, line);
+			free(words);
+			return -1;
+		}
+		mem_store_le32(words + 4 * n, value);
+		n++;
+	}
+	shared->words = words;
+	if (load_add_segment(shared, 0, MEM_TEXT_BEGIN, words, 4 * n, 4 * n, ELF_PF_X) != 0) {
+		return -1;
+	}
+
+	image->entry = MEM_TEXT_BEGIN;
+	image->text_base = MEM_TEXT_BEGIN;
+	image->text_words = n;
+	image->bytes = 4 * n;
+	image->end = MEM_TEXT_BEGIN + 4 * n;
+	return 0;
+}
+
+/***************************************************************/
+/* Raw little-endian image copied to the start of the text segment       */
+/***************************************************************/
+static int load_raw(const char *file, const uint8_t *p, size_t size, load_shared_t *shared)
+{
+	load_image_t *image = &shared->image;
+
+	if (size > MEM_TEXT_END - MEM_TEXT_BEGIN + 1) {
+		error_report("%s does not fit in the text segment\n", file);
+		return -1;
+	}
+	if (load_add_segment(shared, 0, MEM_TEXT_BEGIN, p, size, size, ELF_PF_X) != 0) {
+		return -1;
+	}
+
+	image->entry = MEM_TEXT_BEGIN;
+	image->text_base = MEM_TEXT_BEGIN;
+	image->text_words = (size + 3) / 4;
+	image->bytes = size;
+	image->end = MEM_TEXT_BEGIN + size;
+	return 0;
+}
+
+/***************************************************************/
+/* TRUE if [address, address + len) lies inside one memory region        */
+/***************************************************************/
+static int load_in_region(uint32_t address, uint32_t len)
+{
+	int i;
+	if (len == 0) {
+		return 1;
+	}
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if (address >= MEM_REGIONS[i].begin && address <= MEM_REGIONS[i].end &&
+				len - 1 <= MEM_REGIONS[i].end - address) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Static MIPS32 ELF: every PT_LOAD segment goes to its link address.   */
+/* Memory is already clear, so the .bss tail needs no writes.                  */
+/***************************************************************/
+static int load_elf(const char *file, const uint8_t *p, size_t size, load_shared_t *shared)
+{
+	uint32_t phoff, phentsize, phnum, i;
+	uint32_t offset, vaddr, filesz, memsz, flags;
+	load_image_t *image = &shared->image;
+	const uint8_t *ph;
+
+	if (size < ELF_EHDR_SIZE || p[ELF_EI_CLASS] != ELF_CLASS32) {
+		error_report("%s is not a 32-bit ELF file\n", file);
+		return -1;
+	}
+	if (p[ELF_EI_DATA] != ELF_DATA2LSB) {
+		error_report("%s is big-endian; the simulator is little-endian\n", file);
+		return -1;
+	}
+	if (load_le16(p + ELF_E_MACHINE) != ELF_EM_MIPS) {
+		error_report("%s is not a MIPS executable\n", file);
+		return -1;
+	}
+	phoff = mem_load_le32(p + ELF_E_PHOFF);
+	phentsize = load_le16(p + ELF_E_PHENTSIZE);
+	phnum = load_le16(p + ELF_E_PHNUM);
+	if (phentsize < ELF_PHDR_SIZE || phoff > size || phnum > (size - phoff) / phentsize) {
+		error_report("%s has a malformed program header table\n", file);
+		return -1;
+	}
+
+	image->entry = mem_load_le32(p + ELF_E_ENTRY);
+	image->text_base = 0;
+	image->text_words = 0;
+	image->bytes = 0;
+	image->end = 0;
+	for (i = 0; i < phnum; i++) {
+		ph = p + phoff + i * phentsize;
+		if (mem_load_le32(ph + ELF_P_TYPE) != ELF_PT_LOAD) {
+			continue;
+		}
+		offset = mem_load_le32(ph + ELF_P_OFFSET);
+		vaddr = mem_load_le32(ph + ELF_P_VADDR);
+		filesz = mem_load_le32(ph + ELF_P_FILESZ);
+		memsz = mem_load_le32(ph + ELF_P_MEMSZ);
+		flags = mem_load_le32(ph + ELF_P_FLAGS);
+		if (offset > size || filesz > size - offset || filesz > memsz) {
+			error_report("%s: segment %u lies outside the file\n", file, i);
+			return -1;
+		}
+		if (!load_in_region(vaddr, memsz)) {
+			error_report("%s: segment %u at 0x%08x is outside simulated memory\n", file, i, vaddr);
+			return -1;
+		}
+		if (load_add_segment(shared, i, vaddr, p + offset, filesz, memsz, flags) != 0) {
+			return -1;
+		}
+		image->bytes += filesz;
+		if (vaddr + memsz > image->end) {
+			image->end = vaddr + memsz;
+		}
+		if ((flags & ELF_PF_X) && image->text_words == 0) {
+			image->text_base = vaddr;
+			image->text_words = (memsz + 3) / 4;
+		}
+	}
+	if (image->text_words == 0) {
+		error_report("%s has no executable segment\n", file);
+		return -1;
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Parse the image p of size bytes into shared, telling the format     */
+/* apart by content. Segments point into p, or into shared->words for */
+/* a hex file. Returns -1 with a message printed if it cannot be used. */
+/***************************************************************/
+static int load_parse(const char *name, const uint8_t *p, size_t size, load_shared_t *shared)
+{
+	if (size >= 4 && memcmp(p, "\177ELF", 4) == 0) {
+		shared->image.format = LOAD_ELF;
+		return load_elf(name, p, size, shared);
+	}
+	if (load_is_text(p, size)) {
+		shared->image.format = LOAD_HEX;
+		return load_hex(name, p, size, shared);
+	}
+	shared->image.format = LOAD_RAW;
+	return load_raw(name, p, size, shared);
+}
+
+static void load_release(load_shared_t *shared)
+{
+	free(shared->segments);
+	free(shared->words);
+	free(shared->data);
+	free(shared->file);
+	free(shared);
+}
+
+/***************************************************************/
+/* Read and parse a program file into a new shared entry; NULL with a  */
+/* message printed if the file cannot be used                                        */
+/***************************************************************/
+static load_shared_t *load_read(const char *file)
+{
+	load_shared_t *shared = calloc(1, sizeof(load_shared_t));
+	struct stat st;
+	size_t size, done;
+	ssize_t got;
+	int fd;
+
+	if (shared == NULL || (shared->file = strdup(file)) == NULL) {
+		error_report("Out of memory loading %s\n", file);
+		free(shared);
+		return NULL;
+	}
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		error_report("Can't open program file %s\n", file);
+		if (fd >= 0) {
+			close(fd);
+		}
+		load_release(shared);
+		return NULL;
+	}
+	size = st.st_size;
+	shared->dev = st.st_dev;
+	shared->ino = st.st_ino;
+	shared->size = st.st_size;
+	shared->mtime = st.st_mtim;
+	if ((shared->data = malloc(size > 0 ? size : 1)) == NULL) {
+		error_report("Out of memory loading %s\n", file);
+		close(fd);
+		load_release(shared);
+		return NULL;
+	}
+	/* read, not mapped: the entry outlives the file, which may be rewritten
+	 * or truncated under a mapping while other instances still load it */
+	for (done = 0; done < size; done += got) {
+		got = read(fd, shared->data + done, size - done);
+		if (got <= 0) {
+			error_report("Can't read program file %s\n", file);
+			close(fd);
+			load_release(shared);
+			return NULL;
+		}
+	}
+	close(fd);
+
+	if (load_parse(file, shared->data, size, shared) != 0) {
+		load_release(shared);
+		return NULL;
+	}
+	if (shared->image.format == LOAD_HEX) {
+		/* the decoded words replace the text */
+		free(shared->data);
+		shared->data = NULL;
+	}
+	return shared;
+}
+
+/***************************************************************/
+/* The shared entry for file, parsing it on first use or when it has    */
+/* changed since. Safe to call from any thread.                                      */
+/***************************************************************/
+static load_shared_t *load_find(const char *file)
+{
+	load_shared_t *shared;
+	struct stat st;
+
+	if (stat(file, &st) != 0) {
+		error_report("Can't open program file %s\n", file);
+		return NULL;
+	}
+	pthread_mutex_lock(&LOAD_LOCK);
+	for (shared = LOAD_SHARED; shared != NULL; shared = shared->next) {
+		if (strcmp(shared->file, file) == 0 && shared->dev == st.st_dev && shared->ino == st.st_ino &&
+				shared->size == st.st_size && shared->mtime.tv_sec == st.st_mtim.tv_sec &&
+				shared->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			break;
+		}
+	}
+	if (shared == NULL && (shared = load_read(file)) != NULL) {
+		shared->next = LOAD_SHARED;
+		LOAD_SHARED = shared;
+	}
+	pthread_mutex_unlock(&LOAD_LOCK);
+	return shared;
+}
+
+/***************************************************************/
+/* Parse file ahead of time so later loads only copy it. Returns -1   */
+/* with a message printed if the file cannot be used.                             */
+/***************************************************************/
+int load_share(const char *file)
+{
+	return load_find(file) != NULL ? 0 : -1;
+}
+
+/***************************************************************/
+/* Copy the parsed segments into (cleared) memory                                  */
+/***************************************************************/
+static void load_write(const load_shared_t *shared, load_image_t *image, int verbose)
+{
+	const load_segment_t *seg;
+	uint32_t i;
+
+	for (i = 0; i < shared->num_segments; i++) {
+		seg = &shared->segments[i];
+		mem_write_block(seg->vaddr, seg->data, seg->filesz);
+		if (shared->image.format != LOAD_ELF) {
+			continue;
+		}
+		if (verbose >= 1) {
+			printf("segment %u: 0x%08x-0x%08x %c%s\n", seg->index, seg->vaddr, seg->vaddr + seg->memsz,
+					(seg->flags & ELF_PF_X) ? 'x' : '-', seg->filesz < seg->memsz ? " (+bss)" : "");
+		}
+		if (verbose >= 2) {
+			load_log_words(seg->vaddr, seg->filesz);
+		}
+	}
+	*image = shared->image;
+	if (verbose >= 2 && image->format != LOAD_ELF) {
+		load_log_words(image->text_base, image->bytes);
+	}
+}
+
+/***************************************************************/
+/* Load a program image into (cleared) memory. Returns -1 with a           */
+/* message printed if the file cannot be used.                                        */
+/***************************************************************/
+int load_image(const char *file, load_image_t *image, int verbose)
+{
+	load_shared_t *shared = load_find(file);
+
+	if (shared == NULL) {
+		return -1;
+	}
+	load_write(shared, image, verbose);
+	return 0;
+}
+
+/***************************************************************/
+/* Load an image held in memory, in any of the file formats. It is      */
+/* parsed on every call and not shared; name only labels messages.    */
+/***************************************************************/
+int load_image_buffer(const char *name, const uint8_t *data, size_t size, load_image_t *image, int verbose)
+{
+	load_shared_t shared;
+	int ret;
+
+	memset(&shared, 0, sizeof(shared));
+	shared.file = (char *)name;
+	ret = load_parse(name, data, size, &shared);
+	if (ret == 0) {
+		load_write(&shared, image, verbose);
+	}
+	free(shared.segments);
+	free(shared.words);
+	return ret;
+}
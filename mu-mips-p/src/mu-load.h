@@ -0,0 +1,42 @@
+#ifndef MU_LOAD_H
+#define MU_LOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Program images                                                                                                                                   */
+/******************************************************************************/
+/* load_image() accepts three formats, told apart by content:
+ *   LOAD_ELF  static little-endian MIPS32 ELF; PT_LOAD segments go to their
+ *                 link addresses and execution starts at e_entry
+ *   LOAD_HEX  text file, one hex word per line (the original lab format)
+ *   LOAD_RAW  any other file: little-endian words copied to MEM_TEXT_BEGIN
+ * A file is parsed once and kept; every later load of it, by any instance
+ * on any thread, copies the parsed segments into that instance's memory.
+ * ELF branch offsets count from PC + 4; see DECODE_BRANCH_BIAS. */
+#define LOAD_HEX 0
+#define LOAD_RAW 1
+#define LOAD_ELF 2
+
+typedef struct {
+	int format;                 /* LOAD_* */
+	uint32_t entry;           /* initial PC */
+	uint32_t text_base;     /* first word of the executable segment */
+	uint32_t text_words;   /* its size in words, for decode_program() */
+	uint32_t bytes;           /* total bytes written into memory */
+	uint32_t end;             /* first address past the highest segment, bss included */
+} load_image_t;
+
+#define LOAD_STACK_POINTER 0x7FFFEFFC	/* initial $sp for ELF programs */
+
+extern const char *LOAD_FORMAT_NAMES[];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int load_share(const char *file);
+int load_image(const char *file, load_image_t *image, int verbose);
+int load_image_buffer(const char *name, const uint8_t *data, size_t size, load_image_t *image, int verbose);
+
+#endif
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mu-mips.h"
+
+sim_t SIM_MAIN;	/* the instance main() simulates on */
+
+/***************************************************************/
+/* Simulation farm                                                                                                          */
+/***************************************************************/
+/* --farm <file> runs independent simulations on worker threads, each job
+ * in a fresh instance of its own. Every line of the file that is not
+ * blank or a # comment is one job: a program, then optionally simulator
+ * commands separated by semicolons, e.g.
+ *   stride.in ; mode fast ; cache d 4K 2 32 lru wb 1 20 ; run 100000
+ * A job without commands runs to completion. Jobs are dealt round-robin
+ * onto one queue per worker; a worker takes from the front of its own
+ * queue and, once that is empty, steals from the back of the others'.
+ * Program files are parsed once up front and shared by every worker. The
+ * report is one JSON object: totals, then each job's batch result in
+ * job order. Output of commands such as rdump goes straight to stdout;
+ * what the programs print goes to stderr, or the --stdout file. */
+typedef struct {
+	char *program;
+	char *commands;	/* one per line, for handle_command() */
+	char *result;	/* the job's JSON object */
+	size_t result_len;
+	uint32_t instructions, cycles;
+	int worker;
+	double seconds;
+} farm_job_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	int *jobs;	/* job indexes; the owner takes from head, thieves from tail */
+	int head, tail;
+} farm_queue_t;
+
+typedef struct {
+	farm_job_t *jobs;
+	farm_queue_t *queues;
+	int num_workers;
+	const char *memory;	/* --memory file applied to every job, or NULL */
+	FILE *output;	/* where the programs' stdout goes */
+	int regs;
+	uint32_t steals;
+	pthread_mutex_t lock;	/* for steals */
+} farm_t;
+
+typedef struct {
+	farm_t *farm;
+	int id;
+} farm_worker_t;
+
+static double farm_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/***************************************************************/
+/* Next job for worker id, stealing when its own queue is empty; -1     */
+/* when every queue is                                                                                    */
+/***************************************************************/
+static int farm_next(farm_t *farm, int id) {
+	farm_queue_t *q = &farm->queues[id];
+	int i, job = -1;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		job = q->jobs[q->head++];
+	}
+	pthread_mutex_unlock(&q->lock);
+	for (i = 1; job < 0 && i < farm->num_workers; i++) {
+		q = &farm->queues[(id + i) % farm->num_workers];
+		pthread_mutex_lock(&q->lock);
+		if (q->head < q->tail) {
+			job = q->jobs[--q->tail];
+		}
+		pthread_mutex_unlock(&q->lock);
+		if (job >= 0) {
+			pthread_mutex_lock(&farm->lock);
+			farm->steals++;
+			pthread_mutex_unlock(&farm->lock);
+		}
+	}
+	return job;
+}
+
+/***************************************************************/
+/* Run one job in a fresh instance and keep its JSON result                   */
+/***************************************************************/
+static void farm_run(farm_t *farm, farm_job_t *job) {
+	double start = farm_now();
+	sim_t *s = sim_create();
+	FILE *fp;
+
+	if (s == NULL) {
+		exit(-1);
+	}
+	QUIET = TRUE;
+	syscall_output_to(farm->output);
+	strcpy(prog_file, job->program);
+	if (farm->memory != NULL) {
+		load_memory_config(farm->memory);
+	}
+	if (load_program() != 0) {
+		exit(-1);
+	}
+	if (job->commands[0] != '\0') {
+		CMD_INPUT = fmemopen(job->commands, strlen(job->commands), "r");
+		if (CMD_INPUT == NULL) {
+			printf("Error: Can't read the commands of job %s\n", job->program);
+			exit(-1);
+		}
+		while (handle_command());
+		fclose(CMD_INPUT);
+		CMD_INPUT = stdin;
+	}else {
+		runAll();
+	}
+
+	fp = open_memstream(&job->result, &job->result_len);
+	if (fp == NULL) {
+		printf("Error: Out of memory collecting the result of %s\n", job->program);
+		exit(-1);
+	}
+	print_json(fp, NULL, 0, farm->regs);
+	fclose(fp);
+	job->instructions = INSTRUCTION_COUNT;
+	job->cycles = CYCLE_COUNT;
+	sim_destroy(s);
+	job->seconds = farm_now() - start;
+}
+
+static void *farm_worker(void *arg) {
+	farm_worker_t *w = arg;
+	int job;
+
+	while ((job = farm_next(w->farm, w->id)) >= 0) {
+		w->farm->jobs[job].worker = w->id;
+		farm_run(w->farm, &w->farm->jobs[job]);
+	}
+	return NULL;
+}
+
+/***************************************************************/
+/* Parse the job file into jobs; returns the job count, -1 on error        */
+/***************************************************************/
+static int farm_parse(const char *file, farm_job_t **jobs) {
+	char text[FARM_LINE], *p, *cmd, *end;
+	FILE *fp = fopen(file, "r");
+	int n = 0, lineno = 0;
+	size_t len;
+
+	if (fp == NULL) {
+		printf("Error: Can't open job file %s\n", file);
+		return -1;
+	}
+	*jobs = NULL;
+	while (fgets(text, sizeof(text), fp) != NULL) {
+		lineno++;
+		text[strcspn(text, "\r\n")] = '\0';
+		for (p = text; *p == ' ' || *p == '\t'; p++);
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		/* program name up to the first ; or blank */
+		len = strcspn(p, "; \t");
+		cmd = p + len;
+		if (len >= sizeof(prog_file)) {
+			printf("Error: %s:%d: program path is too long\n", file, lineno);
+			fclose(fp);
+			return -1;
+		}
+		*jobs = realloc(*jobs, (n + 1) * sizeof(farm_job_t));
+		if (*jobs == NULL) {
+			printf("Error: Out of memory reading %s\n", file);
+			exit(-1);
+		}
+		memset(&(*jobs)[n], 0, sizeof(farm_job_t));
+		(*jobs)[n].program = strndup(p, len);
+		/* commands: ; becomes a line break; drop the leading one */
+		for (cmd += strspn(cmd, " \t"); *cmd == ';'; cmd++);
+		(*jobs)[n].commands = strdup(cmd);
+		if ((*jobs)[n].program == NULL || (*jobs)[n].commands == NULL) {
+			printf("Error: Out of memory reading %s\n", file);
+			exit(-1);
+		}
+		for (end = (*jobs)[n].commands; *end != '\0'; end++) {
+			if (*end == ';') {
+				*end = '\n';
+			}
+		}
+		n++;
+	}
+	fclose(fp);
+	if (n == 0) {
+		printf("Error: %s holds no jobs\n", file);
+		return -1;
+	}
+	return n;
+}
+
+/***************************************************************/
+/* Run every job in file on num_workers threads (0: one per CPU) and    */
+/* print the report. Returns -1 if the jobs could not be started.          */
+/***************************************************************/
+static int run_farm(const char *file, int num_workers, const char *memory, FILE *output, int regs) {
+	farm_t farm = { .memory = memory, .output = output, .regs = regs };
+	farm_worker_t *workers;
+	pthread_t *threads;
+	uint64_t instructions = 0, cycles = 0;
+	double start, busy = 0;
+	int num_jobs, i;
+
+	if ((num_jobs = farm_parse(file, &farm.jobs)) < 0) {
+		return -1;
+	}
+	/* parse each program once, and report bad ones before starting */
+	for (i = 0; i < num_jobs; i++) {
+		if (load_share(farm.jobs[i].program) != 0) {
+			return -1;
+		}
+	}
+	if (num_workers <= 0) {
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (num_workers > num_jobs) {
+		num_workers = num_jobs;
+	}
+	if (num_workers < 1) {
+		num_workers = 1;
+	}
+	farm.num_workers = num_workers;
+	farm.queues = calloc(num_workers, sizeof(farm_queue_t));
+	workers = calloc(num_workers, sizeof(farm_worker_t));
+	threads = calloc(num_workers, sizeof(pthread_t));
+	if (farm.queues == NULL || workers == NULL || threads == NULL) {
+		printf("Error: Out of memory starting %d workers\n", num_workers);
+		exit(-1);
+	}
+	pthread_mutex_init(&farm.lock, NULL);
+	for (i = 0; i < num_workers; i++) {
+		pthread_mutex_init(&farm.queues[i].lock, NULL);
+		farm.queues[i].jobs = malloc((num_jobs / num_workers + 1) * sizeof(int));
+		if (farm.queues[i].jobs == NULL) {
+			printf("Error: Out of memory starting %d workers\n", num_workers);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < num_jobs; i++) {
+		farm_queue_t *q = &farm.queues[i % num_workers];
+		q->jobs[q->tail++] = i;
+	}
+
+	start = farm_now();
+	for (i = 0; i < num_workers; i++) {
+		workers[i].farm = &farm;
+		workers[i].id = i;
+		if (pthread_create(&threads[i], NULL, farm_worker, &workers[i]) != 0) {
+			printf("Error: Can't start worker %d\n", i);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < num_workers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (i = 0; i < num_jobs; i++) {
+		instructions += farm.jobs[i].instructions;
+		cycles += farm.jobs[i].cycles;
+		busy += farm.jobs[i].seconds;
+	}
+
+	fflush(stdout);
+	printf("{\n\t\"farm\": { \"jobs\": %d, \"workers\": %d, \"steals\": %u, \"seconds\": %.3f, \"job_seconds\": %.3f, "
+		"\"instructions\": %llu, \"cycles\": %llu },\n\t\"results\": [\n", num_jobs, num_workers, farm.steals,
+		farm_now() - start, busy, (unsigned long long)instructions, (unsigned long long)cycles);
+	for (i = 0; i < num_jobs; i++) {
+		/* the batch result, less its closing newline */
+		fwrite(farm.jobs[i].result, farm.jobs[i].result_len - 1, 1, stdout);
+		printf("%s\n", i + 1 < num_jobs ? "," : "");
+		free(farm.jobs[i].result);
+		free(farm.jobs[i].program);
+		free(farm.jobs[i].commands);
+	}
+	printf("\t]\n}\n");
+
+	for (i = 0; i < num_workers; i++) {
+		free(farm.queues[i].jobs);
+	}
+	free(farm.queues);
+	free(farm.jobs);
+	free(workers);
+	free(threads);
+	return 0;
+}
+
+/***************************************************************/
+/* Command line                                                                                                        */
+/***************************************************************/
+/* Any of --run, --sim, --script or a dump option selects batch mode: the
+ * actions run in the order given, nothing but errors and script output is
+ * printed, and the result goes to stdout as one JSON object. What the
+ * program itself prints goes to stderr instead, or to the --stdout file,
+ * so the result stays parseable. */
+enum { ACTION_RUN, ACTION_SIM, ACTION_SCRIPT };
+
+static const struct option LONG_OPTIONS[] = {
+	{ "run",          required_argument, NULL, 'r' },
+	{ "sim",          no_argument,       NULL, 's' },
+	{ "script",      required_argument, NULL, 'f' },
+	{ "dump-regs", no_argument,       NULL, 'd' },
+	{ "dump-mem", required_argument, NULL, 'm' },
+	{ "memory",     required_argument, NULL, 'M' },
+	{ "trace",        required_argument, NULL, 't' },
+	{ "farm",         required_argument, NULL, 'F' },
+	{ "jobs",         required_argument, NULL, 'j' },
+	{ "stdout",      required_argument, NULL, 'o' },
+	{ "verbose",    no_argument,       NULL, 'v' },
+	{ NULL, 0, NULL, 0 }
+};
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] <input program>\n", name);
+	printf("  -v, --verbose\t\tlist loaded segments (twice: every word)\n");
+	printf("  --memory <file>\tconfigure the caches and DRAM from <file>\n");
+	printf("  --trace <file>\twrite retired instructions to <file> (|cmd: pipe to cmd)\n");
+	printf("  --run <n>\t\tsimulate <n> cycles (instructions in fast mode)\n");
+	printf("  --sim\t\t\tsimulate to completion\n");
+	printf("  --script <file>\trun the simulator commands in <file>\n");
+	printf("  --stdout <file>\twrite what the program prints to <file> (batch default: stderr)\n");
+	printf("  --dump-regs\t\tinclude registers in the JSON result\n");
+	printf("  --dump-mem <a:b>\tinclude memory from <a> to <b> (hex) in the JSON result\n");
+	printf("  --farm <file>\t\trun the jobs in <file> (program ; commands ...) in parallel\n");
+	printf("  --jobs <n>\t\tworker threads for --farm (default: one per CPU)\n\n");
+	printf("       %s --farm <file> [--jobs <n>] [--memory <file>] [--stdout <file>] [--dump-regs]\n\n", name);
+}
+
+/***************************************************************/
+/* main                                                                                                                                   */
+/***************************************************************/
+int main(int argc, char *argv[]) {                              
+	int opt, i, batch = FALSE, regs = FALSE, workers = 0;
+	int num_actions = 0, num_ranges = 0;
+	int *action = malloc(argc * sizeof(int));
+	char **action_arg = malloc(argc * sizeof(char *));
+	uint32_t *ranges = malloc(2 * argc * sizeof(uint32_t));
+	char *end, *memory = NULL, *trace = NULL, *farm = NULL;
+	FILE *output = NULL;
+
+	if (action == NULL || action_arg == NULL || ranges == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	sim_select(&SIM_MAIN);
+	atexit(trace_close);
+	CMD_INPUT = stdin;
+	while ((opt = getopt_long(argc, argv, "v", LONG_OPTIONS, NULL)) != -1) {
+		switch (opt) {
+			case 'v':
+				VERBOSE++;
+				break;
+			case 'M':
+				memory = optarg;
+				break;
+			case 't':
+				trace = optarg;
+				break;
+			case 'F':
+				farm = optarg;
+				break;
+			case 'o':
+				if (output != NULL) {
+					fclose(output);
+				}
+				if ((output = fopen(optarg, "w")) == NULL) {
+					printf("Error: Can't create %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'j':
+				workers = atoi(optarg);
+				break;
+			case 'r':
+			case 's':
+			case 'f':
+				action[num_actions] = opt == 'r' ? ACTION_RUN : opt == 's' ? ACTION_SIM : ACTION_SCRIPT;
+				action_arg[num_actions++] = optarg;
+				batch = TRUE;
+				break;
+			case 'd':
+				regs = TRUE;
+				batch = TRUE;
+				break;
+			case 'm':
+				ranges[2 * num_ranges] = strtoul(optarg, &end, 16);
+				if (*end != ':') {
+					printf("Error: --dump-mem expects <start>:<stop>, got %s\n", optarg);
+					exit(1);
+				}
+				ranges[2 * num_ranges + 1] = strtoul(end + 1, &end, 16);
+				if (*end != '\0') {
+					printf("Error: --dump-mem expects <start>:<stop>, got %s\n", optarg);
+					exit(1);
+				}
+				num_ranges++;
+				batch = TRUE;
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+	QUIET = batch;
+	if (output == NULL && (batch || farm != NULL)) {
+		/* stdout carries the JSON result */
+		output = stderr;
+	}
+
+	if (farm != NULL) {
+		if (trace != NULL || num_actions > 0 || num_ranges > 0 || optind < argc) {
+			printf("Error: --farm takes the programs from the job file and only --jobs, --memory, --stdout and --dump-regs\n");
+			exit(1);
+		}
+		QUIET = TRUE;
+		initialize();
+		if (memory != NULL && load_memory_config(memory) != 0) {
+			exit(1);
+		}
+		return run_farm(farm, workers, memory, output, regs) == 0 ? 0 : 1;
+	}
+
+	if (!QUIET) {
+		printf("\n**************************\n");
+		printf("Welcome to MU-MIPS SIM...\n");
+		printf("**************************\n\n");
+	}
+	if (optind >= argc) {
+		printf("Error: You should provide input file.\n");
+		usage(argv[0]);
+		exit(1);
+	}
+	if (strlen(argv[optind]) >= sizeof(prog_file)) {
+		printf("Error: Program path %s is too long\n", argv[optind]);
+		exit(1);
+	}
+
+	strcpy(prog_file, argv[optind]);
+	initialize();
+	syscall_output_to(output);
+	if (memory != NULL && load_memory_config(memory) != 0) {
+		exit(1);
+	}
+	if (load_program() != 0) {
+		exit(-1);
+	}
+	if (trace != NULL && trace_open(trace) != 0) {
+		exit(1);
+	}
+	if (!batch) {
+		help();
+		while (handle_command());
+		return 0;
+	}
+
+	for (i = 0; i < num_actions; i++) {
+		switch (action[i]) {
+			case ACTION_RUN:
+				run(atoi(action_arg[i]));
+				break;
+			case ACTION_SIM:
+				runAll();
+				break;
+			case ACTION_SCRIPT:
+				if (run_script(action_arg[i]) != 0) {
+					exit(1);
+				}
+				break;
+		}
+	}
+	fflush(stdout);
+	print_json(stdout, ranges, num_ranges, regs);
+	return 0;
+}
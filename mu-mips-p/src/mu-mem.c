@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+
+mem_region_t MEM_REGIONS[] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END },
+	{ MEM_DATA_BEGIN, MEM_DATA_END },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END }
+};
+
+static mem_ctx_t MEM_DEFAULT;
+__thread mem_ctx_t *MEM_CTX = &MEM_DEFAULT;
+
+/* backs read TLB entries for pages that were never written */
+static uint8_t MEM_ZERO_PAGE[MEM_PAGE_SIZE];
+
+/***************************************************************/
+/* Find the page backing an address. For writes the page is allocated     */
+/* on first touch and queued for clearing on the next reset.                  */
+/***************************************************************/
+mem_page_t *mem_page_lookup(uint32_t address, int write)
+{
+	uint32_t dir = address >> (MEM_PAGE_SHIFT + MEM_PT_SHIFT);
+	uint32_t idx = (address >> MEM_PAGE_SHIFT) & (MEM_PT_ENTRIES - 1);
+	mem_page_t *page;
+
+	if (MEM_PAGE_DIR[dir] == NULL) {
+		if (!write) {
+			return NULL;
+		}
+		MEM_PAGE_DIR[dir] = calloc(MEM_PT_ENTRIES, sizeof(mem_page_t *));
+		if (MEM_PAGE_DIR[dir] == NULL) {
+			error_fatal("Out of memory allocating page table for 0x%08x\n", address);
+		}
+	}
+	page = MEM_PAGE_DIR[dir][idx];
+	if (!write) {
+		return page;
+	}
+	if (page == NULL) {
+		page = calloc(1, sizeof(mem_page_t));
+		if (page == NULL) {
+			error_fatal("Out of memory allocating page for 0x%08x\n", address);
+		}
+		page->vpn = address >> MEM_PAGE_SHIFT;
+		MEM_PAGE_DIR[dir][idx] = page;
+		MEM_PAGES_ALLOCATED++;
+
+		/* a cached read translation still points at the zero page */
+		if (MEM_TLB_READ[page->vpn & (MEM_TLB_ENTRIES - 1)].vpn == page->vpn) {
+			MEM_TLB_READ[page->vpn & (MEM_TLB_ENTRIES - 1)].vpn = MEM_TLB_INVALID;
+		}
+	}
+	if (!page->dirty) {
+		page->dirty = 1;
+		page->next_dirty = MEM_DIRTY_PAGES;
+		MEM_DIRTY_PAGES = page;
+	}
+	return page;
+}
+
+/***************************************************************/
+/* Return TRUE if the address falls in one of MEM_REGIONS                      */
+/***************************************************************/
+int mem_mapped(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Read/write a single byte of backing store (no region check)             */
+/***************************************************************/
+static uint8_t mem_read_byte(uint32_t address)
+{
+	mem_page_t *page = mem_page_lookup(address, 0);
+	return page == NULL ? 0 : page->data[address & MEM_PAGE_MASK];
+}
+
+static void mem_write_byte(uint32_t address, uint8_t value)
+{
+	/* untouched pages already read as zero */
+	if (value == 0 && mem_page_lookup(address, 0) == NULL) {
+		return;
+	}
+	mem_page_lookup(address, 1)->data[address & MEM_PAGE_MASK] = value;
+}
+
+/***************************************************************/
+/* Read a 32-bit word without going through the TLB                           */
+/***************************************************************/
+uint32_t mem_read_32_uncached(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
+			uint32_t offset = address & MEM_PAGE_MASK;
+			if (offset > MEM_PAGE_SIZE - 4) {
+				/* word straddles two pages */
+				return (mem_read_byte(address+3) << 24) |
+						(mem_read_byte(address+2) << 16) |
+						(mem_read_byte(address+1) <<  8) |
+						(mem_read_byte(address+0) <<  0);
+			}
+			mem_page_t *page = mem_page_lookup(address, 0);
+			if (page == NULL) {
+				return 0;
+			}
+			return (page->data[offset+3] << 24) |
+					(page->data[offset+2] << 16) |
+					(page->data[offset+1] <<  8) |
+					(page->data[offset+0] <<  0);
+		}
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Write a 32-bit word without going through the TLB                            */
+/***************************************************************/
+void mem_write_32_uncached(uint32_t address, uint32_t value)
+{
+	int i;
+	uint32_t offset;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
+			offset = address & MEM_PAGE_MASK;
+			if (offset > MEM_PAGE_SIZE - 4) {
+				mem_write_byte(address+3, (value >> 24) & 0xFF);
+				mem_write_byte(address+2, (value >> 16) & 0xFF);
+				mem_write_byte(address+1, (value >>  8) & 0xFF);
+				mem_write_byte(address+0, (value >>  0) & 0xFF);
+				return;
+			}
+			if (value == 0 && mem_page_lookup(address, 0) == NULL) {
+				return;
+			}
+			mem_page_t *page = mem_page_lookup(address, 1);
+
+			page->data[offset+3] = (value >> 24) & 0xFF;
+			page->data[offset+2] = (value >> 16) & 0xFF;
+			page->data[offset+1] = (value >>  8) & 0xFF;
+			page->data[offset+0] = (value >>  0) & 0xFF;
+			return;
+		}
+	}
+}
+
+/***************************************************************/
+/* Copy a host buffer into guest memory a page at a time. Used by the     */
+/* program loader; addresses outside MEM_REGIONS are skipped.               */
+/***************************************************************/
+void mem_write_block(uint32_t address, const uint8_t *src, uint32_t len)
+{
+	static const uint8_t zero[MEM_PAGE_SIZE];
+	uint32_t offset, n;
+
+	while (len > 0) {
+		offset = address & MEM_PAGE_MASK;
+		n = MEM_PAGE_SIZE - offset;
+		if (n > len) {
+			n = len;
+		}
+		if (mem_mapped(address)) {
+			if (address >= MEM_TEXT_BEGIN && address <= MEM_TEXT_END && MEM_TEXT_WRITE_HOOK != NULL) {
+				MEM_TEXT_WRITE_HOOK(address, n);
+			}
+			/* untouched pages already read as zero */
+			if (mem_page_lookup(address, 0) != NULL || memcmp(src, zero, n) != 0) {
+				memcpy(mem_page_lookup(address, 1)->data + offset, src, n);
+			}
+		}
+		address += n;
+		src += n;
+		len -= n;
+	}
+}
+
+/***************************************************************/
+/* TLB miss (or unaligned) read of <size> bytes: refill the entry, then    */
+/* read little-endian                                                                                         */
+/***************************************************************/
+static uint32_t mem_read_slow(uint32_t address, int size)
+{
+	uint32_t vpn = address >> MEM_PAGE_SHIFT;
+	uint32_t offset = address & MEM_PAGE_MASK;
+	mem_tlb_entry_t *e = &MEM_TLB_READ[vpn & (MEM_TLB_ENTRIES - 1)];
+	uint32_t value = 0;
+	int i;
+
+	if (e->vpn != vpn) {
+		if (!mem_mapped(address)) {
+			return 0;
+		}
+		mem_page_t *page = mem_page_lookup(address, 0);
+		e->vpn = vpn;
+		e->host = page != NULL ? page->data : MEM_ZERO_PAGE;
+	}
+	if (offset > MEM_PAGE_SIZE - size) {
+		/* access straddles two pages */
+		for (i = size - 1; i >= 0; i--) {
+			value = (value << 8) | mem_read_byte(address + i);
+		}
+		return value;
+	}
+	for (i = size - 1; i >= 0; i--) {
+		value = (value << 8) | e->host[offset + i];
+	}
+	return value;
+}
+
+/***************************************************************/
+/* TLB miss (or unaligned) write of <size> bytes: dirty the page and      */
+/* refill the entry                                                                                              */
+/***************************************************************/
+static void mem_write_slow(uint32_t address, uint32_t value, int size)
+{
+	uint32_t offset = address & MEM_PAGE_MASK;
+	int text = address >= MEM_TEXT_BEGIN && address <= MEM_TEXT_END;
+	mem_page_t *page;
+	int i;
+
+	if (!mem_mapped(address)) {
+		return;
+	}
+	if (text && MEM_TEXT_WRITE_HOOK != NULL) {
+		MEM_TEXT_WRITE_HOOK(address, size);
+	}
+	if (offset > MEM_PAGE_SIZE - size) {
+		for (i = 0; i < size; i++) {
+			mem_write_byte(address + i, (value >> (8 * i)) & 0xFF);
+		}
+		return;
+	}
+	if (value == 0 && mem_page_lookup(address, 0) == NULL) {
+		return;
+	}
+	page = mem_page_lookup(address, 1);
+	if (!text) {
+		MEM_TLB_WRITE[page->vpn & (MEM_TLB_ENTRIES - 1)].vpn = page->vpn;
+		MEM_TLB_WRITE[page->vpn & (MEM_TLB_ENTRIES - 1)].host = page->data;
+	}
+	for (i = 0; i < size; i++) {
+		page->data[offset + i] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+uint32_t mem_read_32_slow(uint32_t address) { return mem_read_slow(address, 4); }
+uint16_t mem_read_16_slow(uint32_t address) { return mem_read_slow(address, 2); }
+uint8_t mem_read_8_slow(uint32_t address) { return mem_read_slow(address, 1); }
+
+void mem_write_32_slow(uint32_t address, uint32_t value) { mem_write_slow(address, value, 4); }
+void mem_write_16_slow(uint32_t address, uint16_t value) { mem_write_slow(address, value, 2); }
+void mem_write_8_slow(uint32_t address, uint8_t value) { mem_write_slow(address, value, 1); }
+
+/***************************************************************/
+/* Drop every cached translation                                                                         */
+/***************************************************************/
+void mem_tlb_flush()
+{
+	int i;
+	for (i = 0; i < MEM_TLB_ENTRIES; i++) {
+		MEM_TLB_READ[i].vpn = MEM_TLB_INVALID;
+		MEM_TLB_WRITE[i].vpn = MEM_TLB_INVALID;
+	}
+}
+
+/***************************************************************/
+/* Zero every page written since the last reset                                          */
+/***************************************************************/
+void mem_clear_dirty()
+{
+	mem_page_t *page = MEM_DIRTY_PAGES;
+	while (page != NULL) {
+		mem_page_t *next = page->next_dirty;
+		memset(page->data, 0, MEM_PAGE_SIZE);
+		page->dirty = 0;
+		page->next_dirty = NULL;
+		page = next;
+	}
+	MEM_DIRTY_PAGES = NULL;
+
+	/* clean pages must take the slow path again on their next write */
+	mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Checkpoint image of memory: every dirty page that is not all zero as  */
+/* a little-endian page number followed by the 4 KB of data, closed by    */
+/* MEM_TLB_INVALID. Returns the number of pages written, -1 on error.    */
+/***************************************************************/
+int mem_save_pages(FILE *fp)
+{
+	static const uint8_t zero[MEM_PAGE_SIZE];
+	mem_page_t *page;
+	uint8_t vpn[4];
+	int count = 0;
+
+	for (page = MEM_DIRTY_PAGES; page != NULL; page = page->next_dirty) {
+		if (memcmp(page->data, zero, MEM_PAGE_SIZE) == 0) {
+			continue;
+		}
+		mem_store_le32(vpn, page->vpn);
+		if (fwrite(vpn, 4, 1, fp) != 1 || fwrite(page->data, MEM_PAGE_SIZE, 1, fp) != 1) {
+			return -1;
+		}
+		count++;
+	}
+	mem_store_le32(vpn, MEM_TLB_INVALID);
+	if (fwrite(vpn, 4, 1, fp) != 1) {
+		return -1;
+	}
+	return count;
+}
+
+/***************************************************************/
+/* Replace memory with the pages of a checkpoint image. The data is read */
+/* straight into the page, bypassing the text write hook; callers must    */
+/* rebuild anything derived from the text region. Returns the number of  */
+/* pages read, -1 on a short or malformed image.                                  */
+/***************************************************************/
+int mem_load_pages(FILE *fp)
+{
+	mem_page_t *page;
+	uint8_t buf[4];
+	uint32_t vpn;
+	int count = 0;
+
+	mem_clear_dirty();
+	for (;;) {
+		if (fread(buf, 4, 1, fp) != 1) {
+			return -1;
+		}
+		vpn = mem_load_le32(buf);
+		if (vpn == MEM_TLB_INVALID) {
+			break;
+		}
+		if (vpn >= (1u << (32 - MEM_PAGE_SHIFT))) {
+			return -1;
+		}
+		page = mem_page_lookup(vpn << MEM_PAGE_SHIFT, 1);
+		if (fread(page->data, MEM_PAGE_SIZE, 1, fp) != 1) {
+			return -1;
+		}
+		count++;
+	}
+	mem_tlb_flush();
+	return count;
+}
+
+/***************************************************************/
+/* Start with an empty page directory; pages are allocated on first write */
+/***************************************************************/
+void init_memory() {
+	memset(MEM_PAGE_DIR, 0, sizeof(MEM_PAGE_DIR));
+	MEM_DIRTY_PAGES = NULL;
+	MEM_PAGES_ALLOCATED = 0;
+	mem_tlb_flush();
+}
+
+/***************************************************************/
+/* Release every page and page table of the current instance                 */
+/***************************************************************/
+void mem_free() {
+	uint32_t dir, idx;
+
+	for (dir = 0; dir < MEM_DIR_ENTRIES; dir++) {
+		if (MEM_PAGE_DIR[dir] == NULL) {
+			continue;
+		}
+		for (idx = 0; idx < MEM_PT_ENTRIES; idx++) {
+			free(MEM_PAGE_DIR[dir][idx]);
+		}
+		free(MEM_PAGE_DIR[dir]);
+	}
+	init_memory();
+}
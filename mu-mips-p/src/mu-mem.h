@@ -0,0 +1,250 @@
+#ifndef MU_MEM_H
+#define MU_MEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************/
+/* MIPS memory layout                                                                                                                                      */
+/******************************************************************************/
+#define MEM_TEXT_BEGIN  0x00400000
+#define MEM_TEXT_END      0x0FFFFFFF
+/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
+#define MEM_DATA_BEGIN  0x10010000
+#define MEM_DATA_END   0x7FFFFFFF
+
+#define MEM_KTEXT_BEGIN 0x80000000
+#define MEM_KTEXT_END  0x8FFFFFFF
+
+#define MEM_KDATA_BEGIN 0x90000000
+#define MEM_KDATA_END  0xFFFEFFFF
+
+/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
+#define MEM_STACK_BEGIN 0x7FFFFFFF
+#define MEM_STACK_END  0x10010000
+
+typedef struct {
+	uint32_t begin, end;
+} mem_region_t;
+
+extern mem_region_t MEM_REGIONS[];
+
+#define NUM_MEM_REGION 4
+
+/******************************************************************************/
+/* Sparse guest memory                                                                                                                              */
+/******************************************************************************/
+/* Regions are backed by 4 KB pages allocated on first write. A page that was
+ * never written reads as zero. The 32-bit address splits into a 10-bit
+ * directory index, a 10-bit page table index and a 12-bit page offset. */
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE  (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK  (MEM_PAGE_SIZE - 1)
+#define MEM_PT_SHIFT   10
+#define MEM_PT_ENTRIES (1 << MEM_PT_SHIFT)
+#define MEM_DIR_ENTRIES (1 << (32 - MEM_PAGE_SHIFT - MEM_PT_SHIFT))
+
+typedef struct mem_page_struct {
+	uint8_t data[MEM_PAGE_SIZE];
+	uint32_t vpn;                                   /* guest page number */
+	int dirty;                                          /* written since the last reset */
+	struct mem_page_struct *next_dirty;
+} mem_page_t;
+
+/******************************************************************************/
+/* Software TLB                                                                                                                                          */
+/******************************************************************************/
+/* Direct-mapped by guest page number. Read entries may point at a shared
+ * zero page for pages that were never written; write entries only exist for
+ * pages that are already allocated and dirty, so a hit never has to touch the
+ * page table. Both are flushed whenever the dirty list is cleared. */
+#define MEM_TLB_ENTRIES 256
+#define MEM_TLB_INVALID 0xFFFFFFFF
+
+typedef struct {
+	uint32_t vpn;
+	uint8_t *host;
+} mem_tlb_entry_t;
+
+/******************************************************************************/
+/* Memory instance                                                                                                                                    */
+/******************************************************************************/
+/* Everything above that changes while a program runs belongs to one
+ * simulator instance. MEM_CTX is per thread and points at the instance the
+ * thread is simulating; the names the rest of the code uses are macros over
+ * it. A thread that never selects one shares a default instance. */
+typedef struct {
+	mem_page_t **page_dir[MEM_DIR_ENTRIES]; /* page tables, allocated on demand */
+	mem_page_t *dirty_pages;                     /* pages reset() has to clear */
+	uint32_t pages_allocated;
+	mem_tlb_entry_t tlb_read[MEM_TLB_ENTRIES];
+	mem_tlb_entry_t tlb_write[MEM_TLB_ENTRIES];
+	/* Called for every store into the text region. Text pages never get a
+	 * write TLB entry, so such stores always reach the slow path. */
+	void (*text_write_hook)(uint32_t address, int size);
+} mem_ctx_t;
+
+extern __thread mem_ctx_t *MEM_CTX;
+
+#define MEM_PAGE_DIR            (MEM_CTX->page_dir)
+#define MEM_DIRTY_PAGES       (MEM_CTX->dirty_pages)
+#define MEM_PAGES_ALLOCATED (MEM_CTX->pages_allocated)
+#define MEM_TLB_READ            (MEM_CTX->tlb_read)
+#define MEM_TLB_WRITE          (MEM_CTX->tlb_write)
+#define MEM_TEXT_WRITE_HOOK (MEM_CTX->text_write_hook)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void init_memory();
+void mem_free();
+mem_page_t *mem_page_lookup(uint32_t address, int write);
+int mem_mapped(uint32_t address);
+void mem_clear_dirty();
+void mem_tlb_flush();
+uint32_t mem_read_32_slow(uint32_t address);
+uint16_t mem_read_16_slow(uint32_t address);
+uint8_t mem_read_8_slow(uint32_t address);
+void mem_write_32_slow(uint32_t address, uint32_t value);
+void mem_write_16_slow(uint32_t address, uint16_t value);
+void mem_write_8_slow(uint32_t address, uint8_t value);
+uint32_t mem_read_32_uncached(uint32_t address);
+void mem_write_32_uncached(uint32_t address, uint32_t value);
+void mem_write_block(uint32_t address, const uint8_t *src, uint32_t len);
+int mem_save_pages(FILE *fp);
+int mem_load_pages(FILE *fp);
+
+/***************************************************************/
+/* Host access to little-endian guest words                                                          */
+/***************************************************************/
+static inline uint32_t mem_load_le32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline void mem_store_le32(uint8_t *p, uint32_t v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	memcpy(p, &v, 4);
+}
+
+/***************************************************************/
+/* Checkpoint fields: little-endian words on a stream. A short read     */
+/* clears *ok and yields 0, so a caller checks once after a run of gets */
+/***************************************************************/
+static inline void ckpt_put(FILE *fp, uint32_t value)
+{
+	uint8_t b[4];
+	mem_store_le32(b, value);
+	fwrite(b, 4, 1, fp);
+}
+
+static inline uint32_t ckpt_get(FILE *fp, int *ok)
+{
+	uint8_t b[4];
+	if (fread(b, 4, 1, fp) != 1) {
+		*ok = 0;
+		return 0;
+	}
+	return mem_load_le32(b);
+}
+
+static inline void ckpt_put64(FILE *fp, uint64_t value)
+{
+	ckpt_put(fp, (uint32_t)value);
+	ckpt_put(fp, (uint32_t)(value >> 32));
+}
+
+static inline uint64_t ckpt_get64(FILE *fp, int *ok)
+{
+	uint64_t low = ckpt_get(fp, ok);
+	return low | ((uint64_t)ckpt_get(fp, ok) << 32);
+}
+
+/***************************************************************/
+/* Read a 32-bit word from memory                                                                            */
+/***************************************************************/
+static inline uint32_t mem_read_32(uint32_t address)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_READ[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT) && (address & 3) == 0) {
+		return mem_load_le32(e->host + (address & MEM_PAGE_MASK));
+	}
+	return mem_read_32_slow(address);
+}
+
+/***************************************************************/
+/* Write a 32-bit word to memory                                                                                */
+/***************************************************************/
+static inline void mem_write_32(uint32_t address, uint32_t value)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_WRITE[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT) && (address & 3) == 0) {
+		mem_store_le32(e->host + (address & MEM_PAGE_MASK), value);
+		return;
+	}
+	mem_write_32_slow(address, value);
+}
+
+/***************************************************************/
+/* Read a 16-bit halfword from memory                                                                     */
+/***************************************************************/
+static inline uint16_t mem_read_16(uint32_t address)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_READ[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT) && (address & 1) == 0) {
+		const uint8_t *p = e->host + (address & MEM_PAGE_MASK);
+		return p[0] | (p[1] << 8);
+	}
+	return mem_read_16_slow(address);
+}
+
+/***************************************************************/
+/* Write a 16-bit halfword to memory                                                                         */
+/***************************************************************/
+static inline void mem_write_16(uint32_t address, uint16_t value)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_WRITE[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT) && (address & 1) == 0) {
+		uint8_t *p = e->host + (address & MEM_PAGE_MASK);
+		p[0] = value & 0xFF;
+		p[1] = value >> 8;
+		return;
+	}
+	mem_write_16_slow(address, value);
+}
+
+/***************************************************************/
+/* Read a byte from memory                                                                                      */
+/***************************************************************/
+static inline uint8_t mem_read_8(uint32_t address)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_READ[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT)) {
+		return e->host[address & MEM_PAGE_MASK];
+	}
+	return mem_read_8_slow(address);
+}
+
+/***************************************************************/
+/* Write a byte to memory                                                                                          */
+/***************************************************************/
+static inline void mem_write_8(uint32_t address, uint8_t value)
+{
+	mem_tlb_entry_t *e = &MEM_TLB_WRITE[(address >> MEM_PAGE_SHIFT) & (MEM_TLB_ENTRIES - 1)];
+	if (e->vpn == (address >> MEM_PAGE_SHIFT)) {
+		e->host[address & MEM_PAGE_MASK] = value;
+		return;
+	}
+	mem_write_8_slow(address, value);
+}
+
+#endif
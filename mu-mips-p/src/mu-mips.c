@@ -1,11 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <assert.h>
+#include <math.h>
+#include <unistd.h>
 
 #include "mu-mips.h"
 
+__thread sim_t *SIM;
+
+const char *MULDIV_NAMES[MULDIV_UNITS] = { "mult", "div" };
+
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
 /***************************************************************/
@@ -22,53 +29,89 @@ void help() {
 	printf("low <val>\t-- set the LO register to <val>\n");
 	printf("print\t-- print the program loaded into memory\n");
 	printf("show\t-- print the current content of the pipeline registers\n");
+	printf("stats\t-- print the performance counters and the hottest instructions\n");
+	printf("core <switch|threaded>\t-- select how EX/MEM dispatch instructions\n");
+	printf("mode <pipe|fast|ooo>\t-- detailed pipeline, fast functional simulation or out-of-order core\n");
+	printf("ooo <rob> <rs> <regs> <lsq> <unified|split>\t-- out-of-order core sizes (stations per unit when split)\n");
+	printf("jit <on|off>\t-- run hot blocks as host code in fast mode\n");
+	printf("forward <on|off>\t-- data forwarding (off: stall until writeback)\n");
+	printf("width <n> <ports>\t-- issue up to <n> instructions a cycle, <ports> of them loads/stores\n");
+	printf("muldiv <mult|div> <latency> <interval>\t-- mult/div unit timing in cycles\n");
+	printf("bpred <nottaken|bimodal|gshare|tournament|btb>\t-- branch predictor (starts cold)\n");
+	printf("cache <i|d|l2> <size> <assoc> <line> <lru|plru|random> <wb|wt> <hit> <miss>\t-- cache model, latencies in cycles\n");
+	printf("cache <i|d|l2> off\t-- disable a cache model\n");
+	printf("memory <file>\t-- configure the caches and DRAM from <file>\n");
+	printf("sample <ff> <warm> <measure> <n>\t-- sampled simulation, n samples (0: to completion)\n");
+	printf("trace <file>|off\t-- write retired instructions to <file> (|cmd: pipe to cmd)\n");
+	printf("timeline <n>\t-- record stage occupancy for the last <n> pipeline cycles (0: off)\n");
+	printf("timeline dump <file>\t-- write the recorded cycles as a Konata log\n");
+	printf("checkpoint <file>\t-- save the simulator state to <file>\n");
+	printf("restore <file>\t-- continue from a state saved by checkpoint\n");
 	printf("?\t-- display help menu\n");
 	printf("quit\t-- exit the simulator\n\n");
 	printf("------------------------------------------------------------------\n\n");
 }
 
 /***************************************************************/
-/* Read a 32-bit word from memory                                                                            */
+/* Run the stages and record what occupied each one: ID to WB hold    */
+/* the latches as the cycle began, IF whatever it fetched                        */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address)
+static void timeline_latch(timeline_slot_t *slot, const CPU_Pipeline_Reg *reg)
 {
-	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) &&  ( address <= MEM_REGIONS[i].end) ) {
-			uint32_t offset = address - MEM_REGIONS[i].begin;
-			return (MEM_REGIONS[i].mem[offset+3] << 24) |
-					(MEM_REGIONS[i].mem[offset+2] << 16) |
-					(MEM_REGIONS[i].mem[offset+1] <<  8) |
-					(MEM_REGIONS[i].mem[offset+0] <<  0);
-		}
-	}
-	return 0;
+	slot->seq = reg->seq;
+	slot->pc = reg->PC;
+	slot->ir = reg->inst->IR;
 }
 
-/***************************************************************/
-/* Write a 32-bit word to memory                                                                                */
-/***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value)
-{
+static void record_timeline() {
+	timeline_slot_t slots[TIMELINE_SLOTS];
+	uint32_t fetched = FETCH_SEQ;
 	int i;
-	uint32_t offset;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
-			offset = address - MEM_REGIONS[i].begin;
 
-			MEM_REGIONS[i].mem[offset+3] = (value >> 24) & 0xFF;
-			MEM_REGIONS[i].mem[offset+2] = (value >> 16) & 0xFF;
-			MEM_REGIONS[i].mem[offset+1] = (value >>  8) & 0xFF;
-			MEM_REGIONS[i].mem[offset+0] = (value >>  0) & 0xFF;
+	memset(slots, 0, sizeof(slots));
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		timeline_latch(&slots[1 * TIMELINE_WIDTH + i], &IF_ID[i]);
+		timeline_latch(&slots[2 * TIMELINE_WIDTH + i], &ID_EX[i]);
+		timeline_latch(&slots[3 * TIMELINE_WIDTH + i], &EX_MEM[i]);
+		timeline_latch(&slots[4 * TIMELINE_WIDTH + i], &MEM_WB[i]);
+	}
+	handle_pipeline();
+	/* what ID left behind stays in ID; the rest of IF/ID was just fetched */
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		if (IF_ID[i].seq > fetched) {
+			timeline_latch(&slots[i], &IF_ID[i]);
 		}
 	}
+	timeline_record(CYCLE_COUNT, slots);
 }
 
 /***************************************************************/
 /* Execute one cycle                                                                                                              */
 /***************************************************************/
 void cycle() {                                                
-	handle_pipeline();
+	if (SIM_MODE == MODE_FAST) {
+		fast_step();
+		return;
+	}
+	if (SIM_MODE == MODE_OOO) {
+		ooo_cycle();
+		CYCLE_COUNT++;
+		return;
+	}
+	if (PIPELINE_FREEZE > 0) {
+		/* a cache miss is being serviced */
+		PIPELINE_FREEZE--;
+		if (TIMELINE_ON) {
+			timeline_repeat(CYCLE_COUNT);
+		}
+		CYCLE_COUNT++;
+		return;
+	}
+	if (TIMELINE_ON) {
+		record_timeline();
+	}else {
+		handle_pipeline();
+	}
 	CURRENT_STATE = NEXT_STATE;
 	CYCLE_COUNT++;
 }
@@ -79,19 +122,35 @@ void cycle() {
 void run(int num_cycles) {                                      
 	
 	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped\n\n");
+		if (!QUIET) {
+			printf("Simulation Stopped\n\n");
+		}
 		return;
 	}
 
-	printf("Running simulator for %d cycles...\n\n", num_cycles);
+	if (!QUIET) {
+		printf("Running simulator for %d %s...\n\n", num_cycles, SIM_MODE == MODE_FAST ? "instructions" : "cycles");
+	}
 	int i;
+	if (SIM_MODE == MODE_FAST) {
+		i = num_cycles > 0 ? fast_run(num_cycles) : 0;
+		syscall_flush();
+		if (i < num_cycles && !QUIET) {
+			printf("Simulation Stopped.\n\n");
+		}
+		return;
+	}
 	for (i = 0; i < num_cycles; i++) {
 		if (RUN_FLAG == FALSE) {
-			printf("Simulation Stopped.\n\n");
+			syscall_flush();
+			if (!QUIET) {
+				printf("Simulation Stopped.\n\n");
+			}
 			break;
 		}
 		cycle();
 	}
+	syscall_flush();
 }
 
 /***************************************************************/
@@ -99,15 +158,131 @@ void run(int num_cycles) {
 /***************************************************************/
 void runAll() {                                                     
 	if (RUN_FLAG == FALSE) {
-		printf("Simulation Stopped.\n\n");
+		if (!QUIET) {
+			printf("Simulation Stopped.\n\n");
+		}
 		return;
 	}
 
-	printf("Simulation Started...\n\n");
+	if (!QUIET) {
+		printf("Simulation Started...\n\n");
+	}
 	while (RUN_FLAG){
-		cycle();
+		if (SIM_MODE == MODE_FAST) {
+			fast_run(UINT32_MAX);
+		}else {
+			cycle();
+		}
+	}
+	syscall_flush();
+	if (!QUIET) {
+		printf("Simulation Finished.\n\n");
+	}
+}
+
+/***************************************************************/
+/* Step until num_instructions more have retired (or the run stops)    */
+/***************************************************************/
+void run_instructions(uint32_t num_instructions) {
+	uint32_t target = INSTRUCTION_COUNT + num_instructions;
+	if (SIM_MODE == MODE_FAST) {
+		fast_run(num_instructions);
+	}else {
+		while (RUN_FLAG && (int32_t)(target - INSTRUCTION_COUNT) > 0) {
+			cycle();
+		}
+	}
+	syscall_flush();
+}
+
+/***************************************************************/
+/* Two-sided 95% Student t quantile for df degrees of freedom         */
+/***************************************************************/
+static double t_95(uint32_t df) {
+	static const double t[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+		2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+		2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+	return df < sizeof(t) / sizeof(t[0]) ? t[df] : 1.960;
+}
+
+/***************************************************************/
+/* Sampled simulation (SMARTS-style): repeatedly fast-forward ff            */
+/* instructions in fast mode, warm the pipeline up for warm instructions, */
+/* then measure CPI over measure instructions in the detailed pipeline   */
+/* (the out-of-order core when that is the mode sampling starts in).        */
+/* Reports the sample mean CPI with a 95% confidence interval and the     */
+/* cycle count it extrapolates to, and keeps them in SAMPLE for the JSON  */
+/* result.                                                                                                                  */
+/***************************************************************/
+void sample(uint32_t ff, uint32_t warm, uint32_t measure, uint32_t max_samples) {
+	int saved_mode = SIM_MODE;
+	int detailed = SIM_MODE == MODE_OOO ? MODE_OOO : MODE_PIPELINE;
+	uint32_t n = 0, start_instructions = INSTRUCTION_COUNT;
+	uint32_t c0, i0, total;
+	double cpi, sum = 0, sumsq = 0, mean, sd = 0, half = 0;
+
+	if (RUN_FLAG == FALSE) {
+		if (!QUIET) {
+			printf("Simulation Stopped.\n\n");
+		}
+		return;
+	}
+	if (measure == 0) {
+		error_report("Measurement window must be at least one instruction.\n");
+		return;
+	}
+
+	if (!QUIET) {
+		printf("Sampling: fast-forward %u, warm-up %u, measure %u instructions...\n\n", ff, warm, measure);
+	}
+	while (RUN_FLAG && (max_samples == 0 || n < max_samples)) {
+		set_mode(MODE_FAST);
+		run_instructions(ff);
+
+		set_mode(detailed);
+		run_instructions(warm);
+
+		c0 = CYCLE_COUNT;
+		i0 = INSTRUCTION_COUNT;
+		run_instructions(measure);
+		if (INSTRUCTION_COUNT == i0) {
+			break;
+		}
+		cpi = (double)(CYCLE_COUNT - c0) / (INSTRUCTION_COUNT - i0);
+		sum += cpi;
+		sumsq += cpi * cpi;
+		n++;
+	}
+	set_mode(saved_mode);
+
+	total = INSTRUCTION_COUNT - start_instructions;
+	mean = n > 0 ? sum / n : 0;
+	if (n > 1) {
+		sd = sqrt(fmax(0.0, (sumsq - n * mean * mean) / (n - 1)));
+		half = t_95(n - 1) * sd / sqrt(n);
+	}
+	SAMPLE.samples = n;
+	SAMPLE.covered = total;
+	SAMPLE.cpi = mean;
+	SAMPLE.sd = sd;
+	SAMPLE.half = half;
+	if (QUIET) {
+		return;
+	}
+
+	printf("-------------------------------------\n");
+	printf("Sampling Results\n");
+	printf("-------------------------------------\n");
+	printf("# Samples\t\t: %u\n", n);
+	printf("# Instructions Covered\t: %u\n", total);
+	if (n == 0) {
+		printf("-------------------------------------\n");
+		return;
 	}
-	printf("Simulation Finished.\n\n");
+	printf("Sampled CPI\t\t: %.4f +/- %.4f (95%% CI)\n", mean, half);
+	printf("CPI Std. Deviation\t: %.4f (CoV %.2f%%)\n", sd, mean > 0 ? 100.0 * sd / mean : 0.0);
+	printf("Extrapolated Cycles\t: %.0f [%.0f, %.0f]\n", mean * total, (mean - half) * total, (mean + half) * total);
+	printf("-------------------------------------\n");
 }
 
 /***************************************************************/ 
@@ -136,6 +311,38 @@ void rdump() {
 	printf("-------------------------------------\n");
 	printf("# Instructions Executed\t: %u\n", INSTRUCTION_COUNT);
 	printf("# Cycles Executed\t: %u\n", CYCLE_COUNT);
+	if (ESTIMATED_CYCLES > 0) {
+		printf("# Cycles Estimated\t: %u (fast mode)\n", ESTIMATED_CYCLES);
+	}
+	printf("# Stalls (forwarding %s)\t: load-use %u, data %u, control %u, I-cache %u, D-cache %u\n", FORWARDING ? "on" : "off",
+		STALL_LOAD_USE, STALL_DATA, STALL_CONTROL, STALL_ICACHE, STALL_DCACHE);
+	if (ISSUE_WIDTH > 1) {
+		printf("# Issue (%d-wide, %d memory ports)\t: IPC %.3f, held in group %u, structural %u, cycles issuing",
+			ISSUE_WIDTH, MEM_PORTS, CYCLE_COUNT > 0 ? (double)INSTRUCTION_COUNT / CYCLE_COUNT : 0.0,
+			STALL_GROUP, STALL_STRUCTURAL);
+		for (i = 0; i <= ISSUE_WIDTH; i++) {
+			printf(" %d: %u%s", i, ISSUE_GROUPS[i], i < ISSUE_WIDTH ? "," : "\n");
+		}
+	}
+	if (MULDIV[MULDIV_MULT].ops + MULDIV[MULDIV_DIV].ops > 0) {
+		printf("# Mult/div units\t: mult %u ops (latency %u, interval %u) %.2f%% busy, div %u ops (latency %u, interval %u) %.2f%% busy, HI/LO stalls %u\n",
+			MULDIV[MULDIV_MULT].ops, MULDIV[MULDIV_MULT].latency, MULDIV[MULDIV_MULT].interval,
+			CYCLE_COUNT > 0 ? 100.0 * MULDIV[MULDIV_MULT].busy / CYCLE_COUNT : 0.0,
+			MULDIV[MULDIV_DIV].ops, MULDIV[MULDIV_DIV].latency, MULDIV[MULDIV_DIV].interval,
+			CYCLE_COUNT > 0 ? 100.0 * MULDIV[MULDIV_DIV].busy / CYCLE_COUNT : 0.0, STALL_MULDIV);
+	}
+	if (BPRED_STATS.cond + BPRED_STATS.jumps > 0) {
+		printf("# Branches (%s)\t: %u, jumps %u, mispredicted %u (%.2f%% accuracy), penalty %u cycles\n",
+			BPRED_NAMES[BPRED_KIND], BPRED_STATS.cond, BPRED_STATS.jumps, BPRED_STATS.mispredicts,
+			100.0 * (BPRED_STATS.cond_correct + BPRED_STATS.jumps_correct) / (BPRED_STATS.cond + BPRED_STATS.jumps),
+			BPRED_STATS.penalty);
+	}
+	cache_print(&ICACHE, CYCLE_COUNT);
+	cache_print(&DCACHE, CYCLE_COUNT);
+	cache_print(&L2CACHE, CYCLE_COUNT);
+	dram_print(&DRAM, CYCLE_COUNT);
+	ooo_print();
+	syscall_print();
 	printf("PC\t: 0x%08x\n", CURRENT_STATE.PC);
 	printf("-------------------------------------\n");
 	printf("[Register]\t[Value]\n");
@@ -150,19 +357,248 @@ void rdump() {
 }
 
 /***************************************************************/
-/* Read a command from standard input.                                                               */  
+/* Write the run result as one JSON object: counters, and optionally    */
+/* the registers and memory ranges (start/stop pairs)                          */
+/***************************************************************/
+void print_json(FILE *fp, const uint32_t *ranges, int num_ranges, int regs) {
+	uint32_t address;
+	const char *c;
+	int i;
+
+	fprintf(fp, "{\n\t\"program\": \"");
+	for (c = prog_file; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fprintf(fp, "\\%c", *c);
+		}else if ((unsigned char)*c < 0x20) {
+			fprintf(fp, "\\u%04x", *c);
+		}else {
+			fputc(*c, fp);
+		}
+	}
+	fprintf(fp, "\",\n");
+	fprintf(fp, "\t\"mode\": \"%s\",\n", SIM_MODE == MODE_FAST ? "fast" : SIM_MODE == MODE_OOO ? "ooo" : "pipe");
+	fprintf(fp, "\t\"running\": %s,\n", RUN_FLAG ? "true" : "false");
+	fprintf(fp, "\t\"instructions\": %u,\n", INSTRUCTION_COUNT);
+	fprintf(fp, "\t\"cycles\": %u,\n", CYCLE_COUNT);
+	fprintf(fp, "\t\"estimated_cycles\": %u,\n", ESTIMATED_CYCLES);
+	fprintf(fp, "\t\"cpi\": %.4f,\n", INSTRUCTION_COUNT > 0 ? (double)CYCLE_COUNT / INSTRUCTION_COUNT : 0.0);
+	fprintf(fp, "\t\"forwarding\": %s,\n", FORWARDING ? "true" : "false");
+	fprintf(fp, "\t\"issue\": { \"width\": %d, \"mem_ports\": %d, \"ipc\": %.4f, \"groups\": [",
+		ISSUE_WIDTH, MEM_PORTS, CYCLE_COUNT > 0 ? (double)INSTRUCTION_COUNT / CYCLE_COUNT : 0.0);
+	for (i = 0; i <= ISSUE_WIDTH; i++) {
+		fprintf(fp, "%s%u", i > 0 ? ", " : "", ISSUE_GROUPS[i]);
+	}
+	fprintf(fp, "], \"held_group\": %u, \"held_structural\": %u },\n", STALL_GROUP, STALL_STRUCTURAL);
+	fprintf(fp, "\t\"muldiv\": {");
+	for (i = 0; i < MULDIV_UNITS; i++) {
+		fprintf(fp, " \"%s\": { \"latency\": %u, \"interval\": %u, \"ops\": %u, \"busy\": %u },",
+			MULDIV_NAMES[i], MULDIV[i].latency, MULDIV[i].interval, MULDIV[i].ops, MULDIV[i].busy);
+	}
+	fprintf(fp, " \"held\": %u },\n", STALL_MULDIV);
+	fprintf(fp, "\t\"stalls\": { \"load_use\": %u, \"data\": %u, \"control\": %u, \"icache\": %u, \"dcache\": %u },\n",
+		STALL_LOAD_USE, STALL_DATA, STALL_CONTROL, STALL_ICACHE, STALL_DCACHE);
+	fprintf(fp, "\t\"bpred\": { \"kind\": \"%s\", \"branches\": %u, \"branches_correct\": %u, \"jumps\": %u, \"jumps_correct\": %u, \"mispredicts\": %u, \"penalty\": %u },\n",
+		BPRED_NAMES[BPRED_KIND], BPRED_STATS.cond, BPRED_STATS.cond_correct, BPRED_STATS.jumps,
+		BPRED_STATS.jumps_correct, BPRED_STATS.mispredicts, BPRED_STATS.penalty);
+	fprintf(fp, "\t\"icache\": ");
+	cache_print_json(&ICACHE, fp);
+	fprintf(fp, ",\n\t\"dcache\": ");
+	cache_print_json(&DCACHE, fp);
+	fprintf(fp, ",\n\t\"l2\": ");
+	cache_print_json(&L2CACHE, fp);
+	fprintf(fp, ",\n\t\"dram\": ");
+	dram_print_json(&DRAM, fp);
+	fprintf(fp, ",\n\t\"ooo\": ");
+	ooo_print_json(fp);
+	fprintf(fp, ",\n\t\"syscall\": ");
+	syscall_print_json(fp);
+	if (SAMPLE.samples > 0) {
+		fprintf(fp, ",\n\t\"sample\": { \"samples\": %u, \"instructions\": %u, \"cpi\": %.4f, \"sd\": %.4f, "
+			"\"ci_low\": %.4f, \"ci_high\": %.4f, \"extrapolated_cycles\": %.0f }",
+			SAMPLE.samples, SAMPLE.covered, SAMPLE.cpi, SAMPLE.sd, SAMPLE.cpi - SAMPLE.half,
+			SAMPLE.cpi + SAMPLE.half, SAMPLE.cpi * SAMPLE.covered);
+	}else {
+		fprintf(fp, ",\n\t\"sample\": null");
+	}
+	fprintf(fp, ",\n");
+	stats_print_json(fp);
+	fprintf(fp, ",\n\t\"pc\": %u", CURRENT_STATE.PC);
+	if (regs) {
+		fprintf(fp, ",\n\t\"regs\": [");
+		for (i = 0; i < MIPS_REGS; i++) {
+			fprintf(fp, "%s%u", i > 0 ? ", " : "", CURRENT_STATE.REGS[i]);
+		}
+		fprintf(fp, "],\n\t\"hi\": %u,\n\t\"lo\": %u", CURRENT_STATE.HI, CURRENT_STATE.LO);
+	}
+	if (num_ranges > 0) {
+		fprintf(fp, ",\n\t\"mem\": [");
+		for (i = 0; i < num_ranges; i++) {
+			fprintf(fp, "%s\n\t\t{ \"start\": %u, \"stop\": %u, \"words\": [", i > 0 ? "," : "", ranges[2 * i], ranges[2 * i + 1]);
+			/* same inclusive word range as mdump */
+			for (address = ranges[2 * i]; address <= ranges[2 * i + 1] && address >= ranges[2 * i]; address += 4) {
+				fprintf(fp, "%s%u", address > ranges[2 * i] ? ", " : "", mem_read_32(address));
+			}
+			fprintf(fp, "] }");
+		}
+		fprintf(fp, "\n\t]");
+	}
+	fprintf(fp, "\n}\n");
+}
+
+/***************************************************************/
+/* Memory hierarchy configuration                                                             */
+/***************************************************************/
+static cache_t *lookup_cache(const char *which)
+{
+	if (strcasecmp(which, "i") == 0 || strcasecmp(which, "l1i") == 0) {
+		return &ICACHE;
+	}
+	if (strcasecmp(which, "d") == 0 || strcasecmp(which, "l1d") == 0) {
+		return &DCACHE;
+	}
+	if (strcasecmp(which, "l2") == 0) {
+		return &L2CACHE;
+	}
+	return NULL;
+}
+
+static int set_cache(cache_t *c, const char *size_arg, uint32_t assoc, uint32_t line, const char *policy,
+	const char *write, uint32_t hit, uint32_t miss, uint32_t mshrs)
+{
+	unsigned long size;
+	char *end;
+	int p;
+
+	/* size may carry a K suffix */
+	size = strtoul(size_arg, &end, 0);
+	if (*end == 'k' || *end == 'K') {
+		size *= 1024;
+	}
+	for (p = 0; p < CACHE_POLICIES && strcmp(policy, CACHE_POLICY_NAMES[p]) != 0; p++);
+	if (cache_configure(c, size, assoc, line, p, strcmp(write, "wb") == 0, hit, miss, mshrs) != 0 ||
+		(strcmp(write, "wb") != 0 && strcmp(write, "wt") != 0)) {
+		cache_disable(c);
+		printf("Invalid %s configuration (sizes are powers of two, assoc <= %d, hit >= 1, miss >= hit, mshrs <= %d)\n",
+			c->name, CACHE_MAX_ASSOC, CACHE_MAX_MSHRS);
+		return -1;
+	}
+	if (!QUIET) {
+		printf("%s: %u sets of %u x %uB lines, %s, %s.\n", c->name, c->sets, c->assoc, c->line,
+			CACHE_POLICY_NAMES[c->policy], c->write_back ? "write-back" : "write-through");
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* cache <i|d|l2> off | <size> <assoc> <line> <policy> <wb|wt> <hit> <miss> */
+/***************************************************************/
+static void configure_cache() {
+	char which[20], arg[20], policy[20], write[20];
+	uint32_t assoc, line, hit, miss;
+	cache_t *c;
+
+	if (fscanf(CMD_INPUT, "%19s %19s", which, arg) != 2) {
+		return;
+	}
+	if ((c = lookup_cache(which)) == NULL) {
+		printf("Unknown cache %s (use i, d or l2)\n", which);
+		return;
+	}
+	if (strcmp(arg, "off") == 0) {
+		cache_disable(c);
+		if (!QUIET) {
+			printf("%s disabled.\n\n", c->name);
+		}
+		return;
+	}
+	if (fscanf(CMD_INPUT, "%u %u %19s %19s %u %u", &assoc, &line, policy, write, &hit, &miss) != 6) {
+		return;
+	}
+	if (set_cache(c, arg, assoc, line, policy, write, hit, miss, 0) == 0 && !QUIET) {
+		printf("\n");
+	}
+}
+
+/***************************************************************/
+/* Configure the hierarchy from a file (format in mu-mips.h). Levels  */
+/* the file does not name are left alone. Returns -1 on any error.     */
+/***************************************************************/
+int load_memory_config(const char *file) {
+	char text[MEMCFG_LINE], which[20], arg[20], policy[20], write[20];
+	uint32_t assoc, line, hit, miss, mshrs, banks, row, empty, conflict;
+	FILE *fp = fopen(file, "r");
+	cache_t *c;
+	char *hash;
+	int n, lineno = 0, status = 0;
+
+	if (fp == NULL) {
+		error_report("Can't open memory configuration %s\n", file);
+		return -1;
+	}
+	while (fgets(text, sizeof(text), fp) != NULL) {
+		lineno++;
+		if ((hash = strchr(text, '#')) != NULL) {
+			*hash = '\0';
+		}
+		if (sscanf(text, "%19s", which) != 1) {
+			continue;
+		}
+		if (strcasecmp(which, "dram") == 0) {
+			if (sscanf(text, "%*s %u %u %u %u %u", &banks, &row, &hit, &empty, &conflict) != 5 ||
+				dram_configure(&DRAM, banks, row, hit, empty, conflict) != 0) {
+				error_report("%s:%d: expected dram <banks> <row bytes> <hit> <empty> <conflict> "
+					"(powers of two, rows >= 64B, hit <= empty <= conflict)\n", file, lineno);
+				status = -1;
+			}else if (!QUIET) {
+				printf("DRAM: %u banks of %uB rows, %u/%u/%u cycles.\n", DRAM.banks, DRAM.row,
+					DRAM.t_hit, DRAM.t_empty, DRAM.t_conflict);
+			}
+			continue;
+		}
+		if ((c = lookup_cache(which)) == NULL) {
+			error_report("%s:%d: unknown level %s\n", file, lineno, which);
+			status = -1;
+			continue;
+		}
+		mshrs = 0;
+		n = sscanf(text, "%*s %19s %u %u %19s %19s %u %u %u", arg, &assoc, &line, policy, write, &hit, &miss, &mshrs);
+		if (n == 1 && strcmp(arg, "off") == 0) {
+			cache_disable(c);
+		}else if (n < 7) {
+			error_report("%s:%d: expected %s <size> <assoc> <line> <policy> <wb|wt> <hit> <miss> [mshrs]\n",
+				file, lineno, which);
+			status = -1;
+		}else if (set_cache(c, arg, assoc, line, policy, write, hit, miss, mshrs) != 0) {
+			status = -1;
+		}
+	}
+	fclose(fp);
+	if (!QUIET) {
+		printf("\n");
+	}
+	return status;
+}
+
+/***************************************************************/
+/* Read and execute one command from CMD_INPUT. Returns FALSE on   */
+/* quit or end of input.                                                                                    */  
 /***************************************************************/
-void handle_command() {                         
+int handle_command() {                         
 	char buffer[20];
+	char path[256];
 	uint32_t start, stop, cycles;
 	uint32_t register_no;
+	uint32_t rob, rs, regs, lsq;
 	int register_value;
 	int hi_reg_value, lo_reg_value;
+	int i;
 
-	printf("MU-MIPS SIM:> ");
+	if (!QUIET) {
+		printf("MU-MIPS SIM:> ");
+	}
 
-	if (scanf("%s", buffer) == EOF){
-		exit(0);
+	if (fscanf(CMD_INPUT, "%19s", buffer) == EOF){
+		return FALSE;
 	}
 
 	switch(buffer[0]) {
@@ -170,13 +606,66 @@ void handle_command() {
 		case 's':
 			if (buffer[1] == 'h' || buffer[1] == 'H'){
 				show_pipeline();
+			}else if (buffer[1] == 't' || buffer[1] == 'T'){
+				stats_print();
+			}else if (buffer[1] == 'a' || buffer[1] == 'A'){
+				uint32_t ff, warm, measure, samples;
+				if (fscanf(CMD_INPUT, "%u %u %u %u", &ff, &warm, &measure, &samples) != 4) {
+					break;
+				}
+				sample(ff, warm, measure, samples);
 			}else {
 				runAll(); 
 			}
 			break;
 		case 'M':
 		case 'm':
-			if (scanf("%x %x", &start, &stop) != 2){
+			if (buffer[1] == 'e' || buffer[1] == 'E'){
+				if (fscanf(CMD_INPUT, "%255s", path) == 1) {
+					load_memory_config(path);
+				}
+				break;
+			}
+			if (buffer[1] == 'u' || buffer[1] == 'U'){
+				if (fscanf(CMD_INPUT, "%19s %u %u", buffer, &start, &stop) != 3) {
+					break;
+				}
+				for (i = 0; i < MULDIV_UNITS && strcmp(buffer, MULDIV_NAMES[i]) != 0; i++) {
+				}
+				if (i == MULDIV_UNITS) {
+					printf("Unknown unit %s (use mult or div)\n", buffer);
+					break;
+				}
+				if (start < 1 || start > MULDIV_MAX_LATENCY || stop < 1 || stop > start) {
+					printf("Bad latency %u with interval %u (use 1 to %d, interval at most the latency)\n", start, stop, MULDIV_MAX_LATENCY);
+					break;
+				}
+				set_muldiv(i, start, stop);
+				if (!QUIET) {
+					printf("The %s unit has latency %u, interval %u.\n\n", MULDIV_NAMES[i], start, stop);
+				}
+				break;
+			}
+			if (buffer[1] == 'o' || buffer[1] == 'O'){
+				if (fscanf(CMD_INPUT, "%19s", buffer) != 1) {
+					break;
+				}
+				if (strcmp(buffer, "fast") == 0) {
+					set_mode(MODE_FAST);
+				}else if (strcmp(buffer, "pipe") == 0) {
+					set_mode(MODE_PIPELINE);
+				}else if (strcmp(buffer, "ooo") == 0) {
+					set_mode(MODE_OOO);
+				}else {
+					printf("Unknown mode %s (use pipe, fast or ooo)\n", buffer);
+					break;
+				}
+				if (!QUIET) {
+					printf("Simulating in %s mode.\n\n", buffer);
+				}
+				break;
+			}
+			if (fscanf(CMD_INPUT, "%x %x", &start, &stop) != 2){
 				break;
 			}
 			mdump(start, stop);
@@ -186,19 +675,26 @@ void handle_command() {
 			break;
 		case 'Q':
 		case 'q':
-			printf("**************************\n");
-			printf("Exiting MU-MIPS! Good Bye...\n");
-			printf("**************************\n");
-			exit(0);
+			if (!QUIET) {
+				printf("**************************\n");
+				printf("Exiting MU-MIPS! Good Bye...\n");
+				printf("**************************\n");
+			}
+			return FALSE;
 		case 'R':
 		case 'r':
 			if (buffer[1] == 'd' || buffer[1] == 'D'){
 				rdump();
+			}else if((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[3] == 't' || buffer[3] == 'T')){
+				if (fscanf(CMD_INPUT, "%255s", path) != 1) {
+					break;
+				}
+				restore(path);
 			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
 				reset();
 			}
 			else {
-				if (scanf("%d", &cycles) != 1) {
+				if (fscanf(CMD_INPUT, "%d", &cycles) != 1) {
 					break;
 				}
 				run(cycles);
@@ -206,7 +702,11 @@ void handle_command() {
 			break;
 		case 'I':
 		case 'i':
-			if (scanf("%u %i", &register_no, &register_value) != 2){
+			if (fscanf(CMD_INPUT, "%u %i", &register_no, &register_value) != 2){
+				break;
+			}
+			if (register_no >= MIPS_REGS) {
+				error_report("No register %u (0-%d)\n", register_no, MIPS_REGS - 1);
 				break;
 			}
 			CURRENT_STATE.REGS[register_no] = register_value;
@@ -214,7 +714,7 @@ void handle_command() {
 			break;
 		case 'H':
 		case 'h':
-			if (scanf("%i", &hi_reg_value) != 1){
+			if (fscanf(CMD_INPUT, "%i", &hi_reg_value) != 1){
 				break;
 			}
 			CURRENT_STATE.HI = hi_reg_value; 
@@ -222,7 +722,7 @@ void handle_command() {
 			break;
 		case 'L':
 		case 'l':
-			if (scanf("%i", &lo_reg_value) != 1){
+			if (fscanf(CMD_INPUT, "%i", &lo_reg_value) != 1){
 				break;
 			}
 			CURRENT_STATE.LO = lo_reg_value;
@@ -232,17 +732,169 @@ void handle_command() {
 		case 'p':
 			print_program(); 
 			break;
+		case 'B':
+		case 'b':
+			if (fscanf(CMD_INPUT, "%19s", buffer) != 1) {
+				break;
+			}
+			if (bpred_lookup_kind(buffer) < 0) {
+				printf("Unknown predictor %s (use nottaken, bimodal, gshare, tournament or btb)\n", buffer);
+				break;
+			}
+			bpred_init(bpred_lookup_kind(buffer));
+			if (!QUIET) {
+				printf("Predicting branches with %s.\n\n", buffer);
+			}
+			break;
+		case 'T':
+		case 't':
+			if (buffer[1] == 'i' || buffer[1] == 'I'){
+				if (fscanf(CMD_INPUT, "%255s", path) != 1) {
+					break;
+				}
+				if (strcmp(path, "dump") == 0) {
+					if (fscanf(CMD_INPUT, "%255s", path) == 1 && timeline_dump(path) == 0 && !QUIET) {
+						printf("Wrote %u cycles to %s.\n\n", timeline_cycles(), path);
+					}
+					break;
+				}
+				timeline_enable(strtoul(path, NULL, 0));
+				if (!QUIET) {
+					printf("Timeline %s.\n\n", TIMELINE_ON ? "recording" : "off");
+				}
+				break;
+			}
+			if (fscanf(CMD_INPUT, "%255s", path) != 1) {
+				break;
+			}
+			if (strcmp(path, "off") == 0) {
+				trace_close();
+				if (!QUIET) {
+					printf("Tracing off.\n\n");
+				}
+			}else if (trace_open(path) == 0 && !QUIET) {
+				printf("Tracing retired instructions to %s.\n\n", path);
+			}
+			break;
+		case 'F':
+		case 'f':
+			if (fscanf(CMD_INPUT, "%19s", buffer) != 1) {
+				break;
+			}
+			if (strcmp(buffer, "on") == 0) {
+				FORWARDING = TRUE;
+			}else if (strcmp(buffer, "off") == 0) {
+				FORWARDING = FALSE;
+			}else {
+				printf("Unknown setting %s (use on or off)\n", buffer);
+				break;
+			}
+			if (!QUIET) {
+				printf("Forwarding %s.\n\n", buffer);
+			}
+			break;
+		case 'W':
+		case 'w':
+			if (fscanf(CMD_INPUT, "%u %u", &start, &stop) != 2) {
+				break;
+			}
+			if (start < 1 || start > ISSUE_WIDTH_MAX || stop < 1 || stop > start) {
+				printf("Bad width %u with %u memory ports (use 1 to %d, ports at most the width)\n", start, stop, ISSUE_WIDTH_MAX);
+				break;
+			}
+			set_width(start, stop);
+			if (!QUIET) {
+				printf("Issuing up to %u instructions a cycle, %u loads/stores.\n\n", start, stop);
+			}
+			break;
+		case 'O':
+		case 'o':
+			if (fscanf(CMD_INPUT, "%u %u %u %u %19s", &rob, &rs, &regs, &lsq, buffer) != 5) {
+				break;
+			}
+			if (strcmp(buffer, "unified") != 0 && strcmp(buffer, "split") != 0) {
+				printf("Unknown stations %s (use unified or split)\n", buffer);
+				break;
+			}
+			if (set_ooo(rob, rs, regs, lsq, strcmp(buffer, "split") == 0) == 0 && !QUIET) {
+				printf("Out-of-order core: ROB %u, %u %s stations, %u registers, LSQ %u.\n\n", rob, rs, buffer, regs, lsq);
+			}
+			break;
+		case 'J':
+		case 'j':
+			if (fscanf(CMD_INPUT, "%19s", buffer) != 1) {
+				break;
+			}
+			if (strcmp(buffer, "on") == 0) {
+				JIT_ON = TRUE;
+			}else if (strcmp(buffer, "off") == 0) {
+				JIT_ON = FALSE;
+			}else {
+				printf("Unknown setting %s (use on or off)\n", buffer);
+				break;
+			}
+			if (!QUIET) {
+				printf("Translation %s.\n\n", buffer);
+			}
+			break;
+		case 'C':
+		case 'c':
+			if (buffer[1] == 'h' || buffer[1] == 'H'){
+				if (fscanf(CMD_INPUT, "%255s", path) != 1) {
+					break;
+				}
+				checkpoint(path);
+				break;
+			}
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				configure_cache();
+				break;
+			}
+			if (fscanf(CMD_INPUT, "%19s", buffer) != 1) {
+				break;
+			}
+			if (strcmp(buffer, "switch") == 0) {
+				EXEC_CORE = CORE_SWITCH;
+			}else if (strcmp(buffer, "threaded") == 0) {
+				EXEC_CORE = CORE_THREADED;
+			}else {
+				printf("Unknown core %s (use switch or threaded)\n", buffer);
+				break;
+			}
+			if (!QUIET) {
+				printf("Using the %s core.\n\n", buffer);
+			}
+			break;
 		default:
 			printf("Invalid Command.\n");
 			break;
 	}
+	return TRUE;
 }
 
 /***************************************************************/
-/* reset registers/memory and reload program                                                    */
+/* Execute every command in a script file                                                         */
 /***************************************************************/
-void reset() {   
-	int i;
+int run_script(const char *file) {
+	FILE *fp = fopen(file, "r");
+
+	if (fp == NULL) {
+		error_report("Can't open script file %s\n", file);
+		return -1;
+	}
+	CMD_INPUT = fp;
+	while (handle_command());
+	CMD_INPUT = stdin;
+	fclose(fp);
+	return 0;
+}
+
+/***************************************************************/
+/* reset registers/memory and reload program; -1 if the program can't */
+/* be loaded, which leaves the simulator stopped                                       */
+/***************************************************************/
+int reset() {   
+	int i, status;
 	/*reset registers*/
 	for (i = 0; i < MIPS_REGS; i++){
 		CURRENT_STATE.REGS[i] = 0;
@@ -250,60 +902,442 @@ void reset() {
 	CURRENT_STATE.HI = 0;
 	CURRENT_STATE.LO = 0;
 	
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
-	}
+	/*only pages the program touched need clearing*/
+	mem_clear_dirty();
 	
-	/*load program*/
-	load_program();
+	/*load program; if it can't be, nothing runs*/
+	status = load_program();
 	
 	/*reset PC*/
 	INSTRUCTION_COUNT = 0;
-	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
+	CYCLE_COUNT = 0;
+	ESTIMATED_CYCLES = 0;
+	FAST_LOAD_DEST = 0;
+	STALL_LOAD_USE = 0;
+	STALL_DATA = 0;
+	STALL_CONTROL = 0;
+	STALL_GROUP = 0;
+	STALL_STRUCTURAL = 0;
+	memset(ISSUE_GROUPS, 0, sizeof(ISSUE_GROUPS));
+	memset(&SAMPLE, 0, sizeof(SAMPLE));
+	for (i = 0; i < MULDIV_UNITS; i++) {
+		MULDIV[i].free = 0;
+		MULDIV[i].ops = 0;
+		MULDIV[i].busy = 0;
+	}
+	HILO_READY = 0;
+	STALL_MULDIV = 0;
+	bpred_init(BPRED_KIND);
+	cache_flush(&ICACHE);
+	cache_flush(&DCACHE);
+	cache_flush(&L2CACHE);
+	dram_flush(&DRAM);
+	PIPELINE_FREEZE = 0;
+	STALL_ICACHE = 0;
+	STALL_DCACHE = 0;
+	FETCH_SEQ = 0;
+	timeline_clear();
+	stats_reset();
+	ooo_reset_stats();
+	pipeline_clear();
+	CURRENT_STATE.PC = PROGRAM_ENTRY;
 	NEXT_STATE = CURRENT_STATE;
-	RUN_FLAG = TRUE;
+	if (SIM_MODE == MODE_OOO) {
+		ooo_start();
+	}
+	RUN_FLAG = status == 0;
+	return status;
+}
+
+/**************************************************************/
+/* load program into memory; -1 with a message printed if it can't be  */
+/**************************************************************/
+int load_program() {                   
+	load_image_t image;
+	int status;
+
+	if (SIM->prog_data != NULL) {
+		status = load_image_buffer(prog_file, SIM->prog_data, SIM->prog_size, &image, VERBOSE);
+	}else {
+		status = load_image(prog_file, &image, VERBOSE);
+	}
+	if (status != 0) {
+		return -1;
+	}
+	PROGRAM_BASE = image.text_base;
+	PROGRAM_SIZE = image.text_words;
+	PROGRAM_ENTRY = image.entry;
+	DECODE_BRANCH_BIAS = image.format == LOAD_ELF ? 4 : 0;
+	decode_program(PROGRAM_BASE, PROGRAM_SIZE);
+	stats_profile(PROGRAM_BASE, PROGRAM_SIZE);
+	if (image.format == LOAD_ELF) {
+		/* linked programs expect a stack; same initial $sp as SPIM */
+		CURRENT_STATE.REGS[29] = LOAD_STACK_POINTER;
+	}
+	syscall_start(image.end);
+	CURRENT_STATE.PC = PROGRAM_ENTRY;
+	NEXT_STATE = CURRENT_STATE;
+	if (!QUIET) {
+		printf("Program loaded into memory (%s).\n%d words written into memory.\n\n", LOAD_FORMAT_NAMES[image.format], (image.bytes + 3) / 4);
+	}
+	return 0;
 }
 
 /***************************************************************/
-/* Allocate and set memory to zero                                                                            */
+/* Checkpoint helpers: CPU states and pipeline latches                          */
 /***************************************************************/
-void init_memory() {                                           
+static void ckpt_put_state(FILE *fp, const CPU_State *state)
+{
 	int i;
-	for (i = 0; i < NUM_MEM_REGION; i++) {
-		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		MEM_REGIONS[i].mem = malloc(region_size);
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+	ckpt_put(fp, state->PC);
+	for (i = 0; i < MIPS_REGS; i++) {
+		ckpt_put(fp, state->REGS[i]);
 	}
+	ckpt_put(fp, state->HI);
+	ckpt_put(fp, state->LO);
 }
 
-/**************************************************************/
-/* load program into memory                                                                                      */
-/**************************************************************/
-void load_program() {                   
-	FILE * fp;
-	int i, word;
-	uint32_t address;
+static void ckpt_get_state(FILE *fp, CPU_State *state, int *ok)
+{
+	int i;
+	state->PC = ckpt_get(fp, ok);
+	for (i = 0; i < MIPS_REGS; i++) {
+		state->REGS[i] = ckpt_get(fp, ok);
+	}
+	state->HI = ckpt_get(fp, ok);
+	state->LO = ckpt_get(fp, ok);
+}
+
+/* latches hold a pointer into the decode cache, so only the IR is saved */
+static void ckpt_put_latch(FILE *fp, const CPU_Pipeline_Reg *reg)
+{
+	ckpt_put(fp, reg->PC);
+	ckpt_put(fp, (reg->inst->flags & DEC_BUBBLE) != 0);
+	ckpt_put(fp, reg->inst->IR);
+	ckpt_put(fp, reg->pred_PC);
+	ckpt_put(fp, reg->seq);
+	ckpt_put(fp, reg->A);
+	ckpt_put(fp, reg->B);
+	ckpt_put(fp, reg->imm);
+	ckpt_put(fp, reg->ALUOutput);
+	ckpt_put(fp, reg->LMD);
+}
 
-	/* Open program file. */
-	fp = fopen(prog_file, "r");
+static void ckpt_get_latch(FILE *fp, CPU_Pipeline_Reg *reg, uint32_t *bubble, uint32_t *ir, int *ok)
+{
+	reg->PC = ckpt_get(fp, ok);
+	*bubble = ckpt_get(fp, ok);
+	*ir = ckpt_get(fp, ok);
+	reg->pred_PC = ckpt_get(fp, ok);
+	reg->seq = ckpt_get(fp, ok);
+	reg->A = ckpt_get(fp, ok);
+	reg->B = ckpt_get(fp, ok);
+	reg->imm = ckpt_get(fp, ok);
+	reg->ALUOutput = ckpt_get(fp, ok);
+	reg->LMD = ckpt_get(fp, ok);
+}
+
+/***************************************************************/
+/* The counters and settings a checkpoint holds. ckpt_counters() is the */
+/* one place their order in the file is written down; checkpoint() and  */
+/* restore() both go through it.                                                             */
+/***************************************************************/
+typedef struct {
+	uint32_t run_flag, instruction_count, cycle_count, estimated_cycles;
+	uint32_t program_size, program_base, program_entry;
+	uint32_t sim_mode, exec_core, fast_load_dest, forwarding;
+	uint32_t stall_load_use, stall_data, stall_control;
+	uint32_t pipeline_freeze, stall_icache, stall_dcache, fetch_seq;
+	uint32_t issue_width, mem_ports, stall_group, stall_structural;
+	uint32_t issue_groups[ISSUE_WIDTH_MAX + 1];
+	muldiv_unit_t muldiv[MULDIV_UNITS];
+	uint32_t hilo_ready, stall_muldiv;
+	uint32_t branch_bias;
+} ckpt_counters_t;
+
+static void ckpt_word(FILE *fp, uint32_t *value, int save, int *ok)
+{
+	if (save) {
+		ckpt_put(fp, *value);
+	}else {
+		*value = ckpt_get(fp, ok);
+	}
+}
+
+static void ckpt_counters(FILE *fp, ckpt_counters_t *c, int save, int *ok)
+{
+	int i;
+	ckpt_word(fp, &c->run_flag, save, ok);
+	ckpt_word(fp, &c->instruction_count, save, ok);
+	ckpt_word(fp, &c->cycle_count, save, ok);
+	ckpt_word(fp, &c->estimated_cycles, save, ok);
+	ckpt_word(fp, &c->program_size, save, ok);
+	ckpt_word(fp, &c->program_base, save, ok);
+	ckpt_word(fp, &c->program_entry, save, ok);
+	ckpt_word(fp, &c->sim_mode, save, ok);
+	ckpt_word(fp, &c->exec_core, save, ok);
+	ckpt_word(fp, &c->fast_load_dest, save, ok);
+	ckpt_word(fp, &c->forwarding, save, ok);
+	ckpt_word(fp, &c->stall_load_use, save, ok);
+	ckpt_word(fp, &c->stall_data, save, ok);
+	ckpt_word(fp, &c->stall_control, save, ok);
+	ckpt_word(fp, &c->pipeline_freeze, save, ok);
+	ckpt_word(fp, &c->stall_icache, save, ok);
+	ckpt_word(fp, &c->stall_dcache, save, ok);
+	ckpt_word(fp, &c->fetch_seq, save, ok);
+	ckpt_word(fp, &c->issue_width, save, ok);
+	ckpt_word(fp, &c->mem_ports, save, ok);
+	ckpt_word(fp, &c->stall_group, save, ok);
+	ckpt_word(fp, &c->stall_structural, save, ok);
+	for (i = 0; i <= ISSUE_WIDTH_MAX; i++) {
+		ckpt_word(fp, &c->issue_groups[i], save, ok);
+	}
+	for (i = 0; i < MULDIV_UNITS; i++) {
+		ckpt_word(fp, &c->muldiv[i].latency, save, ok);
+		ckpt_word(fp, &c->muldiv[i].interval, save, ok);
+		ckpt_word(fp, &c->muldiv[i].free, save, ok);
+		ckpt_word(fp, &c->muldiv[i].ops, save, ok);
+		ckpt_word(fp, &c->muldiv[i].busy, save, ok);
+	}
+	ckpt_word(fp, &c->hilo_ready, save, ok);
+	ckpt_word(fp, &c->stall_muldiv, save, ok);
+	ckpt_word(fp, &c->branch_bias, save, ok);
+}
+
+static void ckpt_take_counters(ckpt_counters_t *c)
+{
+	c->run_flag = RUN_FLAG;
+	c->instruction_count = INSTRUCTION_COUNT;
+	c->cycle_count = CYCLE_COUNT;
+	c->estimated_cycles = ESTIMATED_CYCLES;
+	c->program_size = PROGRAM_SIZE;
+	c->program_base = PROGRAM_BASE;
+	c->program_entry = PROGRAM_ENTRY;
+	c->sim_mode = SIM_MODE;
+	c->exec_core = EXEC_CORE;
+	c->fast_load_dest = FAST_LOAD_DEST;
+	c->forwarding = FORWARDING;
+	c->stall_load_use = STALL_LOAD_USE;
+	c->stall_data = STALL_DATA;
+	c->stall_control = STALL_CONTROL;
+	c->pipeline_freeze = PIPELINE_FREEZE;
+	c->stall_icache = STALL_ICACHE;
+	c->stall_dcache = STALL_DCACHE;
+	c->fetch_seq = FETCH_SEQ;
+	c->issue_width = ISSUE_WIDTH;
+	c->mem_ports = MEM_PORTS;
+	c->stall_group = STALL_GROUP;
+	c->stall_structural = STALL_STRUCTURAL;
+	memcpy(c->issue_groups, ISSUE_GROUPS, sizeof(c->issue_groups));
+	memcpy(c->muldiv, MULDIV, sizeof(c->muldiv));
+	c->hilo_ready = HILO_READY;
+	c->stall_muldiv = STALL_MULDIV;
+	c->branch_bias = DECODE_BRANCH_BIAS;
+}
+
+static void ckpt_give_counters(const ckpt_counters_t *c)
+{
+	RUN_FLAG = c->run_flag;
+	INSTRUCTION_COUNT = c->instruction_count;
+	CYCLE_COUNT = c->cycle_count;
+	ESTIMATED_CYCLES = c->estimated_cycles;
+	PROGRAM_SIZE = c->program_size;
+	PROGRAM_BASE = c->program_base;
+	PROGRAM_ENTRY = c->program_entry;
+	SIM_MODE = c->sim_mode;
+	EXEC_CORE = c->exec_core;
+	FAST_LOAD_DEST = c->fast_load_dest;
+	FORWARDING = c->forwarding;
+	STALL_LOAD_USE = c->stall_load_use;
+	STALL_DATA = c->stall_data;
+	STALL_CONTROL = c->stall_control;
+	PIPELINE_FREEZE = c->pipeline_freeze;
+	STALL_ICACHE = c->stall_icache;
+	STALL_DCACHE = c->stall_dcache;
+	FETCH_SEQ = c->fetch_seq;
+	ISSUE_WIDTH = c->issue_width;
+	MEM_PORTS = c->mem_ports;
+	STALL_GROUP = c->stall_group;
+	STALL_STRUCTURAL = c->stall_structural;
+	memcpy(ISSUE_GROUPS, c->issue_groups, sizeof(c->issue_groups));
+	memcpy(MULDIV, c->muldiv, sizeof(c->muldiv));
+	HILO_READY = c->hilo_ready;
+	STALL_MULDIV = c->stall_muldiv;
+	DECODE_BRANCH_BIAS = c->branch_bias;
+}
+
+/***************************************************************/
+/* Save the complete simulator state to file                                                  */
+/***************************************************************/
+int checkpoint(const char *file)
+{
+	FILE *fp;
+	ckpt_counters_t counters;
+	int i, pages, failed, ok = TRUE;
+	long size;
+
+	fp = fopen(file, "wb");
 	if (fp == NULL) {
-		printf("Error: Can't open program file %s\n", prog_file);
-		exit(-1);
+		error_report("Can't create checkpoint file %s\n", file);
+		return -1;
+	}
+	setvbuf(fp, NULL, _IOFBF, CKPT_BUFFER);
+	drain_ooo();
+
+	ckpt_put(fp, CKPT_MAGIC);
+	ckpt_put(fp, CKPT_VERSION);
+	ckpt_put_state(fp, &CURRENT_STATE);
+	ckpt_put_state(fp, &NEXT_STATE);
+	for (i = 0; i < ISSUE_WIDTH_MAX; i++) {
+		ckpt_put_latch(fp, &IF_ID[i]);
+		ckpt_put_latch(fp, &ID_EX[i]);
+		ckpt_put_latch(fp, &EX_MEM[i]);
+		ckpt_put_latch(fp, &MEM_WB[i]);
+	}
+	ckpt_take_counters(&counters);
+	ckpt_counters(fp, &counters, TRUE, &ok);
+	fwrite(prog_file, sizeof(prog_file), 1, fp);
+
+	pages = mem_save_pages(fp);
+	bpred_save(fp);
+	cache_save(&ICACHE, fp);
+	cache_save(&DCACHE, fp);
+	cache_save(&L2CACHE, fp);
+	dram_save(&DRAM, fp);
+	stats_save(fp);
+	ooo_save(fp);
+	syscall_save(fp);
+	size = ftell(fp);
+	/* a write that failed part way only shows in the stream's error flag */
+	failed = ferror(fp) != 0 || pages < 0;
+	if (fclose(fp) != 0 || failed) {
+		error_report("Failed writing checkpoint file %s\n", file);
+		return -1;
 	}
+	if (!QUIET) {
+		printf("Checkpoint written to %s: %d pages, %ld bytes.\n\n", file, pages, size);
+	}
+	return 0;
+}
 
-	/* Read in the program. */
+/***************************************************************/
+/* Replace the simulator state with a checkpoint                                             */
+/***************************************************************/
+int restore(const char *file)
+{
+	FILE *fp;
+	CPU_State current, next;
+	CPU_Pipeline_Reg *reg, *latches[4] = { IF_ID, ID_EX, EX_MEM, MEM_WB };
+	CPU_Pipeline_Reg saved[4 * ISSUE_WIDTH_MAX];
+	uint32_t bubble[4 * ISSUE_WIDTH_MAX], ir[4 * ISSUE_WIDTH_MAX];
+	ckpt_counters_t counters;
+	char name[sizeof(prog_file)];
+	int i, pages, ok = TRUE;
+
+	fp = fopen(file, "rb");
+	if (fp == NULL) {
+		error_report("Can't open checkpoint file %s\n", file);
+		return -1;
+	}
+	setvbuf(fp, NULL, _IOFBF, CKPT_BUFFER);
+
+	if (ckpt_get(fp, &ok) != CKPT_MAGIC || ckpt_get(fp, &ok) != CKPT_VERSION || !ok) {
+		error_report("%s is not a version %d checkpoint\n", file, CKPT_VERSION);
+		fclose(fp);
+		return -1;
+	}
+	ckpt_get_state(fp, &current, &ok);
+	ckpt_get_state(fp, &next, &ok);
+	for (i = 0; i < 4 * ISSUE_WIDTH_MAX; i++) {
+		ckpt_get_latch(fp, &saved[i], &bubble[i], &ir[i], &ok);
+	}
+	ckpt_counters(fp, &counters, FALSE, &ok);
+	if (ok && (counters.issue_width < 1 || counters.issue_width > ISSUE_WIDTH_MAX ||
+		counters.mem_ports < 1 || counters.mem_ports > counters.issue_width)) {
+		error_report("Checkpoint file %s has a bad issue width\n", file);
+		fclose(fp);
+		return -1;
+	}
+	if (ok && (counters.sim_mode > MODE_OOO || counters.exec_core > CORE_THREADED || counters.fast_load_dest >= MIPS_REGS)) {
+		error_report("Checkpoint file %s has a bad mode, core or load register\n", file);
+		fclose(fp);
+		return -1;
+	}
+	if (ok && counters.branch_bias != 0 && counters.branch_bias != 4) {
+		error_report("Checkpoint file %s has a bad branch rule\n", file);
+		fclose(fp);
+		return -1;
+	}
+	for (i = 0; i < MULDIV_UNITS; i++) {
+		if (ok && (counters.muldiv[i].latency < 1 || counters.muldiv[i].latency > MULDIV_MAX_LATENCY ||
+			counters.muldiv[i].interval < 1 || counters.muldiv[i].interval > counters.muldiv[i].latency)) {
+			error_report("Checkpoint file %s has a bad mult/div unit\n", file);
+			fclose(fp);
+			return -1;
+		}
+	}
+	if (fread(name, sizeof(name), 1, fp) != 1) {
+		ok = FALSE;
+	}
+	if (!ok) {
+		error_report("Checkpoint file %s is truncated\n", file);
+		fclose(fp);
+		return -1;
+	}
 
-	i = 0;
-	while( fscanf(fp, "%x\n", &word) != EOF ) {
-		address = MEM_TEXT_BEGIN + i;
-		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-		i += 4;
+	/* nothing has been touched until here; a bad page stream, predictor
+	 * or cache leaves them half replaced, so fall back to a clean reset */
+	pages = mem_load_pages(fp);
+	if (pages >= 0 && (bpred_load(fp) != 0 || cache_load(&ICACHE, fp) != 0 || cache_load(&DCACHE, fp) != 0 ||
+		cache_load(&L2CACHE, fp) != 0 || dram_load(&DRAM, fp) != 0 || stats_load(fp) != 0 || ooo_load(fp) != 0 ||
+		syscall_load(fp) != 0)) {
+		pages = -1;
 	}
-	PROGRAM_SIZE = i/4;
-	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
 	fclose(fp);
+	if (pages < 0) {
+		error_report("Checkpoint file %s is truncated, resetting\n", file);
+		reset();
+		return -1;
+	}
+
+	name[sizeof(name) - 1] = '\0';
+	if (SIM->prog_data != NULL && strcmp(name, prog_file) != 0) {
+		/* another program's checkpoint: reset reloads it from its file */
+		free(SIM->prog_data);
+		SIM->prog_data = NULL;
+		SIM->prog_size = 0;
+	}
+	memcpy(prog_file, name, sizeof(prog_file));
+	CURRENT_STATE = current;
+	NEXT_STATE = next;
+	ckpt_give_counters(&counters);
+	timeline_clear();
+	BRANCH_FLUSH = FALSE;
+	PIPELINE_DRAINING = FALSE;
+
+	/* text may have been modified, so decode from the restored image */
+	decode_program(PROGRAM_BASE, PROGRAM_SIZE);
+	for (i = 0; i < 4 * ISSUE_WIDTH_MAX; i++) {
+		/* saved slot by slot, IF/ID to MEM/WB */
+		reg = &latches[i % 4][i / 4];
+		*reg = saved[i];
+		if (bubble[i]) {
+			reg->inst = &DECODE_BUBBLE;
+			continue;
+		}
+		reg->inst = decode_fetch(saved[i].PC);
+		if (reg->inst->IR != ir[i]) {
+			/* fetched before a later store rewrote its word */
+			reg->inst = decode_scratch(ir[i]);
+		}
+	}
+	if (SIM_MODE == MODE_OOO) {
+		ooo_start();
+	}
+	if (!QUIET) {
+		printf("Restored %s: %d pages, %u instructions, %u cycles.\n\n", file, pages, INSTRUCTION_COUNT, CYCLE_COUNT);
+	}
+	return 0;
 }
 
 /************************************************************/
@@ -311,9 +1345,10 @@ void load_program() {
 /************************************************************/
 void handle_pipeline()
 {
-	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
-	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+	/*INSTRUCTION_COUNT is incremented in WB stage, when an instruction is done*/
 	
+	BRANCH_FLUSH = FALSE;
+	PIPELINE_STALL = FALSE;
 	WB();
 	MEM();
 	EX();
@@ -321,531 +1356,676 @@ void handle_pipeline()
 	IF();
 }
 
+/************************************************************/
+/* Return TRUE when no instruction is in flight                                                */ 
+/************************************************************/
+int pipeline_empty()
+{
+	int i;
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		if (!(IF_ID[i].inst->flags & ID_EX[i].inst->flags & EX_MEM[i].inst->flags & MEM_WB[i].inst->flags & DEC_BUBBLE)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/************************************************************/
+/* Turn a pipeline register into a bubble                                                           */ 
+/************************************************************/
+void pipeline_bubble(CPU_Pipeline_Reg *reg)
+{
+	memset(reg, 0, sizeof(*reg));
+	reg->inst = &DECODE_BUBBLE;
+}
+
+/************************************************************/
+/* Empty every slot of all four pipeline registers                                       */ 
+/************************************************************/
+void pipeline_clear()
+{
+	int i;
+	for (i = 0; i < ISSUE_WIDTH_MAX; i++) {
+		pipeline_bubble(&IF_ID[i]);
+		pipeline_bubble(&ID_EX[i]);
+		pipeline_bubble(&EX_MEM[i]);
+		pipeline_bubble(&MEM_WB[i]);
+	}
+}
+
+/************************************************************/
+/* Record a retiring instruction in the trace                                                */ 
+/************************************************************/
+void trace_retire(const CPU_Pipeline_Reg *r, uint32_t cycle)
+{
+	const decoded_inst_t *inst = r->inst;
+	trace_record_t t;
+
+	t.cycle = cycle;
+	t.pc = r->PC;
+	t.ir = inst->IR;
+	t.flags = 0;
+	t.dest = inst->dest;
+	t.value = (inst->flags & DEC_LOAD) ? r->LMD : r->ALUOutput;
+	t.address = r->ALUOutput;
+	t.data = r->B;
+	if (inst->dest != 0) {
+		t.flags |= TRACE_DEST;
+	}
+	if (inst->flags & (DEC_LOAD | DEC_STORE)) {
+		t.flags |= TRACE_MEM;
+	}
+	if (inst->flags & DEC_STORE) {
+		t.flags |= TRACE_STORE;
+	}
+	trace_write(&t);
+}
+
 /************************************************************/
 /* writeback (WB) pipeline stage:                                                                          */ 
 /************************************************************/
 void WB()
 {
-        uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26;
-	uint32_t function = MEM_WB.IR & 0x0000003F;
-	uint32_t rs = (MEM_WB.IR & 0x03E00000) >> 21;
-	uint32_t rt = (MEM_WB.IR & 0x001F0000) >> 16;
-	uint32_t rd = (MEM_WB.IR & 0x0000F800) >> 11;
-	uint32_t sa = (MEM_WB.IR & 0x000007C0) >> 6;
-	uint32_t immediate = MEM_WB.IR & 0x0000FFFF;
-	uint32_t target = MEM_WB.IR & 0x03FFFFFF;
-	
-	if(opcode == 0x00){
-		switch(function){
-				case 0x00: //SLL
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				
-				break;
-
-			case 0x02: //SRL
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				
-				break;
-			case 0x03: //SRA 
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-				
-			case 0x0C: //SYSCALL
+	const decoded_inst_t *inst;
+	uint32_t generation;
+	int i;
 
-				break;
-			case 0x10: //MFHI
-				NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-		
-				break;
-			case 0x11: //MTHI
-				NEXT_STATE.HI = MEM_WB.ALUOutput;
-				
-				break;
-			case 0x12: //MFLO
-				EX_MEM.ALUOutput  = CURRENT_STATE.LO;
-				
-				break;
-			case 0x13: //MTLO
-				NEXT_STATE.LO = MEM_WB.ALUOutput;
-				
-				break;
-			case 0x18: //MULT
-				NEXT_STATE.HI = CURRENT_STATE.HI;
-				NEXT_STATE.LO = CURRENT_STATE.LO;
-				break;
-			case 0x19: //MULTU
-				NEXT_STATE.HI = CURRENT_STATE.HI;
-				NEXT_STATE.LO = CURRENT_STATE.LO;
-				
-				break;
-			case 0x1A: //DIV 
-				NEXT_STATE.HI = CURRENT_STATE.HI;
-				NEXT_STATE.LO = CURRENT_STATE.LO;
-				break;
-			case 0x1B: //DIVU
-				NEXT_STATE.HI = CURRENT_STATE.HI;
-				NEXT_STATE.LO = CURRENT_STATE.LO;
-				break;
-			case 0x20: //ADD
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-			
-				break;
-			case 0x21: //ADDU 
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				
-				break;
-			case 0x22: //SUB
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-			case 0x23: //SUBU
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-			case 0x24: //AND
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-			case 0x25: //OR
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-			case 0x26: //XOR
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				break;
-			case 0x27: //NOR
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				
-				break;
-			case 0x2A: //SLT
-				NEXT_STATE.REGS[rd] = MEM_WB.ALUOutput;
-				
-				break;
-			default:
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
-				break;
+	/* oldest first, so the youngest of two writes to a register wins */
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		inst = MEM_WB[i].inst;
+		WB_DEST[i] = 0;
+		if (inst->flags & DEC_BUBBLE) {
+			continue;
 		}
-	else{
-		switch(code){
-			case 0x08: //ADDI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			case 0x09: //ADDIU
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			case 0x0A: //SLTI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			case 0x0C: //ANDI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			case 0x0D: //ORI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-				break;
-			case 0x0E: //XORI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
-
-				break;
-			case 0x0F: //LUI
-				NEXT_STATE.REGS[rt] = MEM_WB.ALUOutput;
+		/* dest is rd, rt or $ra as decoded; SYSCALL, stores, branches and
+		 * HI/LO writers have none */
+		if (inst->dest != 0) {
+			WB_DEST[i] = inst->dest;
+			WB_VALUE[i] = (inst->flags & DEC_LOAD) ? MEM_WB[i].LMD : MEM_WB[i].ALUOutput;
+			NEXT_STATE.REGS[WB_DEST[i]] = WB_VALUE[i];
+		}
+		if (inst->op == OP_SYSCALL) {
+			/* ID has held everything younger; it reads the result next */
+			generation = DECODE_GENERATION;
+			syscall_run(MEM_WB[i].PC, NEXT_STATE.REGS);
+			if (!RUN_FLAG || DECODE_GENERATION != generation) {
+				/* the program exited, or read into its text: drop what IF
+				 * fetched behind it */
+				NEXT_STATE.PC = MEM_WB[i].PC + 4;
+				BRANCH_FLUSH = TRUE;
+			}
+		}
+		if (TRACE_ON) {
+			trace_retire(&MEM_WB[i], CYCLE_COUNT);
+		}
+		stats_retire(MEM_WB[i].PC, inst, MEM_WB[i].ALUOutput, CYCLE_COUNT + 1);
+		INSTRUCTION_COUNT++;
+	}
+}
 
-				break;
-			case 0x20: //LB
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-				break;
-			case 0x21: //LH
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
+/************************************************************/
+/* Charge a cache access: anything beyond one cycle freezes the       */
+/* pipeline. IF and MEM misses in the same cycle are serviced together. */
+/************************************************************/
+static void cache_stall(cache_t *c, uint32_t address, int write, uint32_t *counter)
+{
+	uint32_t stall = cache_access(c, address, write, CYCLE_COUNT) - 1;
+	/* a miss overlapping one already taken this cycle only adds what is left over */
+	if (stall > PIPELINE_FREEZE) {
+		*counter += stall - PIPELINE_FREEZE;
+		PIPELINE_FREEZE = stall;
+	}
+}
 
-				break;
-			case 0x23: //LW
-				NEXT_STATE.REGS[rt] = MEM_WB.LMD;
-				break;
-			case 0x28: //SB, don't do any thing
-				
-				break;
-			case 0x29: //SH, don't do any thing
-				
-				break;
-			case 0x2B: //SW, don't do any thing
-				
+/************************************************************/
+/* memory access (MEM) pipeline stage: one slot                                        */ 
+/************************************************************/
+static void mem_slot(CPU_Pipeline_Reg *r)
+{
+	const decoded_inst_t *inst = r->inst;
 
-				break;
-			default:
-				
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
-				break;	
-				
-				
-		}		
-				
+	r->LMD = 0;
+	if (!(inst->flags & (DEC_LOAD | DEC_STORE))) {
+		return;
+	}
+	if (DCACHE.enabled) {
+		cache_stall(&DCACHE, r->ALUOutput, inst->flags & DEC_STORE, &STALL_DCACHE);
+	}
+	if (EXEC_CORE == CORE_THREADED) {
+		inst->mem(r);
+		return;
+	}
+	switch (inst->opcode) {
+		case 0x20: //LB
+			r->LMD = (int32_t)(int8_t)mem_read_8(r->ALUOutput); //sign extend
+			break;
+		case 0x21: //LH
+			r->LMD = (int32_t)(int16_t)mem_read_16(r->ALUOutput); //sign extend
+			break;
+		case 0x23: //LW
+			r->LMD = mem_read_32(r->ALUOutput);
+			break;
+		case 0x28: //SB
+			mem_write_8(r->ALUOutput, r->B & 0xFF);
+			break;
+		case 0x29: //SH
+			mem_write_16(r->ALUOutput, r->B & 0xFFFF);
+			break;
+		case 0x2B: //SW
+			mem_write_32(r->ALUOutput, r->B);
+			break;
 	}
 }
 
 /************************************************************/
-/* memory access (MEM) pipeline stage:                                                          */ 
+/* memory access (MEM) pipeline stage: slots in program order, so a     */ 
+/* load sees a store ahead of it in the group                                      */ 
 /************************************************************/
 void MEM()
-{        
-        MEM_WB.PC=EX_MEM.PC;
-	MEM_WB.IR=EX_MEM.IR;
-	MEM_WB.A=EX_MEM.A;
-	MEM_WB.B=EX_MEM.B;
-	MEM_WB.imm=EX_MEM.imm;
-	MEM_WB.ALUOutput=EX_MEM.ALUOutput;//load
-        MEM_WB.LMD=0;//store
-	CURRENT_STATE.HI=0;
-	CURRENT_STATE.LO=0;
-
-     uint32_t opcode = (MEM_WB.IR & 0xFC000000) >> 26;
-     uint32_t function= MEM_WB.IR & 0x0000003F;
-     if(opcode == 0x00){
-		switch(function){
-               case 0x0C: { //SYSTEMCALL
-			       break;// we don't need to do anything with R insutuction
-	       }
-	        default: {
-		           printf(" Wrong\t");
-				//No R type
-			}	
-     }
-    else{
-         switch(code){//I/J type
-		case 0x20: { //LB
-				uint32_t a = 0xFF & mem_read_32(EX_MEM.ALUOutput);
-				if(a >> 7) {	//  negative number
-					byte = (0xFFFFFF00 | a); //sign extend with 1's
-				}
-				MEM_WB.LMD = byte;
-				break;
-			}
-			case 0x21: { //LH
-				uint32_t b = 0xFFFF & mem_read_32(EX_MEM.ALUOutput);
-				if(b >> 15) {	// negative number
-					b = (0xFFFF0000 | b); //sign extend with 1's
-				}
-				MEM_WB.LMD = b;
-				break;
-			}
-			case 0x23: { //LW
-				uint32_t c = mem_read_32(EX_MEM.ALUOutput);
-				MEM_WB.LMD = c;
-				break;
-			}
-			case 0x28: { //SB
-				mem_write_32(EX_MEM.ALUOutput,EX_MEM.B);
-				break;
-			}
-			case 0x29: { //SH
-				mem_write_32(EX_MEM.ALUOutput,EX_MEM.B);
-				break;
-			}
-			case 0x2B: { //SW
-				mem_write_32(EX_MEM.ALUOutput,EX_MEM.B);
-				break;
-			}
-			default: {
-				printf("this instruction has not been handled\t");
-				//Not an instruction accessing memory
-			}	     
-			     
-			     
-	     }
-			     
+{
+	int i;
+
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		MEM_WB[i] = EX_MEM[i];
+		mem_slot(&MEM_WB[i]);
 	}
 }
 
 /************************************************************/
-/* execution (EX) pipeline stage:                                                                          */ 
+/* A branch or jump in EX is taken; resolve_branch() checks this         */ 
+/* against what IF predicted                                                                 */ 
 /************************************************************/
-void EX()
+static void take_branch(uint32_t target)
 {
-	/*IMPLEMENT THIS*/
-	uint32_t instruction, opcode, function, rs, rt, rd, sa, immediate, target;
+	BRANCH_TAKEN = TRUE;
+	BRANCH_TARGET = target;
+}
 
-	EX_MEM.IR=ID_EX.IR;
-	EX_MEM.A=ID_EX.A;//rt
-	EX_MEM.B=ID_EX.B;//sa
-	EX_MEM.imm=ID_EX.imm;
-	EX_MEM.ALUOutput=0;//rd
-	CURRENT_STATE.HI=0;
-	CURRENT_STATE.LO=0;
+/************************************************************/
+/* Train the predictor; on a wrong guess redirect fetch to the real     */ 
+/* next PC and squash the two younger instructions                          */ 
+/************************************************************/
+static void resolve_branch(CPU_Pipeline_Reg *r)
+{
+	uint32_t next = BRANCH_TAKEN ? BRANCH_TARGET : r->PC + 4;
 
+	bpred_update(r->PC, r->inst, BRANCH_TAKEN, BRANCH_TARGET, r->pred_PC, BRANCH_MISPREDICT_PENALTY);
+	if (BRANCH_TAKEN && (r->inst->flags & DEC_BRANCH)) {
+		STATS_TAKEN++;
+	}
+	if (next != r->pred_PC) {
+		NEXT_STATE.PC = next;
+		BRANCH_FLUSH = TRUE;
+	}
+}
+
+/************************************************************/
+/* Forwarding unit: the newest in-flight value of a source register.    */
+/* MEM_WB already holds the group one ahead (MEM ran first this cycle); */
+/* the one two ahead was just written back by WB. Within a group the      */
+/* highest slot is the youngest. A load one ahead never gets here, ID    */
+/* stalls on it, and ID never issues a reader with its producer.            */
+/************************************************************/
+static uint32_t forward_operand(int reads, uint8_t reg, uint32_t value)
+{
+	int i;
 
-	opcode = (EX_MEM.IR & 0xFC000000) >> 26;
-	function = EX_MEM.IR & 0x0000003F;
-	rs = (EX_MEM.IR & 0x03E00000) >> 21;
-	rt = (EX_MEM.IR & 0x001F0000) >> 16;
-	rd = (EX_MEM.IR & 0x0000F800) >> 11;
-	sa = (EX_MEM.IR & 0x000007C0) >> 6;
-	immediate = EX_MEM.IR & 0x0000FFFF;
-	target = EX_MEM.IR & 0x03FFFFFF;
+	if (!reads || reg == 0) {
+		return value;
+	}
+	for (i = ISSUE_WIDTH - 1; i >= 0; i--) {
+		if (MEM_WB[i].inst->dest == reg) {
+			return MEM_WB[i].ALUOutput;	/* EX/MEM -> EX */
+		}
+	}
+	for (i = ISSUE_WIDTH - 1; i >= 0; i--) {
+		if (WB_DEST[i] == reg) {
+			return WB_VALUE[i];	/* MEM/WB -> EX */
+		}
+	}
+	return value;
+}
 
+/************************************************************/
+/* TRUE if inst reads register reg as a source                                       */
+/************************************************************/
+static int reads_reg(const decoded_inst_t *inst, uint8_t reg)
+{
+	return reg != 0 &&
+		(((inst->flags & DEC_READS_RS) && inst->rs == reg) ||
+		((inst->flags & DEC_READS_RT) && inst->rt == reg));
+}
 
+/************************************************************/
+/* Switch core: decode the opcode/function again and execute            */ 
+/************************************************************/
+static void ex_switch(CPU_Pipeline_Reg *r)
+{
+	const decoded_inst_t *inst = r->inst;
+	int64_t product;
 
-	if(opcode == 0x00){
-		switch(function){
+	/* A = REGS[rs], B = REGS[rt], imm already extended by the decoder */
+	if(inst->opcode == 0x00){
+		switch(inst->function){
 			case 0x00: //SLL
-				EX_MEM.ALUOutput = EX_MEM.B << EX_MEM.imm;
-				
+				r->ALUOutput = r->B << inst->sa;
 				break;
-
 			case 0x02: //SRL
-				EX_MEM.ALUOutput = EX_MEM.B >> EX_MEM.imm;
-				
+				r->ALUOutput = r->B >> inst->sa;
 				break;
 			case 0x03: //SRA 
-				if ((EX_MEM.A & 0x80000000) == 1)
-				{
-					EX_MEM.ALUOutput =  ~(~EX_MEM.B >> EX_MEM.imm );
-				}
-				else{
-					EX_MEM.ALUOutput= EX_MEM.B >> EX_MEM.imm;
-				}
+				r->ALUOutput = (int32_t)r->B >> inst->sa;
 				break;
 			case 0x08: //JR
-				NEXT_STATE.PC = EX_MEM.B;
+				take_branch(r->A);
 				break;
 			case 0x09: //JALR
-				EX_MEM.B = CURRENT_STATE.PC + 4;
-				NEXT_STATE.PC = EX_MEM.B;
+				r->ALUOutput = r->PC + 4;
+				take_branch(r->A);
 				break;
-			case 0x0C: //SYSCALL
-
+			case 0x0C: //SYSCALL: serviced as it retires
 				break;
 			case 0x10: //MFHI
-				EX_MEM.ALUOutput = CURRENT_STATE.HI;
+				r->ALUOutput = CURRENT_STATE.HI;
 				break;
 			case 0x11: //MTHI
-				NEXT_STATE.HI =EX_MEM.B;
-				
+				NEXT_STATE.HI = r->A;
 				break;
 			case 0x12: //MFLO
-				EX_MEM.ALUOutput  = CURRENT_STATE.LO;
-				
+				r->ALUOutput = CURRENT_STATE.LO;
 				break;
 			case 0x13: //MTLO
-				NEXT_STATE.LO = EX_MEM.B;
-				
+				NEXT_STATE.LO = r->A;
 				break;
 			case 0x18: //MULT
-				if ((EX_MEM.B & 0x80000000) == 0x80000000){
-					p1 = 0xFFFFFFFF00000000 |EX_MEM.B;
-				}else{
-					p1 = 0x00000000FFFFFFFF & EX_MEM.B;
-				}
-				if ((EX_MEM.A & 0x80000000) == 0x80000000){
-					p2 = 0xFFFFFFFF00000000 | EX_MEM.A ;
-				}else{
-					p2 = 0x00000000FFFFFFFF & EX_MEM.A ;
-				}
-				product = p1 * p2;
-				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
-				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				
+				product = (int64_t)(int32_t)r->A * (int64_t)(int32_t)r->B;
+				NEXT_STATE.LO = (uint64_t)product & 0xFFFFFFFF;
+				NEXT_STATE.HI = (uint64_t)product >> 32;
 				break;
 			case 0x19: //MULTU
-				product = (uint64_t)EX_MEM.B * (uint64_t)EX_MEM.A ;
-				NEXT_STATE.LO = (product & 0X00000000FFFFFFFF);
-				NEXT_STATE.HI = (product & 0XFFFFFFFF00000000)>>32;
-				
+				product = (uint64_t)r->A * (uint64_t)r->B;
+				NEXT_STATE.LO = (uint64_t)product & 0xFFFFFFFF;
+				NEXT_STATE.HI = (uint64_t)product >> 32;
 				break;
 			case 0x1A: //DIV 
-				if(EX_MEM.A  != 0)
-				{
-					NEXT_STATE.LO = (int32_t)EX_MEM.B / (int32_t)EX_MEM.A ;
-					NEXT_STATE.HI = (int32_t)EX_MEM.B  % (int32_t)EX_MEM.A ;
+				if (r->B == 0) {
+					break;
 				}
-				
+				if (r->A == 0x80000000 && r->B == 0xFFFFFFFF) {
+					/* the one quotient that overflows */
+					NEXT_STATE.LO = 0x80000000;
+					NEXT_STATE.HI = 0;
+					break;
+				}
+				NEXT_STATE.LO = (int32_t)r->A / (int32_t)r->B;
+				NEXT_STATE.HI = (int32_t)r->A % (int32_t)r->B;
 				break;
 			case 0x1B: //DIVU
-				if(EX_MEM.A  != 0)
-				{
-					NEXT_STATE.LO = EX_MEM.B  / EX_MEM.A ;
-					NEXT_STATE.HI =EX_MEM.B  % EX_MEM.A ;
+				if (r->B != 0) {
+					NEXT_STATE.LO = r->A / r->B;
+					NEXT_STATE.HI = r->A % r->B;
 				}
-				
 				break;
 			case 0x20: //ADD
-				EX_MEM.ALUOutput = EX_MEM.B  + EX_MEM.A;
-			
-				break;
 			case 0x21: //ADDU 
-				EX_MEM.ALUOutput = EX_MEM.B  + EX_MEM.A;
-				
+				r->ALUOutput = r->A + r->B;
 				break;
 			case 0x22: //SUB
-				EX_MEM.ALUOutput = EX_MEM.B  - EX_MEM.A;
-				break;
 			case 0x23: //SUBU
-				EX_MEM.ALUOutput = EX_MEM.B  - EX_MEM.A;
+				r->ALUOutput = r->A - r->B;
 				break;
 			case 0x24: //AND
-				EX_MEM.ALUOutput = EX_MEM.B  & EX_MEM.A;
+				r->ALUOutput = r->A & r->B;
 				break;
 			case 0x25: //OR
-				EX_MEM.ALUOutput = EX_MEM.B  | EX_MEM.A;
+				r->ALUOutput = r->A | r->B;
 				break;
 			case 0x26: //XOR
-				EX_MEM.ALUOutput = EX_MEM.B  ^ EX_MEM.A;
+				r->ALUOutput = r->A ^ r->B;
 				break;
 			case 0x27: //NOR
-				EX_MEM.ALUOutput  = ~( EX_MEM.B  |  EX_MEM.A );
-				
+				r->ALUOutput = ~(r->A | r->B);
 				break;
 			case 0x2A: //SLT
-				if( EX_MEM.B  < EX_MEM.A ){
-					EX_MEM.ALUOutput= 0x1;
-				}
-				else{
-					EX_MEM.ALUOutput = 0x0;
-				}
-				
+				r->ALUOutput = ((int32_t)r->A < (int32_t)r->B) ? 0x1 : 0x0;
 				break;
 			default:
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				printf("Instruction at 0x%x is not implemented!\n", r->PC);
 				break;
 		}
 	}
 	else{//I/J type
-		switch(opcode){
+		switch(inst->opcode){
 			case 0x01:
-				if(rt == 0x00000){ //BLTZ
-					if((EX_MEM.B & 0x80000000) > 0){
-						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-						branch_jump = TRUE;
+				if(inst->rt == 0x00000){ //BLTZ
+					if((int32_t)r->A < 0){
+						take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 					}
-
 				}
-				else if(rt == 0x00001){ //BGEZ
-					if((EX_MEM.B & 0x80000000) == 0x0){
-						NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-
+				else if(inst->rt == 0x00001){ //BGEZ
+					if((int32_t)r->A >= 0){
+						take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 					}
-
+				}
+				else {
+					printf("Instruction at 0x%x is not implemented!\n", r->PC);
 				}
 				break;
 			case 0x02: //J
-				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
+				take_branch((r->PC & 0xF0000000) | inst->target);
 				break;
 			case 0x03: //JAL
-				NEXT_STATE.PC = (CURRENT_STATE.PC & 0xF0000000) | (target << 2);
-				EX_MEM.ALUOutput = CURRENT_STATE.PC + 4;
+				r->ALUOutput = r->PC + 4;
+				take_branch((r->PC & 0xF0000000) | inst->target);
 				break;
 			case 0x04: //BEQ
-				if(EX_MEM.B == EX_MEM.A){
-					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-
+				if(r->A == r->B){
+					take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 				}
-
 				break;
 			case 0x05: //BNE
-				if(EX_MEM.B != EX_MEM.A){
-					NEXT_STATE.PC = CURRENT_STATE.PC + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-
+				if(r->A != r->B){
+					take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 				}
-
 				break;
 			case 0x06: //BLEZ
-				if((EX_MEM.B & 0x80000000) > 0 || EX_MEM.B == 0){
-					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-
+				if((int32_t)r->A <= 0){
+					take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 				}
-
 				break;
 			case 0x07: //BGTZ
-				if((EX_MEM.B & 0x80000000) == 0x0 || EX_MEM.B != 0){
-					NEXT_STATE.PC = CURRENT_STATE.PC +  ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000)<<2 : (immediate & 0x0000FFFF)<<2);
-					branch_jump = TRUE;
+				if((int32_t)r->A > 0){
+					take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm));
 				}
-
 				break;
 			case 0x08: //ADDI
-				EX_MEM.ALUOutput = EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-
-				break;
 			case 0x09: //ADDIU
-				EX_MEM.ALUOutput = EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-
+				r->ALUOutput = r->A + r->imm;
 				break;
 			case 0x0A: //SLTI
-				if ( (  (int32_t)EX_MEM.B - (int32_t)( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF))) < 0){
-					EX_MEM.ALUOutput = 0x1;
-				}else{
-					EX_MEM.ALUOutput = 0x0;
-				}
-
+				r->ALUOutput = ((int32_t)r->A < (int32_t)r->imm) ? 0x1 : 0x0;
 				break;
 			case 0x0C: //ANDI
-				EX_MEM.ALUOutput = EX_MEM.B & (immediate & 0x0000FFFF);
-
+				r->ALUOutput = r->A & r->imm;
 				break;
 			case 0x0D: //ORI
-				EX_MEM.ALUOutput = EX_MEM.B | (immediate & 0x0000FFFF);
-
+				r->ALUOutput = r->A | r->imm;
 				break;
 			case 0x0E: //XORI
-				EX_MEM.ALUOutput = EX_MEM.B ^ (immediate & 0x0000FFFF);
-
+				r->ALUOutput = r->A ^ r->imm;
 				break;
 			case 0x0F: //LUI
-				EX_MEM.ALUOutput = immediate << 16;
-
+				r->ALUOutput = r->imm << 16;
 				break;
 			case 0x20: //LB
-				data = mem_read_32( EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				EX_MEM.ALUOutput = ((data & 0x000000FF) & 0x80) > 0 ? (data | 0xFFFFFF00) : (data & 0x000000FF);
-
-				break;
 			case 0x21: //LH
-				data = mem_read_32( EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-				EX_MEM.ALUOutput = ((data & 0x0000FFFF) & 0x8000) > 0 ? (data | 0xFFFF0000) : (data & 0x0000FFFF);
-
-				break;
 			case 0x23: //LW
-				EX_MEM.ALUOutput = mem_read_32( EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF)) );
-
-				break;
 			case 0x28: //SB
-				addr =  EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFFFF00) | ( EX_MEM.A & 0x000000FF);
-				mem_write_32(addr, data);
-
-				break;
 			case 0x29: //SH
-				addr =  EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				data = mem_read_32( addr);
-				data = (data & 0xFFFF0000) | ( EX_MEM.A & 0x0000FFFF);
-				mem_write_32(addr, data);
-				break;
 			case 0x2B: //SW
-				addr =  EX_MEM.B + ( (immediate & 0x8000) > 0 ? (immediate | 0xFFFF0000) : (immediate & 0x0000FFFF));
-				mem_write_32(addr,  EX_MEM.A);
-
+				/* effective address = rs + sign-extended offset; MEM() does the access */
+				r->ALUOutput = r->A + r->imm;
 				break;
 			default:
-				/
-				printf("Instruction at 0x%x is not implemented!\n", CURRENT_STATE.PC);
+				printf("Instruction at 0x%x is not implemented!\n", r->PC);
 				break;
 		}
 	}
 }
 
+/************************************************************/
+/* execution (EX) pipeline stage:                                                                          */ 
+/************************************************************/
+void EX()
+{
+	const decoded_inst_t *inst;
+	CPU_Pipeline_Reg *r;
+	int i, unit;
+
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		r = &EX_MEM[i];
+		*r = ID_EX[i];
+		r->ALUOutput = 0;
+		inst = r->inst;
+		if (inst->flags & DEC_BUBBLE) {
+			continue;
+		}
+		if (FORWARDING) {
+			r->A = forward_operand(inst->flags & DEC_READS_RS, inst->rs, r->A);
+			r->B = forward_operand(inst->flags & DEC_READS_RT, inst->rt, r->B);
+		}
+		BRANCH_TAKEN = FALSE;
+		if (EXEC_CORE == CORE_THREADED) {
+			inst->exec(r);
+		}else {
+			ex_switch(r);
+		}
+		if (inst->flags & (DEC_BRANCH | DEC_JUMP)) {
+			resolve_branch(r);
+		}
+		if ((unit = muldiv_unit(inst)) >= 0) {
+			/* HI/LO already hold the result; readers wait for it */
+			HILO_READY = CYCLE_COUNT + muldiv_start(unit, CYCLE_COUNT);
+		}
+	}
+}
+
+/************************************************************/
+/* Threaded core: one EX handler per OP_*, called straight from the     */ 
+/* decoded instruction. Same semantics as the switch in EX().            */ 
+/************************************************************/
+static void ex_invalid(CPU_Pipeline_Reg *r) { printf("Instruction at 0x%x is not implemented!\n", r->PC); }
+static void ex_nop(CPU_Pipeline_Reg *r) { }
+static void ex_sll(CPU_Pipeline_Reg *r) { r->ALUOutput = r->B << r->inst->sa; }
+static void ex_srl(CPU_Pipeline_Reg *r) { r->ALUOutput = r->B >> r->inst->sa; }
+static void ex_sra(CPU_Pipeline_Reg *r) { r->ALUOutput = (int32_t)r->B >> r->inst->sa; }
+static void ex_jr(CPU_Pipeline_Reg *r) { take_branch(r->A); }
+static void ex_jalr(CPU_Pipeline_Reg *r) { r->ALUOutput = r->PC + 4; take_branch(r->A); }
+static void ex_mfhi(CPU_Pipeline_Reg *r) { r->ALUOutput = CURRENT_STATE.HI; }
+static void ex_mthi(CPU_Pipeline_Reg *r) { NEXT_STATE.HI = r->A; }
+static void ex_mflo(CPU_Pipeline_Reg *r) { r->ALUOutput = CURRENT_STATE.LO; }
+static void ex_mtlo(CPU_Pipeline_Reg *r) { NEXT_STATE.LO = r->A; }
+
+static void ex_mult(CPU_Pipeline_Reg *r)
+{
+	int64_t product = (int64_t)(int32_t)r->A * (int64_t)(int32_t)r->B;
+	NEXT_STATE.LO = (uint64_t)product & 0xFFFFFFFF;
+	NEXT_STATE.HI = (uint64_t)product >> 32;
+}
+
+static void ex_multu(CPU_Pipeline_Reg *r)
+{
+	uint64_t product = (uint64_t)r->A * (uint64_t)r->B;
+	NEXT_STATE.LO = product & 0xFFFFFFFF;
+	NEXT_STATE.HI = product >> 32;
+}
+
+static void ex_div(CPU_Pipeline_Reg *r)
+{
+	if (r->B == 0) {
+		return;
+	}
+	if (r->A == 0x80000000 && r->B == 0xFFFFFFFF) {
+		NEXT_STATE.LO = 0x80000000;
+		NEXT_STATE.HI = 0;
+		return;
+	}
+	NEXT_STATE.LO = (int32_t)r->A / (int32_t)r->B;
+	NEXT_STATE.HI = (int32_t)r->A % (int32_t)r->B;
+}
+
+static void ex_divu(CPU_Pipeline_Reg *r)
+{
+	if (r->B != 0) {
+		NEXT_STATE.LO = r->A / r->B;
+		NEXT_STATE.HI = r->A % r->B;
+	}
+}
+
+static void ex_add(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A + r->B; }
+static void ex_sub(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A - r->B; }
+static void ex_and(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A & r->B; }
+static void ex_or(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A | r->B; }
+static void ex_xor(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A ^ r->B; }
+static void ex_nor(CPU_Pipeline_Reg *r) { r->ALUOutput = ~(r->A | r->B); }
+static void ex_slt(CPU_Pipeline_Reg *r) { r->ALUOutput = ((int32_t)r->A < (int32_t)r->B) ? 0x1 : 0x0; }
+
+static void ex_bltz(CPU_Pipeline_Reg *r) { if ((int32_t)r->A < 0) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+static void ex_bgez(CPU_Pipeline_Reg *r) { if ((int32_t)r->A >= 0) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+static void ex_j(CPU_Pipeline_Reg *r) { take_branch((r->PC & 0xF0000000) | r->inst->target); }
+static void ex_jal(CPU_Pipeline_Reg *r) { r->ALUOutput = r->PC + 4; take_branch((r->PC & 0xF0000000) | r->inst->target); }
+static void ex_beq(CPU_Pipeline_Reg *r) { if (r->A == r->B) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+static void ex_bne(CPU_Pipeline_Reg *r) { if (r->A != r->B) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+static void ex_blez(CPU_Pipeline_Reg *r) { if ((int32_t)r->A <= 0) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+static void ex_bgtz(CPU_Pipeline_Reg *r) { if ((int32_t)r->A > 0) take_branch(DECODE_BRANCH_TARGET(r->PC, r->imm)); }
+
+static void ex_addi(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A + r->imm; }
+static void ex_slti(CPU_Pipeline_Reg *r) { r->ALUOutput = ((int32_t)r->A < (int32_t)r->imm) ? 0x1 : 0x0; }
+static void ex_andi(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A & r->imm; }
+static void ex_ori(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A | r->imm; }
+static void ex_xori(CPU_Pipeline_Reg *r) { r->ALUOutput = r->A ^ r->imm; }
+static void ex_lui(CPU_Pipeline_Reg *r) { r->ALUOutput = r->imm << 16; }
+
+static const stage_handler_t EX_HANDLERS[OP_COUNT] = {
+	[OP_INVALID] = ex_invalid,
+	[OP_SLL] = ex_sll, [OP_SRL] = ex_srl, [OP_SRA] = ex_sra,
+	[OP_JR] = ex_jr, [OP_JALR] = ex_jalr, [OP_SYSCALL] = ex_nop,
+	[OP_MFHI] = ex_mfhi, [OP_MTHI] = ex_mthi, [OP_MFLO] = ex_mflo, [OP_MTLO] = ex_mtlo,
+	[OP_MULT] = ex_mult, [OP_MULTU] = ex_multu, [OP_DIV] = ex_div, [OP_DIVU] = ex_divu,
+	[OP_ADD] = ex_add, [OP_ADDU] = ex_add, [OP_SUB] = ex_sub, [OP_SUBU] = ex_sub,
+	[OP_AND] = ex_and, [OP_OR] = ex_or, [OP_XOR] = ex_xor, [OP_NOR] = ex_nor, [OP_SLT] = ex_slt,
+	[OP_BLTZ] = ex_bltz, [OP_BGEZ] = ex_bgez, [OP_J] = ex_j, [OP_JAL] = ex_jal,
+	[OP_BEQ] = ex_beq, [OP_BNE] = ex_bne, [OP_BLEZ] = ex_blez, [OP_BGTZ] = ex_bgtz,
+	[OP_ADDI] = ex_addi, [OP_ADDIU] = ex_addi, [OP_SLTI] = ex_slti,
+	[OP_ANDI] = ex_andi, [OP_ORI] = ex_ori, [OP_XORI] = ex_xori, [OP_LUI] = ex_lui,
+	/* loads and stores: effective address = rs + sign-extended offset */
+	[OP_LB] = ex_addi, [OP_LH] = ex_addi, [OP_LW] = ex_addi,
+	[OP_SB] = ex_addi, [OP_SH] = ex_addi, [OP_SW] = ex_addi,
+};
+
+/************************************************************/
+/* Threaded core: MEM handlers, only bound for loads and stores        */ 
+/************************************************************/
+static void mem_stage_lb(CPU_Pipeline_Reg *r) { r->LMD = (int32_t)(int8_t)mem_read_8(r->ALUOutput); }
+static void mem_stage_lh(CPU_Pipeline_Reg *r) { r->LMD = (int32_t)(int16_t)mem_read_16(r->ALUOutput); }
+static void mem_stage_lw(CPU_Pipeline_Reg *r) { r->LMD = mem_read_32(r->ALUOutput); }
+static void mem_stage_sb(CPU_Pipeline_Reg *r) { mem_write_8(r->ALUOutput, r->B & 0xFF); }
+static void mem_stage_sh(CPU_Pipeline_Reg *r) { mem_write_16(r->ALUOutput, r->B & 0xFFFF); }
+static void mem_stage_sw(CPU_Pipeline_Reg *r) { mem_write_32(r->ALUOutput, r->B); }
+
+static const stage_handler_t MEM_HANDLERS[OP_COUNT] = {
+	[OP_LB] = mem_stage_lb, [OP_LH] = mem_stage_lh, [OP_LW] = mem_stage_lw,
+	[OP_SB] = mem_stage_sb, [OP_SH] = mem_stage_sh, [OP_SW] = mem_stage_sw,
+};
+
+/************************************************************/
+/* Why ID can't issue inst behind the count instructions it has        */ 
+/* already issued this cycle: a counter to charge, or NULL if it can go  */ 
+/************************************************************/
+static uint32_t *issue_hazard(const decoded_inst_t *inst, int count, int mem_ops, int hilo_ops)
+{
+	int i, unit;
+
+	/* the groups in front: EX_MEM holds the one that just left EX,
+	 * MEM_WB the one that just left MEM */
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		if (EX_MEM[i].inst->op == OP_SYSCALL || MEM_WB[i].inst->op == OP_SYSCALL) {
+			/* it changes registers and memory in WB */
+			return &SYSCALL_HELD;
+		}
+		if (FORWARDING) {
+			if ((EX_MEM[i].inst->flags & DEC_LOAD) && reads_reg(inst, EX_MEM[i].inst->dest)) {
+				return &STALL_LOAD_USE;
+			}
+		}else if (reads_reg(inst, EX_MEM[i].inst->dest) || reads_reg(inst, MEM_WB[i].inst->dest)) {
+			return &STALL_DATA;
+		}
+	}
+	/* its own group: nothing forwards between slots in the same stage */
+	for (i = 0; i < count; i++) {
+		if (reads_reg(inst, ID_EX[i].inst->dest)) {
+			return &STALL_GROUP;
+		}
+	}
+	if (((inst->flags & (DEC_LOAD | DEC_STORE)) && mem_ops == MEM_PORTS) ||
+		((inst->flags & DEC_HILO) && hilo_ops > 0)) {
+		return &STALL_STRUCTURAL;
+	}
+	/* it reaches EX next cycle: HI/LO must be ready by then, or a new
+	 * mult/div find its unit free and not finish ahead of the last one */
+	if (inst->flags & DEC_HILO) {
+		unit = muldiv_unit(inst);
+		if (unit < 0 ? CYCLE_COUNT + 1 < HILO_READY :
+			CYCLE_COUNT + 1 < MULDIV[unit].free || CYCLE_COUNT + 1 + MULDIV[unit].latency < HILO_READY) {
+			return &STALL_MULDIV;
+		}
+	}
+	return NULL;
+}
+
 /************************************************************/
 /* instruction decode (ID) pipeline stage:                                                         */ 
 /************************************************************/
 void ID()
 {
-	/*IMPLEMENT THIS*/
 /*
 ID/EX.IR <= IF/ID.IR
 ID/EX.A <= REGS[ IF/ID.IR[rs] ]
 ID/EX.B <= REGS[ IF/ID.IR[rt] ]
 ID/EX.imm <= sign-extend( IF/ID.IR[imm. Field])
+The fields and the extended immediate come pre-decoded with the instruction.
 */
+	const decoded_inst_t *inst;
+	uint32_t *held = NULL;
+	int i, count, mem_ops = 0, hilo_ops = 0;
+
+	if (BRANCH_FLUSH) {
+		/* wrong-path instructions behind a taken branch */
+		for (i = 0; i < ISSUE_WIDTH; i++) {
+			if (!(IF_ID[i].inst->flags & DEC_BUBBLE)) {
+				STALL_CONTROL++;
+			}
+			pipeline_bubble(&ID_EX[i]);
+		}
+		ISSUE_GROUPS[0]++;
+		return;
+	}
 
+	for (count = 0; count < ISSUE_WIDTH; count++) {
+		inst = IF_ID[count].inst;
+		if (inst->flags & DEC_BUBBLE) {
+			break;
+		}
+		if ((held = issue_hazard(inst, count, mem_ops, hilo_ops)) != NULL) {
+			(*held)++;
+			PIPELINE_STALL = TRUE;
+			break;
+		}
+		ID_EX[count] = IF_ID[count];
+		ID_EX[count].A  = NEXT_STATE.REGS[inst->rs];
+		ID_EX[count].B  = NEXT_STATE.REGS[inst->rt];
+		ID_EX[count].imm = inst->imm;
+		mem_ops += (inst->flags & (DEC_LOAD | DEC_STORE)) != 0;
+		hilo_ops += (inst->flags & DEC_HILO) != 0;
+		if ((inst->flags & (DEC_BRANCH | DEC_JUMP)) || inst->op == OP_SYSCALL) {
+			/* ends the group */
+			count++;
+			break;
+		}
+	}
+	ISSUE_GROUPS[count]++;
 
-	ID_EX.IR = IF_ID.IR;
-	ID_EX.A  = CURRENT_STATE.REGS[IF_ID.IR[rs]];
-	ID_EX.b  = CURRENT_STATE.REGS[IF_ID.IR[rt]];
-	ID_EX.imm = ( (IF_ID.IR.imm & 0x8000) > 0 ? (IF_ID.IR.imm | 0xFFFF0000) : (IF_ID.IR.imm & 0x0000FFFF));
-
+	/* what was left moves to the front of IF/ID for IF to fill in behind */
+	for (i = 0; i < ISSUE_WIDTH; i++) {
+		if (i >= count) {
+			pipeline_bubble(&ID_EX[i]);
+		}
+		if (i + count < ISSUE_WIDTH) {
+			IF_ID[i] = IF_ID[i + count];
+		}else {
+			pipeline_bubble(&IF_ID[i]);
+		}
+	}
 }
 
 /************************************************************/
@@ -853,62 +2033,502 @@ ID/EX.imm <= sign-extend( IF/ID.IR[imm. Field])
 /************************************************************/
 void IF()
 {
-	/*IMPLEMENT THIS*/
 /*
 IR <= Mem[PC]
 PC <= PC + 4
 */
+	CPU_Pipeline_Reg *r;
+	uint32_t pc = CURRENT_STATE.PC;
+	int i;
 
-	IF_ID.IR = mem_read_32(CURRENT_STATE.PC);
-	IF_ID.PC = CURRENT_STATE.PC + 4;
+	if (BRANCH_FLUSH) {
+		/* NEXT_STATE.PC already holds the branch target */
+		STALL_CONTROL++;
+		for (i = 0; i < ISSUE_WIDTH; i++) {
+			pipeline_bubble(&IF_ID[i]);
+		}
+		return;
+	}
+	if (PIPELINE_DRAINING) {
+		/* NEXT_STATE.PC already holds the next instruction to run once the
+		 * pipeline has drained */
+		return;
+	}
 
-	
+	/* ID kept the front of IF_ID; NEXT_STATE.PC still points past it */
+	for (i = 0; i < ISSUE_WIDTH && !(IF_ID[i].inst->flags & DEC_BUBBLE); i++) {
+	}
+	for (; i < ISSUE_WIDTH; i++) {
+		r = &IF_ID[i];
+		r->PC = pc;
+		r->inst = decode_fetch(pc);
+		r->seq = ++FETCH_SEQ;
+		if (ICACHE.enabled) {
+			cache_stall(&ICACHE, pc, FALSE, &STALL_ICACHE);
+		}
+		if (r->inst->flags & (DEC_BRANCH | DEC_JUMP)) {
+			r->pred_PC = bpred_predict(pc, r->inst);
+		}else {
+			r->pred_PC = pc + 4;
+		}
+		pc = r->pred_PC;
+		NEXT_STATE.PC = pc;
+		if (r->inst->flags & (DEC_BRANCH | DEC_JUMP)) {
+			/* fetch goes on from the predicted target next cycle */
+			break;
+		}
+	}
+}
+
+
+/************************************************************/
+/* Fast functional mode: fetch, execute and retire one instruction,      */ 
+/* reusing the threaded-core EX/MEM handlers                                        */ 
+/************************************************************/
+const decoded_inst_t *fast_step()
+{
+	const decoded_inst_t *inst = decode_fetch(CURRENT_STATE.PC);
+	CPU_Pipeline_Reg r;
+	uint32_t cost = 1, predicted, icache = 0, dcache = 0;
+	int mispredicted = FALSE;
+
+	r.PC = CURRENT_STATE.PC;
+	r.inst = inst;
+	r.A = CURRENT_STATE.REGS[inst->rs];
+	r.B = CURRENT_STATE.REGS[inst->rt];
+	r.imm = inst->imm;
+	r.ALUOutput = 0;
+	r.LMD = 0;
+
+	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+	BRANCH_TAKEN = FALSE;
+	inst->exec(&r);
+	if (inst->mem != NULL) {
+		inst->mem(&r);
+		if (DCACHE.enabled) {
+			dcache = cache_access(&DCACHE, r.ALUOutput, inst->flags & DEC_STORE, CYCLE_COUNT) - 1;
+		}
+	}
+	if (ICACHE.enabled) {
+		icache = cache_access(&ICACHE, r.PC, FALSE, CYCLE_COUNT) - 1;
+	}
+	/* the misses overlap, as in the pipeline */
+	cost += icache > dcache ? icache : dcache;
+	STALL_DCACHE += dcache;
+	STALL_ICACHE += icache > dcache ? icache - dcache : 0;
+	if (inst->flags & (DEC_BRANCH | DEC_JUMP)) {
+		/* keep the predictor warm and charge what the pipeline would */
+		predicted = bpred_predict(r.PC, inst);
+		if (BRANCH_TAKEN) {
+			NEXT_STATE.PC = BRANCH_TARGET;
+			STATS_TAKEN += (inst->flags & DEC_BRANCH) != 0;
+		}
+		bpred_update(r.PC, inst, BRANCH_TAKEN, BRANCH_TARGET, predicted, FAST_BRANCH_PENALTY);
+		mispredicted = NEXT_STATE.PC != predicted;
+	}
+	if (inst->dest != 0) {
+		NEXT_STATE.REGS[inst->dest] = (inst->flags & DEC_LOAD) ? r.LMD : r.ALUOutput;
+	}
+	if (inst->op == OP_SYSCALL) {
+		syscall_run(r.PC, NEXT_STATE.REGS);
+	}
+	CURRENT_STATE = NEXT_STATE;
+	INSTRUCTION_COUNT++;
+
+	/* estimate what the instruction would have cost in the pipeline */
+	if (CYCLE_COUNT == 0) {
+		cost += FAST_FILL_CYCLES;
+	}
+	if (FAST_LOAD_DEST != 0 &&
+		(((inst->flags & DEC_READS_RS) && inst->rs == FAST_LOAD_DEST) ||
+		((inst->flags & DEC_READS_RT) && inst->rt == FAST_LOAD_DEST))) {
+		cost += FAST_LOAD_USE_STALL;
+		STALL_LOAD_USE += FAST_LOAD_USE_STALL;
+	}
+	if (mispredicted) {
+		cost += FAST_BRANCH_PENALTY;
+		STALL_CONTROL += FAST_BRANCH_PENALTY;
+	}
+	FAST_LOAD_DEST = (inst->flags & DEC_LOAD) ? inst->dest : 0;
+	CYCLE_COUNT += cost;
+	ESTIMATED_CYCLES += cost;
+	stats_retire(r.PC, inst, r.ALUOutput, CYCLE_COUNT);
+	if (TRACE_ON) {
+		trace_retire(&r, CYCLE_COUNT);
+	}
+	return inst;
 }
 
+/************************************************************/
+/* Retire up to max_instructions in fast mode, fewer if the run stops. */ 
+/* The translator gets the first go wherever a block may start: where  */ 
+/* control lands, after a word no block holds, and every JIT_BLOCK_LEN */ 
+/* words of straight-line code. Anything it does not take is stepped.  */ 
+/************************************************************/
+uint32_t fast_run(uint32_t max_instructions)
+{
+	const decoded_inst_t *inst;
+	uint32_t done = 0, stepped = 0, n;
+
+	while (done < max_instructions && RUN_FLAG) {
+		if (stepped == 0) {
+			n = jit_run(max_instructions - done);
+			if (n > 0) {
+				done += n;
+				continue;
+			}
+		}
+		inst = fast_step();
+		done++;
+		if ((inst->flags & (DEC_BRANCH | DEC_JUMP)) || inst->op == OP_SYSCALL || inst->op == OP_INVALID) {
+			stepped = 0;
+		}else {
+			stepped = (stepped + 1) % JIT_BLOCK_LEN;
+		}
+	}
+	return done;
+}
+
+/************************************************************/
+/* Let everything in the out-of-order core retire without fetching    */ 
+/* more, leaving CURRENT_STATE.PC at the next instruction to run           */ 
+/************************************************************/
+void drain_ooo()
+{
+	if (SIM_MODE != MODE_OOO) {
+		return;
+	}
+	PIPELINE_DRAINING = TRUE;
+	while (!ooo_empty()) {
+		cycle();
+	}
+	PIPELINE_DRAINING = FALSE;
+}
+
+/************************************************************/
+/* Switch between the detailed pipeline, fast mode and the out-of-     */ 
+/* order core. Leaving the pipeline or the core drains it first, so the */ 
+/* switch lands on an instruction boundary with CURRENT_STATE.PC at  */ 
+/* the next instruction to run.                                                                   */ 
+/************************************************************/
+void set_mode(int mode)
+{
+	if (mode == SIM_MODE) {
+		return;
+	}
+	if (SIM_MODE == MODE_PIPELINE) {
+		PIPELINE_DRAINING = TRUE;
+		while (!pipeline_empty() || PIPELINE_FREEZE > 0) {
+			cycle();
+		}
+		PIPELINE_DRAINING = FALSE;
+	}
+	drain_ooo();
+	if (mode == MODE_FAST) {
+		FAST_LOAD_DEST = 0;
+	}else if (mode == MODE_PIPELINE) {
+		pipeline_clear();
+		NEXT_STATE = CURRENT_STATE;
+	}else {
+		NEXT_STATE = CURRENT_STATE;
+		ooo_start();
+	}
+	SIM_MODE = mode;
+}
+
+/************************************************************/
+/* Resize the out-of-order core, draining it first when it is running; */ 
+/* -1 if a size is out of range                                                                 */ 
+/************************************************************/
+int set_ooo(uint32_t rob, uint32_t rs, uint32_t regs, uint32_t lsq, int split)
+{
+	drain_ooo();
+	if (ooo_configure(rob, rs, regs, lsq, split) != 0) {
+		return -1;
+	}
+	if (SIM_MODE == MODE_OOO) {
+		ooo_start();
+	}
+	return 0;
+}
+
+/************************************************************/
+/* Issue up to width instructions a cycle, at most ports of them loads   */ 
+/* and stores. A narrower pipeline would drop slots, so instructions     */ 
+/* in flight drain first, as for a mode switch.                                       */ 
+/************************************************************/
+void set_width(int width, int ports)
+{
+	if (width < ISSUE_WIDTH && SIM_MODE == MODE_PIPELINE) {
+		PIPELINE_DRAINING = TRUE;
+		while (!pipeline_empty() || PIPELINE_FREEZE > 0) {
+			cycle();
+		}
+		PIPELINE_DRAINING = FALSE;
+	}
+	ISSUE_WIDTH = width;
+	MEM_PORTS = ports;
+}
+
+/************************************************************/
+/* The mult/div unit inst runs on, -1 if none                                              */ 
+/************************************************************/
+int muldiv_unit(const decoded_inst_t *inst)
+{
+	switch (inst->op) {
+		case OP_MULT:
+		case OP_MULTU:
+			return MULDIV_MULT;
+		case OP_DIV:
+		case OP_DIVU:
+			return MULDIV_DIV;
+		default:
+			return -1;
+	}
+}
+
+/************************************************************/
+/* Start an operation on a unit in cycle; returns its latency                   */ 
+/************************************************************/
+uint32_t muldiv_start(int unit, uint32_t cycle)
+{
+	muldiv_unit_t *u = &MULDIV[unit];
+
+	u->free = cycle + u->interval;
+	u->ops++;
+	u->busy += u->interval;
+	return u->latency;
+}
+
+/************************************************************/
+/* Set a unit's latency and initiation interval, both in cycles        */ 
+/************************************************************/
+void set_muldiv(int unit, uint32_t latency, uint32_t interval)
+{
+	MULDIV[unit].latency = latency;
+	MULDIV[unit].interval = interval;
+}
+
+/* cycles in which ID issued 0, 1, ... ISSUE_WIDTH_MAX instructions */
+static const char *ISSUE_COUNTER_NAMES[ISSUE_WIDTH_MAX + 1] = { "issue.0", "issue.1", "issue.2", "issue.3", "issue.4" };
+
+/************************************************************/
+/* Put the counters the simulator keeps in the stats registry            */ 
+/************************************************************/
+static void register_counters()
+{
+	int i;
+
+	stats_init();
+	stats_register("cycles", &CYCLE_COUNT);
+	stats_register("instructions", &INSTRUCTION_COUNT);
+	stats_register("stall.load_use", &STALL_LOAD_USE);
+	stats_register("stall.data", &STALL_DATA);
+	stats_register("stall.control", &STALL_CONTROL);
+	stats_register("stall.icache", &STALL_ICACHE);
+	stats_register("stall.dcache", &STALL_DCACHE);
+	stats_register("stall.group", &STALL_GROUP);
+	stats_register("stall.structural", &STALL_STRUCTURAL);
+	stats_register("stall.muldiv", &STALL_MULDIV);
+	for (i = 0; i <= ISSUE_WIDTH_MAX; i++) {
+		stats_register(ISSUE_COUNTER_NAMES[i], &ISSUE_GROUPS[i]);
+	}
+	stats_register("muldiv.mult_ops", &MULDIV[MULDIV_MULT].ops);
+	stats_register("muldiv.mult_busy", &MULDIV[MULDIV_MULT].busy);
+	stats_register("muldiv.div_ops", &MULDIV[MULDIV_DIV].ops);
+	stats_register("muldiv.div_busy", &MULDIV[MULDIV_DIV].busy);
+	ooo_register_counters();
+	syscall_register_counters();
+	stats_register("bpred.mispredicts", &BPRED_STATS.mispredicts);
+	stats_register("icache.accesses", &ICACHE.stats.accesses);
+	stats_register("icache.misses", &ICACHE.stats.misses);
+	stats_register("dcache.accesses", &DCACHE.stats.accesses);
+	stats_register("dcache.misses", &DCACHE.stats.misses);
+	stats_register("l2.accesses", &L2CACHE.stats.accesses);
+	stats_register("l2.misses", &L2CACHE.stats.misses);
+	stats_register("dram.accesses", &DRAM.stats.accesses);
+	stats_register("dram.row_conflicts", &DRAM.stats.row_conflicts);
+}
+
+/************************************************************/
+/* Make s the instance this thread simulates                                                     */ 
+/************************************************************/
+void sim_select(sim_t *s) {
+	SIM = s;
+	MEM_CTX = &s->mem;
+	DECODE_CTX = &s->decode;
+	BPRED_CTX = &s->bpred;
+	TRACE_CTX = &s->trace;
+	TIMELINE_CTX = &s->timeline;
+	STATS_CTX = &s->stats;
+	JIT_CTX = &s->jit;
+	OOO_CTX = &s->ooo;
+	SYSCALL_CTX = &s->syscall;
+}
 
 /************************************************************/
 /* Initialize Memory                                                                                                    */ 
 /************************************************************/
 void initialize() { 
+	L2CACHE.name = "L2";
+	L2CACHE.dram = &DRAM;
+	ICACHE.name = "I-cache";
+	ICACHE.next = &L2CACHE;
+	ICACHE.dram = &DRAM;
+	DCACHE.name = "D-cache";
+	DCACHE.next = &L2CACHE;
+	DCACHE.dram = &DRAM;
 	init_memory();
+	decode_set_handlers(EX_HANDLERS, MEM_HANDLERS);
+	FORWARDING = TRUE;
+	ISSUE_WIDTH = 1;
+	MEM_PORTS = 1;
+	set_muldiv(MULDIV_MULT, 1, 1);
+	set_muldiv(MULDIV_DIV, 1, 1);
+	JIT_ON = TRUE;
+	ooo_configure(OOO_ROB, OOO_RS, OOO_REGS, OOO_LSQ, FALSE);
+	bpred_init(BPRED_NOTTAKEN);
+	register_counters();
+	pipeline_clear();
 	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
 }
 
 /************************************************************/
-/* Print the program loaded into memory (in MIPS assembly format)    */ 
+/* A new, initialized instance, selected for this thread; NULL if out  */ 
+/* of memory                                                                                                            */ 
+/************************************************************/
+sim_t *sim_create() {
+	sim_t *s = calloc(1, sizeof(sim_t));
+
+	if (s == NULL) {
+		error_report("Out of memory creating a simulator instance\n");
+		return NULL;
+	}
+	sim_select(s);
+	CMD_INPUT = stdin;
+	initialize();
+	return s;
+}
+
+/************************************************************/
+/* Release everything s holds. Leaves s selected, so the thread must */
+/* select another instance before simulating again.                                   */ 
+/************************************************************/
+void sim_destroy(sim_t *s) {
+	sim_select(s);
+	trace_close();
+	free(s->trace.buf);
+	timeline_enable(0);
+	decode_program(0, 0);
+	free(STATS_PROFILE);
+	cache_disable(&ICACHE);
+	cache_disable(&DCACHE);
+	cache_disable(&L2CACHE);
+	dram_disable(&DRAM);
+	mem_free();
+	jit_free();
+	ooo_free();
+	syscall_free();
+	free(s->prog_data);
+	free(s);
+}
+
+/************************************************************/
+/* Print the program loaded into memory (in MIPS assembly format).   */ 
+/* Branch and jump targets inside the text get labels L1, L2, ... in   */
+/* address order. Once anything has run, each line also shows how often */
+/* it retired, the cycles it was charged and those beyond one per run.  */
 /************************************************************/
 void print_program(){
-	/*IMPLEMENT THIS*/
+	uint32_t *labels = calloc(PROGRAM_SIZE > 0 ? PROGRAM_SIZE : 1, sizeof(uint32_t));
+	uint32_t i, pc, target, count, cycles, num_labels = 0;
+	int profiled = STATS_PROFILE_BASE == PROGRAM_BASE && STATS_PROFILE_WORDS == PROGRAM_SIZE && INSTRUCTION_COUNT > 0;
+	char text[DISASM_LEN], label[16];
+	decoded_inst_t d;
+
+	if (labels == NULL) {
+		error_report("Out of memory listing the program\n");
+		return;
+	}
+	/* decode from memory so stores into the text show up */
+	for (i = 0; i < PROGRAM_SIZE; i++) {
+		pc = PROGRAM_BASE + 4 * i;
+		decode_inst(mem_read_32(pc), &d);
+		if (disasm_target(&d, pc, &target) && target - PROGRAM_BASE < 4 * PROGRAM_SIZE && (target & 3) == 0) {
+			labels[(target - PROGRAM_BASE) / 4] = 1;
+		}
+	}
+	for (i = 0; i < PROGRAM_SIZE; i++) {
+		if (labels[i]) {
+			labels[i] = ++num_labels;
+		}
+	}
+
+	printf("-------------------------------------\n");
+	printf("[Address]\t[Word]\t\t%-32s%s\n", "[Instruction]", profiled ? "[Executed]\t[Cycles]\t[Stalls]" : "");
+	printf("-------------------------------------\n");
+	for (i = 0; i < PROGRAM_SIZE; i++) {
+		pc = PROGRAM_BASE + 4 * i;
+		decode_inst(mem_read_32(pc), &d);
+		if (labels[i]) {
+			printf("L%u:\n", labels[i]);
+		}
+		if (disasm_target(&d, pc, &target) && target - PROGRAM_BASE < 4 * PROGRAM_SIZE && labels[(target - PROGRAM_BASE) / 4]) {
+			snprintf(label, sizeof(label), "L%u", labels[(target - PROGRAM_BASE) / 4]);
+			disasm(&d, pc, label, text, sizeof(text));
+		}else {
+			disasm(&d, pc, NULL, text, sizeof(text));
+		}
+		printf("0x%08x\t%08x\t%-32s", pc, d.IR, text);
+		if (profiled && STATS_PROFILE[i].count > 0) {
+			count = STATS_PROFILE[i].count;
+			cycles = STATS_PROFILE[i].cycles;
+			printf("%u\t\t%u\t\t%u", count, cycles, cycles > count ? cycles - count : 0);
+		}
+		printf("\n");
+	}
+	printf("-------------------------------------\n");
+	free(labels);
 }
 
 /************************************************************/
 /* Print the current pipeline                                                                                    */ 
 /************************************************************/
-void show_pipeline(){
-	/*IMPLEMENT THIS*/
+static void show_latch(const char *name, const CPU_Pipeline_Reg *reg)
+{
+	if (reg->inst->flags & DEC_BUBBLE) {
+		printf("%s\t: bubble\n", name);
+		return;
+	}
+	char text[DISASM_LEN];
+
+	disasm(reg->inst, reg->PC, NULL, text, sizeof(text));
+	printf("%s\t: #%u 0x%08x %-28s IR 0x%08x  A 0x%08x  B 0x%08x  imm 0x%08x  ALUOutput 0x%08x  LMD 0x%08x\n",
+		name, reg->seq, reg->PC, text, reg->inst->IR,
+		reg->A, reg->B, reg->imm, reg->ALUOutput, reg->LMD);
 }
 
-/***************************************************************/
-/* main                                                                                                                                   */
-/***************************************************************/
-int main(int argc, char *argv[]) {                              
-	printf("\n**************************\n");
-	printf("Welcome to MU-MIPS SIM...\n");
-	printf("**************************\n\n");
-	
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
-		exit(1);
-	}
+void show_pipeline(){
+	const char *names[4] = { "IF/ID", "ID/EX", "EX/MEM", "MEM/WB" };
+	CPU_Pipeline_Reg *latches[4] = { IF_ID, ID_EX, EX_MEM, MEM_WB };
+	char name[16];
+	int i, slot;
 
-	strcpy(prog_file, argv[1]);
-	initialize();
-	load_program();
-	help();
-	while (1){
-		handle_command();
+	printf("-------------------------------------\n");
+	printf("Pipeline at cycle %u (PC 0x%08x)%s\n", CYCLE_COUNT, CURRENT_STATE.PC,
+		PIPELINE_FREEZE > 0 ? ", frozen on a cache miss" : "");
+	printf("-------------------------------------\n");
+	for (i = 0; i < 4; i++) {
+		for (slot = 0; slot < ISSUE_WIDTH; slot++) {
+			if (ISSUE_WIDTH > 1) {
+				snprintf(name, sizeof(name), "%s.%d", names[i], slot);
+			}else {
+				snprintf(name, sizeof(name), "%s", names[i]);
+			}
+			show_latch(name, &latches[i][slot]);
+		}
 	}
-	return 0;
+	printf("-------------------------------------\n");
 }
@@ -1,41 +1,23 @@
+#include <stdio.h>
 #include <stdint.h>
 
+#include "mu-mem.h"
+#include "mu-decode.h"
+#include "mu-load.h"
+#include "mu-bpred.h"
+#include "mu-cache.h"
+#include "mu-trace.h"
+#include "mu-timeline.h"
+#include "mu-stats.h"
+#include "mu-disasm.h"
+#include "mu-jit.h"
+#include "mu-ooo.h"
+#include "mu-syscall.h"
+#include "mu-error.h"
+
 #define FALSE 0
 #define TRUE  1
 
-/******************************************************************************/
-/* MIPS memory layout                                                                                                                                      */
-/******************************************************************************/
-#define MEM_TEXT_BEGIN  0x00400000
-#define MEM_TEXT_END      0x0FFFFFFF
-/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
-#define MEM_DATA_BEGIN  0x10010000
-#define MEM_DATA_END   0x7FFFFFFF
-
-#define MEM_KTEXT_BEGIN 0x80000000
-#define MEM_KTEXT_END  0x8FFFFFFF
-
-#define MEM_KDATA_BEGIN 0x90000000
-#define MEM_KDATA_END  0xFFFEFFFF
-
-/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
-#define MEM_STACK_BEGIN 0x7FFFFFFF
-#define MEM_STACK_END  0x10010000
-
-typedef struct {
-	uint32_t begin, end;
-	uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
-
-#define NUM_MEM_REGION 4
 #define MIPS_REGS 32
 
 typedef struct CPU_State_Struct {
@@ -46,8 +28,10 @@ typedef struct CPU_State_Struct {
 } CPU_State;
 
 typedef struct CPU_Pipeline_Reg_Struct{
-	uint32_t PC;
-	uint32_t IR;
+	uint32_t PC;                           /* address of the instruction in the latch */
+	const decoded_inst_t *inst;    /* DECODE_BUBBLE when the latch is empty */
+	uint32_t pred_PC;                  /* where IF fetched next, checked in EX */
+	uint32_t seq;                         /* fetch order for the timeline, 0 in a bubble */
 	uint32_t A;
 	uint32_t B;
 	uint32_t imm;
@@ -56,50 +40,275 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	
 } CPU_Pipeline_Reg;
 
+#define BRANCH_MISPREDICT_PENALTY 2	/* resolved in EX: IF and ID squashed */
+
+/* Superscalar issue: every latch holds a group of up to ISSUE_WIDTH
+ * instructions, oldest in slot 0. IF fetches in order into the free slots
+ * of IF/ID and stops after a branch or jump. ID issues from the front and
+ * stops at the first instruction that reads a register written ahead of it
+ * in the same group, would take more than MEM_PORTS loads and stores or a
+ * second mult/div unit (HI/LO) operation, or is held by a hazard with the
+ * groups in front. A branch, jump or SYSCALL ends its group, so a
+ * mispredict never squashes anything issued with it. What ID leaves waits
+ * in IF/ID. Fast mode's stall model stays scalar. */
+#define ISSUE_WIDTH_MAX TIMELINE_WIDTH
+
+/* Mult/div units: MULT/MULTU go to one, DIV/DIVU to the other. Each has a
+ * latency, the cycles from entering EX until MFHI/MFLO can read the
+ * result in EX, and an initiation interval, the cycles before it takes
+ * another operation (the latency for an unpipelined divider). ID holds
+ * MFHI, MFLO, MTHI and MTLO until HI/LO is ready, and a MULT or DIV until
+ * its unit is free and it would not finish ahead of the one in flight. EX
+ * still computes the result at once; only the timing waits. Both default
+ * to one cycle, which is the single-cycle EX. Fast mode does not model
+ * them. */
+#define MULDIV_MULT 0
+#define MULDIV_DIV   1
+#define MULDIV_UNITS 2
+#define MULDIV_MAX_LATENCY 256
+
+typedef struct {
+	uint32_t latency;
+	uint32_t interval;
+	uint32_t free;	/* first cycle it takes another operation */
+	uint32_t ops;	/* operations started */
+	uint32_t busy;	/* cycles it could not have taken one */
+} muldiv_unit_t;
+
+extern const char *MULDIV_NAMES[MULDIV_UNITS];
+
+/* EX()/MEM() dispatch: nested switch on opcode/function, or a direct call
+ * through the handler bound into the decoded instruction */
+#define CORE_SWITCH     0
+#define CORE_THREADED 1
+
+/* Simulation mode. MODE_FAST retires one instruction per step directly
+ * against CURRENT_STATE and charges CYCLE_COUNT from a simple stall model
+ * instead of stepping the five stages. MODE_OOO times the same
+ * instructions on the out-of-order core in mu-ooo.h. */
+#define MODE_PIPELINE 0
+#define MODE_FAST         1
+#define MODE_OOO          2
+
+/* Memory configuration file, one level per line, # starts a comment:
+ *   l1i|l1d|l2 <size> <assoc> <line> <policy> <wb|wt> <hit> <miss> [mshrs]
+ *   dram <banks> <row bytes> <row hit> <row empty> <row conflict>
+ * miss is only charged by the last cache level. */
+#define MEMCFG_LINE 256
+#define FARM_LINE      1024	/* longest job line in a --farm file */
+
+/* fast-mode stall model: a 5-stage pipeline with full forwarding. The
+ * estimated stalls are counted in the pipeline's STALL_LOAD_USE,
+ * STALL_CONTROL and cache stall counters, so they explain the estimate. */
+#define FAST_FILL_CYCLES        4	/* before the first instruction retires */
+#define FAST_LOAD_USE_STALL  1	/* next instruction reads the loaded register */
+#define FAST_BRANCH_PENALTY 2	/* mispredicted branch/jump squashes IF and ID */
+
+/* the last sample command's estimate, for the JSON result */
+typedef struct {
+	uint32_t samples;	/* 0 until a sample command measured something */
+	uint32_t covered;	/* instructions the sampled run retired */
+	double cpi;	/* sample mean CPI */
+	double sd;
+	double half;	/* 95% confidence interval half-width */
+} sample_result_t;
+
 /***************************************************************/
-/* CPU State info.                                                                                                               */
+/* Simulator instance                                                                                                        */
 /***************************************************************/
+/* Everything one simulation changes as it runs. SIM is per thread and
+ * points at the instance the thread is simulating; sim_select() also
+ * points the memory, decode, predictor, trace, timeline, stats,
+ * translator, out-of-order and system call modules at the instance's
+ * parts. The upper-case names used throughout are macros over SIM. */
+typedef struct {
+	/* CPU State info. */
+	CPU_State current_state, next_state;
+	int run_flag;	/* run flag*/
+	uint32_t instruction_count;
+	uint32_t cycle_count;
+	uint32_t program_size; /*in words*/
+	uint32_t program_base;	/* address of the first text word */
+	uint32_t program_entry;	/* PC after reset */
+	int verbose;	/* -v: 1 lists segments, 2 also echoes every loaded word */
+	int quiet;	/* batch mode: no banners, prompts or progress messages */
+	FILE *cmd_input;	/* where handle_command() reads from: stdin or a --script file */
+	int branch_flush;	/* EX found a misprediction this cycle; ID and IF squash */
+	int branch_taken;	/* the branch/jump being executed is taken ... */
+	uint32_t branch_target;	/* ... to here */
+	int exec_core;	/* CORE_* */
+
+	int sim_mode;	/* MODE_* */
+	int pipeline_draining;	/* IF stops fetching so the pipeline empties */
+	uint32_t estimated_cycles;	/* part of CYCLE_COUNT charged by the fast-mode model */
+	int fast_load_dest;	/* register loaded by the previous fast-mode instruction, 0 if none */
+
+	/* Hazard handling. With FORWARDING on, EX takes its operands from the
+	 * instructions ahead of it and only a load followed by a use stalls, for
+	 * one bubble. With it off, ID holds an instruction until its sources have
+	 * been written back. Either way ID reads the register file after WB has
+	 * written it in the same cycle. */
+	int forwarding;
+	int pipeline_stall;	/* ID held its instruction this cycle; IF does not fetch */
+	uint32_t wb_dest[ISSUE_WIDTH_MAX], wb_value[ISSUE_WIDTH_MAX];	/* registers written back this cycle, by slot (MEM/WB -> EX path) */
+	uint32_t stall_load_use;	/* cycles issue stopped at a load followed by a use */
+	uint32_t stall_data;	/* cycles issue stopped waiting for writeback with forwarding off */
+	uint32_t stall_control;	/* fetched instructions squashed by taken branches/jumps */
+	uint32_t fetch_seq;	/* instructions fetched so far, numbering the latches */
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t CYCLE_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+	int issue_width;	/* slots per latch in use, 1 to ISSUE_WIDTH_MAX */
+	int mem_ports;	/* loads and stores per group */
+	uint32_t stall_group;	/* cycles issue stopped at a dependency inside the group */
+	uint32_t stall_structural;	/* cycles issue stopped for a memory port or the mult/div unit */
+	uint32_t issue_groups[ISSUE_WIDTH_MAX + 1];	/* pipeline cycles by the instructions ID issued */
+	sample_result_t sample;
 
+	muldiv_unit_t muldiv[MULDIV_UNITS];
+	uint32_t hilo_ready;	/* first cycle EX may read HI/LO */
+	uint32_t stall_muldiv;	/* cycles issue stopped for a mult/div unit or a pending HI/LO */
+
+	/* Memory hierarchy, each level disabled until configured: split L1s in
+	 * front of a unified L2 and DRAM. A missing level is skipped. The caches
+	 * block: a miss in IF or MEM freezes the whole pipeline for the extra
+	 * latency, and an I-cache and a D-cache miss in the same cycle overlap. */
+	dram_t dram;
+	cache_t l2cache, icache, dcache;
+	uint32_t pipeline_freeze;	/* cycles left before the pipeline moves again */
+	uint32_t stall_icache;	/* cycles frozen on I-cache latency, past any D-cache miss it overlaps */
+	uint32_t stall_dcache;	/* cycles frozen on D-cache latency; the two add up to the frozen cycles */
+
+	/* Pipeline Registers. */
+	CPU_Pipeline_Reg if_id[ISSUE_WIDTH_MAX], id_ex[ISSUE_WIDTH_MAX], ex_mem[ISSUE_WIDTH_MAX], mem_wb[ISSUE_WIDTH_MAX];
+
+	char prog_file[256];
+	uint8_t *prog_data;	/* program image loaded from memory, NULL to read prog_file */
+	size_t prog_size;
+
+	/* the modules' parts of the instance */
+	mem_ctx_t mem;
+	decode_ctx_t decode;
+	bpred_ctx_t bpred;
+	trace_ctx_t trace;
+	timeline_ctx_t timeline;
+	stats_ctx_t stats;
+	jit_ctx_t jit;
+	ooo_ctx_t ooo;
+	syscall_ctx_t syscall;
+} sim_t;
+
+extern __thread sim_t *SIM;
+
+#define CURRENT_STATE          (SIM->current_state)
+#define NEXT_STATE                (SIM->next_state)
+#define RUN_FLAG                   (SIM->run_flag)
+#define INSTRUCTION_COUNT  (SIM->instruction_count)
+#define CYCLE_COUNT             (SIM->cycle_count)
+#define PROGRAM_SIZE           (SIM->program_size)
+#define PROGRAM_BASE           (SIM->program_base)
+#define PROGRAM_ENTRY         (SIM->program_entry)
+#define VERBOSE                     (SIM->verbose)
+#define QUIET                          (SIM->quiet)
+#define CMD_INPUT                  (SIM->cmd_input)
+#define BRANCH_FLUSH            (SIM->branch_flush)
+#define BRANCH_TAKEN            (SIM->branch_taken)
+#define BRANCH_TARGET          (SIM->branch_target)
+#define EXEC_CORE                 (SIM->exec_core)
+#define SIM_MODE                   (SIM->sim_mode)
+#define PIPELINE_DRAINING   (SIM->pipeline_draining)
+#define ESTIMATED_CYCLES     (SIM->estimated_cycles)
+#define FAST_LOAD_DEST        (SIM->fast_load_dest)
+#define FORWARDING               (SIM->forwarding)
+#define PIPELINE_STALL          (SIM->pipeline_stall)
+#define WB_DEST                     (SIM->wb_dest)
+#define WB_VALUE                   (SIM->wb_value)
+#define STALL_LOAD_USE        (SIM->stall_load_use)
+#define STALL_DATA                (SIM->stall_data)
+#define STALL_CONTROL          (SIM->stall_control)
+#define FETCH_SEQ                  (SIM->fetch_seq)
+#define ISSUE_WIDTH               (SIM->issue_width)
+#define MEM_PORTS                  (SIM->mem_ports)
+#define STALL_GROUP              (SIM->stall_group)
+#define STALL_STRUCTURAL    (SIM->stall_structural)
+#define ISSUE_GROUPS            (SIM->issue_groups)
+#define SAMPLE                       (SIM->sample)
+#define MULDIV                        (SIM->muldiv)
+#define HILO_READY                (SIM->hilo_ready)
+#define STALL_MULDIV            (SIM->stall_muldiv)
+#define DRAM                           (SIM->dram)
+#define L2CACHE                     (SIM->l2cache)
+#define ICACHE                        (SIM->icache)
+#define DCACHE                       (SIM->dcache)
+#define PIPELINE_FREEZE        (SIM->pipeline_freeze)
+#define STALL_ICACHE             (SIM->stall_icache)
+#define STALL_DCACHE            (SIM->stall_dcache)
+#define IF_ID                           (SIM->if_id)
+#define ID_EX                           (SIM->id_ex)
+#define EX_MEM                       (SIM->ex_mem)
+#define MEM_WB                       (SIM->mem_wb)
+#define prog_file                     (SIM->prog_file)
 
 /***************************************************************/
-/* Pipeline Registers.                                                                                                        */
+/* Checkpoint file format                                                                                            */
 /***************************************************************/
-CPU_Pipeline_Reg IF_ID;
-CPU_Pipeline_Reg ID_EX;
-CPU_Pipeline_Reg EX_MEM;
-CPU_Pipeline_Reg MEM_WB;
-
-char prog_file[32];
+/* Little-endian 32-bit words: magic, version, both CPU states, the four
+ * latches with ISSUE_WIDTH_MAX slots each (PC, bubble, IR, pred_PC, seq, A, B, imm, ALUOutput, LMD), the counters and
+ * modes, the program extent and entry, the hazard settings and stall
+ * counters (with the pending cache freeze), the fetch sequence, the issue
+ * width, memory ports and issue counters, the mult/div units (latency,
+ * interval, free, ops, busy each) with HI/LO readiness and their stall
+ * counter, the branch bias (DECODE_BRANCH_BIAS), the program file name, the memory image written by
+ * mem_save_pages(), then the predictor and the caches as written by
+ * bpred_save() and cache_save() (I, D, L2), then dram_save(),
+ * stats_save(), ooo_save() and syscall_save(). The out-of-order window is
+ * drained before saving, so it restores empty. Decoded
+ * records are rebuilt on restore. */
+#define CKPT_MAGIC     0x4B43554D	/* "MUCK" */
+#define CKPT_VERSION  13
+#define CKPT_BUFFER   (1 << 20)	/* stdio buffer for the page stream */
 
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
 void help();
-uint32_t mem_read_32(uint32_t address);
-void mem_write_32(uint32_t address, uint32_t value);
 void cycle();
+const decoded_inst_t *fast_step();
+uint32_t fast_run(uint32_t max_instructions);
+void set_mode(int mode);
+void set_width(int width, int ports);
+void set_muldiv(int unit, uint32_t latency, uint32_t interval);
+int muldiv_unit(const decoded_inst_t *inst);
+uint32_t muldiv_start(int unit, uint32_t cycle);
+int set_ooo(uint32_t rob, uint32_t rs, uint32_t regs, uint32_t lsq, int split);
+void drain_ooo();
+int pipeline_empty();
 void run(int num_cycles);
 void runAll();
+void run_instructions(uint32_t num_instructions);
+void sample(uint32_t ff, uint32_t warm, uint32_t measure, uint32_t max_samples);
 void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
-void handle_command();
-void reset();
-void init_memory();
-void load_program();
-void handle_pipeline(); /*IMPLEMENT THIS*/
-void WB();/*IMPLEMENT THIS*/
-void MEM();/*IMPLEMENT THIS*/
-void EX();/*IMPLEMENT THIS*/
-void ID();/*IMPLEMENT THIS*/
-void IF();/*IMPLEMENT THIS*/
-void show_pipeline();/*IMPLEMENT THIS*/
+int handle_command();
+int run_script(const char *file);
+int load_memory_config(const char *file);
+void print_json(FILE *fp, const uint32_t *ranges, int num_ranges, int regs);
+int reset();
+int checkpoint(const char *file);
+int restore(const char *file);
+int load_program();
+void handle_pipeline();
+void pipeline_bubble(CPU_Pipeline_Reg *reg);
+void pipeline_clear();
+void trace_retire(const CPU_Pipeline_Reg *r, uint32_t cycle);
+void WB();
+void MEM();
+void EX();
+void ID();
+void IF();
+void show_pipeline();
 void initialize();
-void print_program(); /*IMPLEMENT THIS*/
+sim_t *sim_create();
+void sim_destroy(sim_t *s);
+void sim_select(sim_t *s);
+void print_program();
 
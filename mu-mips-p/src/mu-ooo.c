@@ -0,0 +1,735 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+static ooo_ctx_t OOO_DEFAULT;
+__thread ooo_ctx_t *OOO_CTX = &OOO_DEFAULT;
+
+#define OOO_ROB_SIZE       (OOO_CTX->rob_size)
+#define OOO_RS_SIZE          (OOO_CTX->rs_size)
+#define OOO_NUM_REGS      (OOO_CTX->num_regs)
+#define OOO_LSQ_SIZE        (OOO_CTX->lsq_size)
+#define OOO_SPLIT              (OOO_CTX->split)
+#define OOO_WINDOW         (OOO_CTX->window)
+#define OOO_CAPACITY       (OOO_CTX->capacity)
+#define OOO_HEAD              (OOO_CTX->head)
+#define OOO_IN_ROB          (OOO_CTX->in_rob)
+#define OOO_QUEUED          (OOO_CTX->queued)
+#define OOO_RS_USED         (OOO_CTX->rs_used)
+#define OOO_LSQ_USED       (OOO_CTX->lsq_used)
+#define OOO_MAP                (OOO_CTX->map)
+#define OOO_FREE_REGS     (OOO_CTX->free_regs)
+#define OOO_NUM_FREE      (OOO_CTX->num_free)
+#define OOO_REG_READY     (OOO_CTX->reg_ready)
+#define OOO_FRONT            (OOO_CTX->front)
+#define OOO_FRONT_PC      (OOO_CTX->front_pc)
+#define OOO_FETCH_RESUME (OOO_CTX->fetch_resume)
+#define OOO_FETCH_BLOCKED (OOO_CTX->fetch_blocked)
+
+#define OOO_NONE 0xFFFF	/* no physical register */
+
+/* where an instruction in the window is */
+enum {
+	OOO_IN_QUEUE,	/* fetched, waiting to dispatch */
+	OOO_IN_RS,	/* dispatched, waiting to issue */
+	OOO_EXECUTING	/* issued; done once ready has passed */
+};
+
+struct ooo_entry_struct {
+	CPU_Pipeline_Reg r;	/* as the oracle ran it: operands, result, load value, store address and data */
+	decoded_inst_t inst;	/* r.inst; a copy, since a scratch record may be reused while it is in flight */
+	uint32_t next_pc;
+	uint32_t hi, lo;	/* HI/LO once it has run */
+	uint32_t fetch_cycle;
+	uint32_t ready;	/* in the queue: cycle it may dispatch; executing: cycle its result is ready */
+	uint16_t src[3];	/* physical registers read: rs, rt, HI or LO */
+	uint16_t dst[2], prev[2];	/* physical registers written, and the mappings they replaced */
+	uint8_t arch[2];	/* architectural registers written */
+	uint8_t num_dst;
+	uint8_t size;	/* bytes a load or store accesses, 0 otherwise */
+	uint8_t pool;	/* OOO_RS_* */
+	uint8_t state;
+	uint8_t taken;
+	uint8_t mispredicted;
+};
+
+/***************************************************************/
+/* The window in age order: 0 is the oldest unretired instruction      */
+/***************************************************************/
+static inline ooo_entry_t *ooo_entry(uint32_t age)
+{
+	return &OOO_WINDOW[(OOO_HEAD + age) % OOO_CAPACITY];
+}
+
+static uint8_t ooo_size(const decoded_inst_t *inst)
+{
+	switch (inst->op) {
+		case OP_LB:
+		case OP_SB:
+			return 1;
+		case OP_LH:
+		case OP_SH:
+			return 2;
+		case OP_LW:
+		case OP_SW:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+static uint8_t ooo_pool(const decoded_inst_t *inst)
+{
+	if (!OOO_SPLIT) {
+		return OOO_RS_ALU;
+	}
+	if (inst->flags & (DEC_LOAD | DEC_STORE)) {
+		return OOO_RS_MEM;
+	}
+	return (inst->flags & DEC_HILO) ? OOO_RS_MULDIV : OOO_RS_ALU;
+}
+
+static int ooo_overlap(const ooo_entry_t *a, const ooo_entry_t *b)
+{
+	return a->r.ALUOutput < b->r.ALUOutput + b->size && b->r.ALUOutput < a->r.ALUOutput + a->size;
+}
+
+/***************************************************************/
+/* Set the core's sizes; takes effect the next time it starts, with an  */
+/* empty window. -1 if a size is out of range.                                      */
+/***************************************************************/
+int ooo_configure(uint32_t rob, uint32_t rs, uint32_t regs, uint32_t lsq, int split)
+{
+	if (rob < 1 || rob > OOO_MAX_ENTRIES || rs < 1 || rs > rob || lsq < 1 || lsq > rob ||
+		regs < OOO_ARCH_REGS + 2 || regs > OOO_MAX_REGS) {
+		error_report("Bad out-of-order core: ROB 1 to %d, stations and LSQ 1 to the ROB size, %d to %d registers\n",
+			OOO_MAX_ENTRIES, OOO_ARCH_REGS + 2, OOO_MAX_REGS);
+		return -1;
+	}
+	ooo_free();
+	OOO_ROB_SIZE = rob;
+	OOO_RS_SIZE = rs;
+	OOO_NUM_REGS = regs;
+	OOO_LSQ_SIZE = lsq;
+	OOO_SPLIT = split;
+	return 0;
+}
+
+/***************************************************************/
+/* Start with an empty window and every architectural register mapped */
+/* to itself, fetching from CURRENT_STATE.PC                                        */
+/***************************************************************/
+void ooo_start()
+{
+	uint32_t i;
+
+	if (OOO_WINDOW == NULL) {
+		OOO_CAPACITY = OOO_ROB_SIZE + OOO_FETCH_QUEUE;
+		OOO_WINDOW = calloc(OOO_CAPACITY, sizeof(ooo_entry_t));
+		OOO_FREE_REGS = malloc(OOO_NUM_REGS * sizeof(uint16_t));
+		OOO_REG_READY = malloc(OOO_NUM_REGS * sizeof(uint32_t));
+		if (OOO_WINDOW == NULL || OOO_FREE_REGS == NULL || OOO_REG_READY == NULL) {
+			error_fatal("Out of memory for the out-of-order core\n");
+		}
+	}
+	OOO_HEAD = 0;
+	OOO_IN_ROB = 0;
+	OOO_QUEUED = 0;
+	memset(OOO_RS_USED, 0, sizeof(OOO_RS_USED));
+	OOO_LSQ_USED = 0;
+	for (i = 0; i < OOO_ARCH_REGS; i++) {
+		OOO_MAP[i] = i;
+	}
+	OOO_NUM_FREE = 0;
+	for (i = OOO_NUM_REGS; i-- > OOO_ARCH_REGS;) {
+		OOO_FREE_REGS[OOO_NUM_FREE++] = i;
+	}
+	memset(OOO_REG_READY, 0, OOO_NUM_REGS * sizeof(uint32_t));
+	OOO_FETCH_RESUME = 0;
+	OOO_FETCH_BLOCKED = FALSE;
+}
+
+/***************************************************************/
+/* Nothing fetched and not yet retired                                                      */
+/***************************************************************/
+int ooo_empty()
+{
+	return OOO_WINDOW == NULL || OOO_IN_ROB + OOO_QUEUED == 0;
+}
+
+/***************************************************************/
+/* Throw away everything in flight, youngest first so each rename is   */
+/* undone, and fetch again from the architectural state                       */
+/***************************************************************/
+void ooo_squash()
+{
+	ooo_entry_t *e;
+	uint32_t i;
+	int k;
+
+	if (ooo_empty()) {
+		return;
+	}
+	for (i = OOO_IN_ROB; i-- > 0;) {
+		e = ooo_entry(i);
+		for (k = e->num_dst; k-- > 0;) {
+			OOO_MAP[e->arch[k]] = e->prev[k];
+			OOO_FREE_REGS[OOO_NUM_FREE++] = e->dst[k];
+		}
+		if (e->state == OOO_IN_RS) {
+			OOO_RS_USED[e->pool]--;
+		}
+		if (e->size > 0) {
+			OOO_LSQ_USED--;
+		}
+	}
+	OOO_IN_ROB = 0;
+	OOO_QUEUED = 0;
+	OOO_FETCH_BLOCKED = FALSE;
+	OOO_FETCH_RESUME = CYCLE_COUNT + 1;
+	OOO_CTX->squashes++;
+}
+
+/***************************************************************/
+/* What a load sees: memory, overlaid with the bytes of the older       */
+/* stores still in the window, youngest last so it wins. A store to an */
+/* unmapped address is dropped by memory, so it forwards nothing.      */
+/***************************************************************/
+static uint32_t ooo_read(const ooo_entry_t *load, uint32_t count)
+{
+	const ooo_entry_t *s;
+	uint32_t address = load->r.ALUOutput, value, offset, i, k;
+
+	switch (load->size) {
+		case 1:
+			value = mem_read_8(address);
+			break;
+		case 2:
+			value = mem_read_16(address);
+			break;
+		default:
+			value = mem_read_32(address);
+			break;
+	}
+	for (i = 0; i < count; i++) {
+		s = ooo_entry(i);
+		if (!(s->inst.flags & DEC_STORE) || !ooo_overlap(s, load) || !mem_mapped(s->r.ALUOutput)) {
+			continue;
+		}
+		for (k = 0; k < load->size; k++) {
+			offset = address + k - s->r.ALUOutput;
+			if (offset < s->size) {
+				value = (value & ~(0xFFu << (8 * k))) | (((s->r.B >> (8 * offset)) & 0xFF) << (8 * k));
+			}
+		}
+	}
+	switch (load->inst.op) {
+		case OP_LB:
+			return (int32_t)(int8_t)value;
+		case OP_LH:
+			return (int32_t)(int16_t)value;
+		default:
+			return value;
+	}
+}
+
+/***************************************************************/
+/* Fetch one word and run it through the oracle against the front      */
+/* state. Loads read through the stores in flight; stores only record  */
+/* their address and data until they retire.                                         */
+/***************************************************************/
+static ooo_entry_t *ooo_fetch_word(uint32_t pc)
+{
+	uint32_t count = OOO_IN_ROB + OOO_QUEUED, hi, lo, predicted;
+	ooo_entry_t *e = ooo_entry(count);
+	CPU_Pipeline_Reg *r = &e->r;
+
+	e->inst = *decode_fetch(pc);
+	r->PC = pc;
+	r->inst = &e->inst;
+	r->seq = ++FETCH_SEQ;
+	r->A = OOO_FRONT[e->inst.rs];
+	r->B = OOO_FRONT[e->inst.rt];
+	r->imm = e->inst.imm;
+	r->ALUOutput = 0;
+	r->LMD = 0;
+	e->size = ooo_size(&e->inst);
+
+	BRANCH_TAKEN = FALSE;
+	if (e->inst.flags & DEC_HILO) {
+		/* the handlers keep HI/LO in the CPU states */
+		hi = CURRENT_STATE.HI;
+		lo = CURRENT_STATE.LO;
+		CURRENT_STATE.HI = NEXT_STATE.HI = OOO_FRONT[OOO_HI];
+		CURRENT_STATE.LO = NEXT_STATE.LO = OOO_FRONT[OOO_LO];
+		e->inst.exec(r);
+		OOO_FRONT[OOO_HI] = NEXT_STATE.HI;
+		OOO_FRONT[OOO_LO] = NEXT_STATE.LO;
+		CURRENT_STATE.HI = NEXT_STATE.HI = hi;
+		CURRENT_STATE.LO = NEXT_STATE.LO = lo;
+	}else {
+		e->inst.exec(r);
+	}
+	if (e->inst.flags & DEC_LOAD) {
+		r->LMD = ooo_read(e, count);
+	}
+	if (e->inst.dest != 0) {
+		OOO_FRONT[e->inst.dest] = (e->inst.flags & DEC_LOAD) ? r->LMD : r->ALUOutput;
+	}
+	e->hi = OOO_FRONT[OOO_HI];
+	e->lo = OOO_FRONT[OOO_LO];
+	e->taken = BRANCH_TAKEN;
+	e->next_pc = BRANCH_TAKEN ? BRANCH_TARGET : pc + 4;
+	e->mispredicted = FALSE;
+	if (e->inst.flags & (DEC_BRANCH | DEC_JUMP)) {
+		/* trained at once, like fast mode; the penalty is charged once
+		 * the branch has executed */
+		predicted = bpred_predict(pc, &e->inst);
+		bpred_update(pc, &e->inst, BRANCH_TAKEN, BRANCH_TARGET, predicted, 0);
+		e->mispredicted = predicted != e->next_pc;
+	}
+	r->pred_PC = e->next_pc;
+	OOO_FRONT_PC = e->next_pc;
+
+	e->state = OOO_IN_QUEUE;
+	e->fetch_cycle = CYCLE_COUNT;
+	e->ready = CYCLE_COUNT + 1;
+	OOO_QUEUED++;
+	return e;
+}
+
+/***************************************************************/
+/* Fetch up to ISSUE_WIDTH words into the queue, stopping after a          */
+/* branch or jump and at an I-cache miss                                                */
+/***************************************************************/
+static void ooo_fetch()
+{
+	ooo_entry_t *e;
+	uint32_t latency;
+	int i;
+
+	if (OOO_FETCH_BLOCKED) {
+		return;
+	}
+	if (PIPELINE_DRAINING || CYCLE_COUNT < OOO_FETCH_RESUME) {
+		return;
+	}
+	if (ooo_empty()) {
+		/* pick up registers set while nothing was in flight */
+		memcpy(OOO_FRONT, CURRENT_STATE.REGS, sizeof(CURRENT_STATE.REGS));
+		OOO_FRONT[OOO_HI] = CURRENT_STATE.HI;
+		OOO_FRONT[OOO_LO] = CURRENT_STATE.LO;
+		OOO_FRONT_PC = CURRENT_STATE.PC;
+	}
+	for (i = 0; i < ISSUE_WIDTH && OOO_QUEUED < OOO_FETCH_QUEUE; i++) {
+		e = ooo_fetch_word(OOO_FRONT_PC);
+		if (ICACHE.enabled) {
+			latency = cache_access(&ICACHE, e->r.PC, FALSE, CYCLE_COUNT);
+			if (latency > 1) {
+				STALL_ICACHE += latency - 1;
+				e->ready += latency - 1;
+				OOO_FETCH_RESUME = CYCLE_COUNT + latency;
+			}
+		}
+		if (e->mispredicted || e->inst.op == OP_SYSCALL) {
+			/* a SYSCALL's effects are not in the front state until it retires */
+			OOO_FETCH_BLOCKED = TRUE;
+			break;
+		}
+		if ((e->inst.flags & (DEC_BRANCH | DEC_JUMP)) || CYCLE_COUNT < OOO_FETCH_RESUME) {
+			break;
+		}
+	}
+}
+
+/***************************************************************/
+/* Dispatch in order: rename, then take a ROB entry, a station and an  */
+/* LSQ entry. The first resource missing stalls dispatch and is counted. */
+/***************************************************************/
+static void ooo_dispatch()
+{
+	ooo_entry_t *e;
+	const decoded_inst_t *inst;
+	uint8_t arch[2];
+	uint32_t *stall;
+	int i, k, num_dst;
+
+	for (i = 0; i < ISSUE_WIDTH && OOO_QUEUED > 0; i++) {
+		e = ooo_entry(OOO_IN_ROB);
+		inst = &e->inst;
+		if (e->ready > CYCLE_COUNT) {
+			break;
+		}
+		num_dst = 0;
+		if (inst->dest != 0) {
+			arch[num_dst++] = inst->dest;
+		}
+		if (inst->op == OP_MULT || inst->op == OP_MULTU || inst->op == OP_DIV || inst->op == OP_DIVU) {
+			arch[num_dst++] = OOO_HI;
+			arch[num_dst++] = OOO_LO;
+		}else if (inst->op == OP_MTHI) {
+			arch[num_dst++] = OOO_HI;
+		}else if (inst->op == OP_MTLO) {
+			arch[num_dst++] = OOO_LO;
+		}
+		e->pool = ooo_pool(inst);
+
+		stall = NULL;
+		if (OOO_IN_ROB == OOO_ROB_SIZE) {
+			stall = &OOO_CTX->rob_full;
+		}else if (OOO_RS_USED[e->pool] == OOO_RS_SIZE) {
+			stall = &OOO_CTX->rs_full;
+		}else if (OOO_NUM_FREE < (uint32_t)num_dst) {
+			stall = &OOO_CTX->regs_full;
+		}else if (e->size > 0 && OOO_LSQ_USED == OOO_LSQ_SIZE) {
+			stall = &OOO_CTX->lsq_full;
+		}
+		if (stall != NULL) {
+			(*stall)++;
+			break;
+		}
+
+		/* sources before destinations: an instruction reads the
+		 * producers ahead of it */
+		e->src[0] = (inst->flags & DEC_READS_RS) ? OOO_MAP[inst->rs] : OOO_NONE;
+		e->src[1] = (inst->flags & DEC_READS_RT) ? OOO_MAP[inst->rt] : OOO_NONE;
+		e->src[2] = inst->op == OP_MFHI ? OOO_MAP[OOO_HI] : inst->op == OP_MFLO ? OOO_MAP[OOO_LO] : OOO_NONE;
+		for (k = 0; k < num_dst; k++) {
+			e->arch[k] = arch[k];
+			e->prev[k] = OOO_MAP[arch[k]];
+			e->dst[k] = OOO_FREE_REGS[--OOO_NUM_FREE];
+			OOO_REG_READY[e->dst[k]] = UINT32_MAX;
+			OOO_MAP[arch[k]] = e->dst[k];
+		}
+		e->num_dst = num_dst;
+
+		e->state = OOO_IN_RS;
+		OOO_RS_USED[e->pool]++;
+		if (e->size > 0) {
+			OOO_LSQ_USED++;
+		}
+		OOO_IN_ROB++;
+		OOO_QUEUED--;
+	}
+}
+
+/***************************************************************/
+/* Cycles a load takes, 0 if it must wait: until every older store     */
+/* has issued, and until one it overlaps has its data                             */
+/***************************************************************/
+static uint32_t ooo_load_latency(uint32_t age, const ooo_entry_t *load)
+{
+	const ooo_entry_t *s;
+	int forwarded = FALSE;
+	uint32_t i;
+
+	for (i = 0; i < age; i++) {
+		s = ooo_entry(i);
+		if (!(s->inst.flags & DEC_STORE)) {
+			continue;
+		}
+		if (s->state != OOO_EXECUTING) {
+			return 0;
+		}
+		if (ooo_overlap(s, load)) {
+			if (s->ready > CYCLE_COUNT) {
+				return 0;
+			}
+			forwarded = TRUE;
+		}
+	}
+	if (forwarded) {
+		OOO_CTX->forwarded++;
+		return 1;
+	}
+	return DCACHE.enabled ? cache_access(&DCACHE, load->r.ALUOutput, FALSE, CYCLE_COUNT) : 1;
+}
+
+/***************************************************************/
+/* Issue the oldest ready instructions: ISSUE_WIDTH a cycle, MEM_PORTS  */
+/* loads and stores, one mult/div unit operation                                 */
+/***************************************************************/
+static void ooo_issue()
+{
+	ooo_entry_t *e;
+	uint32_t i, latency, resume;
+	int k, issued = 0, mem_ops = 0, hilo_ops = 0, ready, unit;
+
+	for (i = 0; i < OOO_IN_ROB && issued < ISSUE_WIDTH; i++) {
+		e = ooo_entry(i);
+		if (e->state != OOO_IN_RS) {
+			continue;
+		}
+		ready = TRUE;
+		for (k = 0; k < 3; k++) {
+			if (e->src[k] != OOO_NONE && OOO_REG_READY[e->src[k]] > CYCLE_COUNT) {
+				ready = FALSE;
+			}
+		}
+		if (!ready) {
+			continue;
+		}
+		if (e->size > 0 && mem_ops == MEM_PORTS) {
+			continue;
+		}
+		if ((e->inst.flags & DEC_HILO) && hilo_ops > 0) {
+			continue;
+		}
+		unit = muldiv_unit(&e->inst);
+		if (unit >= 0 && CYCLE_COUNT < MULDIV[unit].free) {
+			continue;
+		}
+		latency = 1;
+		if (unit >= 0) {
+			latency = muldiv_start(unit, CYCLE_COUNT);
+		}else if (e->inst.flags & DEC_LOAD) {
+			latency = ooo_load_latency(i, e);
+			if (latency == 0) {
+				continue;
+			}
+		}
+
+		e->state = OOO_EXECUTING;
+		e->ready = CYCLE_COUNT + latency;
+		for (k = 0; k < e->num_dst; k++) {
+			OOO_REG_READY[e->dst[k]] = e->ready;
+		}
+		OOO_RS_USED[e->pool]--;
+		issued++;
+		mem_ops += e->size > 0;
+		hilo_ops += (e->inst.flags & DEC_HILO) != 0;
+
+		if (e->mispredicted) {
+			/* fetch restarts down the right path once it has executed */
+			resume = e->ready + OOO_REDIRECT;
+			if (resume > OOO_FETCH_RESUME) {
+				OOO_FETCH_RESUME = resume;
+			}
+			OOO_FETCH_BLOCKED = FALSE;
+			BPRED_STATS.penalty += resume - e->fetch_cycle - 1;
+			OOO_CTX->mispredict_wait += resume - e->fetch_cycle - 1;
+		}
+	}
+}
+
+/***************************************************************/
+/* Retire in order: only here do registers, HI/LO, memory and the PC  */
+/* change. A store into text squashes everything behind it.                  */
+/***************************************************************/
+static void ooo_retire()
+{
+	ooo_entry_t *e;
+	const decoded_inst_t *inst;
+	uint32_t generation;
+	int i, k;
+
+	for (i = 0; i < ISSUE_WIDTH && OOO_IN_ROB > 0; i++) {
+		e = ooo_entry(0);
+		inst = &e->inst;
+		if (e->state != OOO_EXECUTING || e->ready > CYCLE_COUNT) {
+			break;
+		}
+		generation = DECODE_GENERATION;
+		if (inst->flags & DEC_STORE) {
+			inst->mem(&e->r);
+			if (DCACHE.enabled) {
+				/* drains from the LSQ; nothing waits on it */
+				cache_access(&DCACHE, e->r.ALUOutput, TRUE, CYCLE_COUNT);
+			}
+		}
+		if (inst->dest != 0) {
+			CURRENT_STATE.REGS[inst->dest] = (inst->flags & DEC_LOAD) ? e->r.LMD : e->r.ALUOutput;
+		}
+		CURRENT_STATE.HI = e->hi;
+		CURRENT_STATE.LO = e->lo;
+		CURRENT_STATE.PC = e->next_pc;
+		if (inst->op == OP_SYSCALL) {
+			/* the window behind it is empty; fetch picks up what it leaves */
+			syscall_run(e->r.PC, CURRENT_STATE.REGS);
+			SYSCALL_HELD += CYCLE_COUNT - e->fetch_cycle - 1;
+			OOO_FETCH_BLOCKED = !RUN_FLAG;
+		}
+		NEXT_STATE = CURRENT_STATE;
+		for (k = 0; k < e->num_dst; k++) {
+			OOO_FREE_REGS[OOO_NUM_FREE++] = e->prev[k];
+		}
+		if (e->size > 0) {
+			OOO_LSQ_USED--;
+		}
+		if (e->taken && (inst->flags & DEC_BRANCH)) {
+			STATS_TAKEN++;
+		}
+		if (TRACE_ON) {
+			trace_retire(&e->r, CYCLE_COUNT);
+		}
+		stats_retire(e->r.PC, inst, e->r.ALUOutput, CYCLE_COUNT + 1);
+		INSTRUCTION_COUNT++;
+		OOO_HEAD = (OOO_HEAD + 1) % OOO_CAPACITY;
+		OOO_IN_ROB--;
+		if (DECODE_GENERATION != generation) {
+			/* what was fetched behind the store may be stale */
+			ooo_squash();
+			break;
+		}
+	}
+}
+
+/***************************************************************/
+/* One cycle of the core, stages back to front so each sees what the  */
+/* ones ahead of it left last cycle                                                          */
+/***************************************************************/
+void ooo_cycle()
+{
+	int i;
+
+	ooo_retire();
+	ooo_issue();
+	ooo_dispatch();
+	ooo_fetch();
+
+	OOO_CTX->cycles++;
+	OOO_CTX->rob_occupancy += OOO_IN_ROB;
+	for (i = 0; i < OOO_RS_POOLS; i++) {
+		OOO_CTX->rs_occupancy += OOO_RS_USED[i];
+	}
+	OOO_CTX->lsq_occupancy += OOO_LSQ_USED;
+}
+
+/***************************************************************/
+/* Clear the statistics                                                                                 */
+/***************************************************************/
+void ooo_reset_stats()
+{
+	OOO_CTX->cycles = 0;
+	OOO_CTX->rob_occupancy = 0;
+	OOO_CTX->rs_occupancy = 0;
+	OOO_CTX->lsq_occupancy = 0;
+	OOO_CTX->rob_full = 0;
+	OOO_CTX->rs_full = 0;
+	OOO_CTX->regs_full = 0;
+	OOO_CTX->lsq_full = 0;
+	OOO_CTX->mispredict_wait = 0;
+	OOO_CTX->forwarded = 0;
+	OOO_CTX->squashes = 0;
+}
+
+void ooo_register_counters()
+{
+	stats_register("ooo.cycles", &OOO_CTX->cycles);
+	stats_register("ooo.rob_full", &OOO_CTX->rob_full);
+	stats_register("ooo.rs_full", &OOO_CTX->rs_full);
+	stats_register("ooo.regs_full", &OOO_CTX->regs_full);
+	stats_register("ooo.lsq_full", &OOO_CTX->lsq_full);
+	stats_register("ooo.mispredict_wait", &OOO_CTX->mispredict_wait);
+	stats_register("ooo.forwarded", &OOO_CTX->forwarded);
+	stats_register("ooo.squashes", &OOO_CTX->squashes);
+}
+
+/***************************************************************/
+/* Report occupancy and why dispatch stalled, once the core has run     */
+/***************************************************************/
+void ooo_print()
+{
+	double cycles = OOO_CTX->cycles;
+
+	if (OOO_CTX->cycles == 0) {
+		return;
+	}
+	printf("# Out-of-order (ROB %u, RS %u %s, %u registers, LSQ %u)\t: %u cycles, occupancy ROB %.2f, RS %.2f, LSQ %.2f\n",
+		OOO_ROB_SIZE, OOO_RS_SIZE, OOO_SPLIT ? "split" : "unified", OOO_NUM_REGS, OOO_LSQ_SIZE, OOO_CTX->cycles,
+		OOO_CTX->rob_occupancy / cycles, OOO_CTX->rs_occupancy / cycles, OOO_CTX->lsq_occupancy / cycles);
+	printf("# Out-of-order stalls\t: dispatch ROB %u, RS %u, registers %u, LSQ %u; fetch on mispredicts %u; %u loads forwarded, %u squashes\n",
+		OOO_CTX->rob_full, OOO_CTX->rs_full, OOO_CTX->regs_full, OOO_CTX->lsq_full,
+		OOO_CTX->mispredict_wait, OOO_CTX->forwarded, OOO_CTX->squashes);
+}
+
+void ooo_print_json(FILE *fp)
+{
+	double cycles = OOO_CTX->cycles;
+
+	if (OOO_CTX->cycles == 0) {
+		fprintf(fp, "null");
+		return;
+	}
+	fprintf(fp, "{ \"rob\": %u, \"rs\": %u, \"split\": %s, \"regs\": %u, \"lsq\": %u, \"cycles\": %u, "
+		"\"occupancy\": { \"rob\": %.4f, \"rs\": %.4f, \"lsq\": %.4f }, "
+		"\"stalls\": { \"rob_full\": %u, \"rs_full\": %u, \"regs_full\": %u, \"lsq_full\": %u, \"mispredict\": %u }, "
+		"\"forwarded\": %u, \"squashes\": %u }",
+		OOO_ROB_SIZE, OOO_RS_SIZE, OOO_SPLIT ? "true" : "false", OOO_NUM_REGS, OOO_LSQ_SIZE, OOO_CTX->cycles,
+		OOO_CTX->rob_occupancy / cycles, OOO_CTX->rs_occupancy / cycles, OOO_CTX->lsq_occupancy / cycles,
+		OOO_CTX->rob_full, OOO_CTX->rs_full, OOO_CTX->regs_full, OOO_CTX->lsq_full, OOO_CTX->mispredict_wait,
+		OOO_CTX->forwarded, OOO_CTX->squashes);
+}
+
+/***************************************************************/
+/* Checkpoint the configuration and counters as little-endian words;    */
+/* the window is always empty by then                                                      */
+/***************************************************************/
+void ooo_save(FILE *fp)
+{
+	ckpt_put(fp, OOO_ROB_SIZE);
+	ckpt_put(fp, OOO_RS_SIZE);
+	ckpt_put(fp, OOO_NUM_REGS);
+	ckpt_put(fp, OOO_LSQ_SIZE);
+	ckpt_put(fp, OOO_SPLIT);
+	ckpt_put(fp, OOO_CTX->cycles);
+	ckpt_put64(fp, OOO_CTX->rob_occupancy);
+	ckpt_put64(fp, OOO_CTX->rs_occupancy);
+	ckpt_put64(fp, OOO_CTX->lsq_occupancy);
+	ckpt_put(fp, OOO_CTX->rob_full);
+	ckpt_put(fp, OOO_CTX->rs_full);
+	ckpt_put(fp, OOO_CTX->regs_full);
+	ckpt_put(fp, OOO_CTX->lsq_full);
+	ckpt_put(fp, OOO_CTX->mispredict_wait);
+	ckpt_put(fp, OOO_CTX->forwarded);
+	ckpt_put(fp, OOO_CTX->squashes);
+}
+
+/***************************************************************/
+/* Restore what ooo_save() wrote; -1 if the file is short or the sizes  */
+/* are out of range. The window starts empty.                                       */
+/***************************************************************/
+int ooo_load(FILE *fp)
+{
+	uint32_t rob, rs, regs, lsq, split;
+	int ok = 1;
+
+	rob = ckpt_get(fp, &ok);
+	rs = ckpt_get(fp, &ok);
+	regs = ckpt_get(fp, &ok);
+	lsq = ckpt_get(fp, &ok);
+	split = ckpt_get(fp, &ok);
+	if (!ok || ooo_configure(rob, rs, regs, lsq, split != 0) != 0) {
+		return -1;
+	}
+	OOO_CTX->cycles = ckpt_get(fp, &ok);
+	OOO_CTX->rob_occupancy = ckpt_get64(fp, &ok);
+	OOO_CTX->rs_occupancy = ckpt_get64(fp, &ok);
+	OOO_CTX->lsq_occupancy = ckpt_get64(fp, &ok);
+	OOO_CTX->rob_full = ckpt_get(fp, &ok);
+	OOO_CTX->rs_full = ckpt_get(fp, &ok);
+	OOO_CTX->regs_full = ckpt_get(fp, &ok);
+	OOO_CTX->lsq_full = ckpt_get(fp, &ok);
+	OOO_CTX->mispredict_wait = ckpt_get(fp, &ok);
+	OOO_CTX->forwarded = ckpt_get(fp, &ok);
+	OOO_CTX->squashes = ckpt_get(fp, &ok);
+	return ok ? 0 : -1;
+}
+
+/***************************************************************/
+/* Release the window and register file                                                   */
+/***************************************************************/
+void ooo_free()
+{
+	free(OOO_WINDOW);
+	free(OOO_FREE_REGS);
+	free(OOO_REG_READY);
+	OOO_WINDOW = NULL;
+	OOO_FREE_REGS = NULL;
+	OOO_REG_READY = NULL;
+	OOO_IN_ROB = 0;
+	OOO_QUEUED = 0;
+}
@@ -0,0 +1,113 @@
+#ifndef MU_OOO_H
+#define MU_OOO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Out-of-order core                                                                                                                                */
+/******************************************************************************/
+/* MODE_OOO times the program on an out-of-order core instead of the
+ * five-stage pipeline. It is driven by the functional oracle: as IF
+ * fetches a word, the EX handlers run it at once against the state the
+ * instructions fetched before it leave behind (the front state), so every
+ * in-flight instruction knows its operands, address, result and next PC.
+ * The timing model then moves it through:
+ *   fetch    ISSUE_WIDTH words a cycle into a fetch queue, stopping after a
+ *            branch or jump; a mispredicted one stops fetch until it has
+ *            executed (no wrong path is fetched), a SYSCALL until it has
+ *            retired;
+ *   dispatch in order, renaming its registers (the 32 GPRs, HI and LO) onto
+ *            the physical register file and taking a ROB entry, a
+ *            reservation station and, for loads and stores, an LSQ entry;
+ *   issue    oldest ready first, ISSUE_WIDTH a cycle, at most MEM_PORTS
+ *            loads and stores and one mult/div unit operation; MULT and
+ *            DIV take their unit's latency and interval (MULDIV);
+ *   retire   in order, ISSUE_WIDTH a cycle, once executed.
+ * Retirement is precise: registers, HI/LO and memory change only as
+ * instructions retire. Stores wait in the LSQ until then, and a load
+ * takes its bytes from older stores still there (store-to-load
+ * forwarding), in the oracle and in the timing: it issues once every
+ * older store has, and skips the D-cache if one of them supplies it. A
+ * store into text squashes everything behind it and fetch starts again.
+ *
+ * The reservation stations are one unified pool of rs entries, or split
+ * into rs each for the ALU, memory and mult/div units. */
+#define OOO_ARCH_REGS 34	/* GPRs, then HI and LO */
+#define OOO_HI 32
+#define OOO_LO 33
+#define OOO_FETCH_QUEUE 16	/* fetched words waiting to dispatch */
+#define OOO_REDIRECT       1	/* cycles after a mispredict executes before fetch resumes */
+#define OOO_MAX_ENTRIES 1024	/* largest ROB, stations, LSQ */
+#define OOO_MAX_REGS     4096	/* largest physical register file */
+
+/* configuration until the ooo command changes it */
+#define OOO_ROB    64
+#define OOO_RS     32
+#define OOO_REGS  96
+#define OOO_LSQ    32
+
+enum {
+	OOO_RS_ALU, OOO_RS_MEM, OOO_RS_MULDIV,
+	OOO_RS_POOLS
+};
+
+typedef struct ooo_entry_struct ooo_entry_t;
+
+/* one simulator instance's core; OOO_CTX is per thread, like MEM_CTX.
+ * Nothing is allocated until the mode is first selected. */
+typedef struct {
+	/* configuration */
+	uint32_t rob_size, rs_size, num_regs, lsq_size;
+	int split;	/* one station per unit instead of a unified pool */
+
+	/* the window: fetched instructions from the oldest unretired one,
+	 * ROB entries first, then the fetch queue */
+	ooo_entry_t *window;
+	uint32_t capacity;	/* rob_size + OOO_FETCH_QUEUE */
+	uint32_t head;	/* oldest instruction */
+	uint32_t in_rob;	/* dispatched and not yet retired */
+	uint32_t queued;	/* in the fetch queue */
+	uint32_t rs_used[OOO_RS_POOLS];
+	uint32_t lsq_used;
+
+	/* register renaming */
+	uint16_t map[OOO_ARCH_REGS];	/* physical register of each architectural one */
+	uint16_t *free_regs;	/* stack of free physical registers */
+	uint32_t num_free;
+	uint32_t *reg_ready;	/* cycle each physical register's value is ready */
+
+	/* the front end */
+	uint32_t front[OOO_ARCH_REGS];	/* registers as the oracle left them */
+	uint32_t front_pc;	/* next word to fetch */
+	uint32_t fetch_resume;	/* fetch waits until this cycle (I-cache miss, redirect) */
+	int fetch_blocked;	/* waiting for a mispredicted branch to execute */
+
+	/* statistics */
+	uint32_t cycles;	/* cycles simulated in this mode */
+	uint64_t rob_occupancy, rs_occupancy, lsq_occupancy;	/* summed every cycle */
+	uint32_t rob_full, rs_full, regs_full, lsq_full;	/* dispatch stalled, by first cause */
+	uint32_t mispredict_wait;	/* cycles fetch waited on a mispredicted branch */
+	uint32_t forwarded;	/* loads satisfied from the LSQ */
+	uint32_t squashes;	/* window flushes: stores into text, registers set from outside */
+} ooo_ctx_t;
+
+extern __thread ooo_ctx_t *OOO_CTX;
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int ooo_configure(uint32_t rob, uint32_t rs, uint32_t regs, uint32_t lsq, int split);
+void ooo_start();
+void ooo_cycle();
+int ooo_empty();
+void ooo_squash();
+void ooo_reset_stats();
+void ooo_register_counters();
+void ooo_print();
+void ooo_print_json(FILE *fp);
+void ooo_save(FILE *fp);
+int ooo_load(FILE *fp);
+void ooo_free();
+
+#endif
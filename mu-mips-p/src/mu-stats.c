@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-decode.h"
+#include "mu-disasm.h"
+#include "mu-stats.h"
+
+static stats_ctx_t STATS_DEFAULT;
+__thread stats_ctx_t *STATS_CTX = &STATS_DEFAULT;
+
+const char *STATS_CLASS_NAMES[] = { "alu", "muldiv", "load", "store", "branch", "jump", "syscall", "other" };
+const char *STATS_REGION_NAMES[] = { "text", "data", "stack", "kernel", "unmapped" };
+
+#define STATS_COUNTERS        (STATS_CTX->counters)
+#define STATS_NUM_COUNTERS (STATS_CTX->num_counters)
+
+/***************************************************************/
+/* Build the class table and register the counters kept here             */
+/***************************************************************/
+void stats_init()
+{
+	char (*names)[24] = STATS_CTX->names;
+	int op, i;
+
+	for (op = 0; op < OP_COUNT; op++) {
+		if (op == OP_INVALID) {
+			STATS_CLASS_OF[op] = STATS_OTHER;
+		}else if (op >= OP_MULT && op <= OP_DIVU) {
+			STATS_CLASS_OF[op] = STATS_MULDIV;
+		}else if (op == OP_SYSCALL) {
+			STATS_CLASS_OF[op] = STATS_SYSCALL;
+		}else if (op == OP_JR || op == OP_JALR || op == OP_J || op == OP_JAL) {
+			STATS_CLASS_OF[op] = STATS_JUMP;
+		}else if ((op >= OP_BLTZ && op <= OP_BGEZ) || (op >= OP_BEQ && op <= OP_BGTZ)) {
+			STATS_CLASS_OF[op] = STATS_BRANCH;
+		}else if (op >= OP_LB && op <= OP_LW) {
+			STATS_CLASS_OF[op] = STATS_LOAD;
+		}else if (op >= OP_SB && op <= OP_SW) {
+			STATS_CLASS_OF[op] = STATS_STORE;
+		}else {
+			STATS_CLASS_OF[op] = STATS_ALU;
+		}
+	}
+	if (STATS_NUM_COUNTERS > 0) {
+		return;
+	}
+	for (i = 0; i < STATS_CLASSES; i++) {
+		snprintf(names[i], sizeof(names[i]), "retired.%s", STATS_CLASS_NAMES[i]);
+		stats_register(names[i], &STATS_RETIRED[i]);
+	}
+	stats_register("branches.taken", &STATS_TAKEN);
+	for (i = 0; i < STATS_REGIONS; i++) {
+		snprintf(names[STATS_CLASSES + i], sizeof(names[0]), "memory.%s", STATS_REGION_NAMES[i]);
+		stats_register(names[STATS_CLASSES + i], &STATS_MEMORY[i]);
+	}
+}
+
+/***************************************************************/
+/* Add a counter to the registry; name must outlive the instance       */
+/***************************************************************/
+void stats_register(const char *name, const uint32_t *value)
+{
+	if (STATS_NUM_COUNTERS == STATS_MAX_COUNTERS) {
+		error_fatal("More than %d counters registered\n", STATS_MAX_COUNTERS);
+	}
+	STATS_COUNTERS[STATS_NUM_COUNTERS].name = name;
+	STATS_COUNTERS[STATS_NUM_COUNTERS].value = value;
+	STATS_NUM_COUNTERS++;
+}
+
+/***************************************************************/
+/* Value of the counter registered as name; -1 if there is none        */
+/***************************************************************/
+int stats_find(const char *name, uint32_t *value)
+{
+	int i;
+
+	for (i = 0; i < STATS_NUM_COUNTERS; i++) {
+		if (strcmp(STATS_COUNTERS[i].name, name) == 0) {
+			*value = *STATS_COUNTERS[i].value;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/***************************************************************/
+/* Number of registered counters and the name of the i-th; NULL       */
+/* when i is out of range                                                                            */
+/***************************************************************/
+int stats_counters()
+{
+	return STATS_NUM_COUNTERS;
+}
+
+const char *stats_counter_name(int i)
+{
+	return i >= 0 && i < STATS_NUM_COUNTERS ? STATS_COUNTERS[i].name : NULL;
+}
+
+/***************************************************************/
+/* Profile the words words of text at base, starting from zero              */
+/***************************************************************/
+void stats_profile(uint32_t base, uint32_t words)
+{
+	free(STATS_PROFILE);
+	STATS_PROFILE_BASE = base;
+	STATS_PROFILE_WORDS = words;
+	STATS_PROFILE = calloc(words > 0 ? words : 1, sizeof(stats_profile_t));
+	if (STATS_PROFILE == NULL) {
+		error_fatal("Out of memory allocating a %u word profile\n", words);
+	}
+}
+
+/***************************************************************/
+/* Clear the counters kept here and the profile                                     */
+/***************************************************************/
+void stats_reset()
+{
+	memset(STATS_RETIRED, 0, sizeof(STATS_RETIRED));
+	memset(STATS_MEMORY, 0, sizeof(STATS_MEMORY));
+	STATS_TAKEN = 0;
+	STATS_LAST_RETIRE = 0;
+	if (STATS_PROFILE != NULL) {
+		memset(STATS_PROFILE, 0, STATS_PROFILE_WORDS * sizeof(stats_profile_t));
+	}
+}
+
+/***************************************************************/
+/* Every registered counter, then the STATS_TOP words of text that     */
+/* were charged the most cycles                                                                */
+/***************************************************************/
+void stats_print()
+{
+	uint32_t top[STATS_TOP], i, total = 0;
+	int n = 0, j, k;
+	decoded_inst_t d;
+	char text[DISASM_LEN];
+
+	printf("-------------------------------------\n");
+	printf("Performance Counters\n");
+	printf("-------------------------------------\n");
+	for (j = 0; j < STATS_NUM_COUNTERS; j++) {
+		printf("%-20s\t: %u\n", STATS_COUNTERS[j].name, *STATS_COUNTERS[j].value);
+	}
+
+	for (i = 0; i < STATS_PROFILE_WORDS; i++) {
+		total += STATS_PROFILE[i].cycles;
+		if (STATS_PROFILE[i].count == 0) {
+			continue;
+		}
+		/* insertion into the top list, most cycles first */
+		if (n < STATS_TOP) {
+			k = n++;
+		}else if (STATS_PROFILE[top[STATS_TOP - 1]].cycles < STATS_PROFILE[i].cycles) {
+			k = STATS_TOP - 1;
+		}else {
+			continue;
+		}
+		for (; k > 0 && STATS_PROFILE[top[k - 1]].cycles < STATS_PROFILE[i].cycles; k--) {
+			top[k] = top[k - 1];
+		}
+		top[k] = i;
+	}
+	printf("-------------------------------------\n");
+	printf("[PC]\t\t[Executed]\t[Cycles]\t[Share]\t[Instruction]\n");
+	printf("-------------------------------------\n");
+	for (j = 0; j < n; j++) {
+		i = top[j];
+		decode_inst(mem_read_32(STATS_PROFILE_BASE + 4 * i), &d);
+		disasm(&d, STATS_PROFILE_BASE + 4 * i, NULL, text, sizeof(text));
+		printf("0x%08x\t%u\t\t%u\t\t%.2f%%\t%s\n", STATS_PROFILE_BASE + 4 * i, STATS_PROFILE[i].count,
+			STATS_PROFILE[i].cycles, total > 0 ? 100.0 * STATS_PROFILE[i].cycles / total : 0.0, text);
+	}
+	printf("-------------------------------------\n");
+}
+
+/***************************************************************/
+/* "counters" and "profile" members of the JSON result; the profile    */
+/* lists every word of text that retired, as [pc, count, cycles]            */
+/***************************************************************/
+void stats_print_json(FILE *fp)
+{
+	uint32_t i;
+	int j, first = 1;
+
+	fprintf(fp, "\t\"counters\": {");
+	for (j = 0; j < STATS_NUM_COUNTERS; j++) {
+		fprintf(fp, "%s \"%s\": %u", j > 0 ? "," : "", STATS_COUNTERS[j].name, *STATS_COUNTERS[j].value);
+	}
+	fprintf(fp, " },\n\t\"profile\": [");
+	for (i = 0; i < STATS_PROFILE_WORDS; i++) {
+		if (STATS_PROFILE[i].count > 0) {
+			fprintf(fp, "%s\n\t\t[%u, %u, %u]", first ? "" : ",", STATS_PROFILE_BASE + 4 * i,
+				STATS_PROFILE[i].count, STATS_PROFILE[i].cycles);
+			first = 0;
+		}
+	}
+	fprintf(fp, "%s]", first ? "" : "\n\t");
+}
+
+/***************************************************************/
+/* Checkpoint the counters kept here and the profile                            */
+/***************************************************************/
+void stats_save(FILE *fp)
+{
+	uint32_t i;
+
+	for (i = 0; i < STATS_CLASSES; i++) {
+		ckpt_put(fp, STATS_RETIRED[i]);
+	}
+	for (i = 0; i < STATS_REGIONS; i++) {
+		ckpt_put(fp, STATS_MEMORY[i]);
+	}
+	ckpt_put(fp, STATS_TAKEN);
+	ckpt_put(fp, STATS_LAST_RETIRE);
+	ckpt_put(fp, STATS_PROFILE_BASE);
+	ckpt_put(fp, STATS_PROFILE_WORDS);
+	for (i = 0; i < STATS_PROFILE_WORDS; i++) {
+		ckpt_put(fp, STATS_PROFILE[i].count);
+		ckpt_put(fp, STATS_PROFILE[i].cycles);
+	}
+}
+
+/***************************************************************/
+/* Restore what stats_save() wrote; -1 if the file is short                    */
+/***************************************************************/
+int stats_load(FILE *fp)
+{
+	uint32_t i, base, words;
+	int ok = 1;
+
+	for (i = 0; i < STATS_CLASSES; i++) {
+		STATS_RETIRED[i] = ckpt_get(fp, &ok);
+	}
+	for (i = 0; i < STATS_REGIONS; i++) {
+		STATS_MEMORY[i] = ckpt_get(fp, &ok);
+	}
+	STATS_TAKEN = ckpt_get(fp, &ok);
+	STATS_LAST_RETIRE = ckpt_get(fp, &ok);
+	base = ckpt_get(fp, &ok);
+	words = ckpt_get(fp, &ok);
+	if (!ok || words > (MEM_TEXT_END - MEM_TEXT_BEGIN + 1) / 4) {
+		return -1;
+	}
+	stats_profile(base, words);
+	for (i = 0; i < words; i++) {
+		STATS_PROFILE[i].count = ckpt_get(fp, &ok);
+		STATS_PROFILE[i].cycles = ckpt_get(fp, &ok);
+	}
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,138 @@
+#ifndef MU_STATS_H
+#define MU_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-mem.h"
+#include "mu-decode.h"
+
+/******************************************************************************/
+/* Performance counters                                                                                                                            */
+/******************************************************************************/
+/* A registry of named 32-bit counters. Modules register the counters they
+ * already keep (stall cycles, cache misses, ...) once at start-up, and the
+ * stats command and the JSON result print whatever is registered. Counting
+ * retired instructions is done here: stats_retire() bumps the class and
+ * memory region counters and a per-PC profile of the loaded text, charging
+ * each instruction the cycles since the previous one retired. */
+#define STATS_MAX_COUNTERS 64
+#define STATS_TOP 10	/* hot spots the stats command lists */
+
+enum {
+	STATS_ALU, STATS_MULDIV, STATS_LOAD, STATS_STORE, STATS_BRANCH, STATS_JUMP, STATS_SYSCALL, STATS_OTHER,
+	STATS_CLASSES
+};
+
+enum {
+	STATS_TEXT, STATS_DATA, STATS_STACK, STATS_KERNEL, STATS_UNMAPPED,
+	STATS_REGIONS
+};
+
+/* accesses this close below the top of the stack count as stack */
+#define STATS_STACK_SPAN (8 << 20)
+
+typedef struct {
+	const char *name;
+	const uint32_t *value;
+} stats_counter_t;
+
+typedef struct {
+	uint32_t count;	/* times retired */
+	uint32_t cycles;	/* cycles charged */
+} stats_profile_t;
+
+/* one simulator instance's registry and counters; STATS_CTX is per
+ * thread, like MEM_CTX */
+typedef struct {
+	uint32_t retired[STATS_CLASSES];
+	uint32_t memory[STATS_REGIONS];
+	uint32_t taken;	/* conditional branches taken */
+	uint32_t last_retire;	/* cycle count when the last instruction retired */
+	uint8_t class_of[OP_COUNT];
+	stats_profile_t *profile;	/* one entry per text word */
+	uint32_t profile_base, profile_words;
+	stats_counter_t counters[STATS_MAX_COUNTERS];
+	int num_counters;
+	char names[STATS_CLASSES + STATS_REGIONS][24];	/* of the counters kept here */
+} stats_ctx_t;
+
+extern __thread stats_ctx_t *STATS_CTX;
+extern const char *STATS_CLASS_NAMES[];
+extern const char *STATS_REGION_NAMES[];
+
+#define STATS_RETIRED             (STATS_CTX->retired)
+#define STATS_MEMORY             (STATS_CTX->memory)
+#define STATS_TAKEN                 (STATS_CTX->taken)
+#define STATS_LAST_RETIRE      (STATS_CTX->last_retire)
+#define STATS_CLASS_OF           (STATS_CTX->class_of)
+#define STATS_PROFILE             (STATS_CTX->profile)
+#define STATS_PROFILE_BASE   (STATS_CTX->profile_base)
+#define STATS_PROFILE_WORDS (STATS_CTX->profile_words)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void stats_init();
+void stats_register(const char *name, const uint32_t *value);
+int stats_find(const char *name, uint32_t *value);
+int stats_counters();
+const char *stats_counter_name(int i);
+void stats_profile(uint32_t base, uint32_t words);
+void stats_reset();
+void stats_print();
+void stats_print_json(FILE *fp);
+void stats_save(FILE *fp);
+int stats_load(FILE *fp);
+
+static inline int stats_region(uint32_t address)
+{
+	if (address >= MEM_TEXT_BEGIN && address < MEM_DATA_BEGIN) {
+		return address < 0x10000000 ? STATS_TEXT : STATS_DATA;
+	}
+	if (address >= MEM_DATA_BEGIN && address <= MEM_STACK_BEGIN) {
+		return address > MEM_STACK_BEGIN - STATS_STACK_SPAN ? STATS_STACK : STATS_DATA;
+	}
+	if (address >= MEM_KTEXT_BEGIN && address <= MEM_KDATA_END) {
+		return STATS_KERNEL;
+	}
+	return STATS_UNMAPPED;
+}
+
+/***************************************************************/
+/* Count a load or store of address                                                               */
+/***************************************************************/
+static inline void stats_access(uint32_t address)
+{
+	STATS_MEMORY[stats_region(address)]++;
+}
+
+/***************************************************************/
+/* Count an instruction of op retiring at pc by the time cycles cycles */
+/* have elapsed, leaving its memory access, if any, to stats_access()  */
+/***************************************************************/
+static inline void stats_retire_op(uint32_t pc, uint8_t op, uint32_t cycles)
+{
+	uint32_t index = (pc - STATS_PROFILE_BASE) >> 2;
+
+	STATS_RETIRED[STATS_CLASS_OF[op]]++;
+	if (index < STATS_PROFILE_WORDS) {
+		STATS_PROFILE[index].count++;
+		STATS_PROFILE[index].cycles += cycles - STATS_LAST_RETIRE;
+	}
+	STATS_LAST_RETIRE = cycles;
+}
+
+/***************************************************************/
+/* Count an instruction retiring at pc by the time cycles cycles have  */
+/* elapsed; address is its effective address if it is a load or store */
+/***************************************************************/
+static inline void stats_retire(uint32_t pc, const decoded_inst_t *inst, uint32_t address, uint32_t cycles)
+{
+	if (inst->flags & (DEC_LOAD | DEC_STORE)) {
+		stats_access(address);
+	}
+	stats_retire_op(pc, inst->op, cycles);
+}
+
+#endif
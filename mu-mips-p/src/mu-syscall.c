@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-mips.h"
+
+static syscall_ctx_t SYSCALL_DEFAULT;
+__thread syscall_ctx_t *SYSCALL_CTX = &SYSCALL_DEFAULT;
+
+#define SYSCALL_OUT          (SYSCALL_CTX->out)
+#define SYSCALL_OUT_LEN   (SYSCALL_CTX->out_len)
+#define SYSCALL_BRK           (SYSCALL_CTX->brk)
+#define SYSCALL_FILE          (SYSCALL_CTX->files)
+
+#define SYSCALL_CHUNK 4096	/* bytes copied between host and program at a time */
+
+/* where the arguments and the result are */
+#define REG_V0 2
+#define REG_A0 4
+#define REG_A1 5
+#define REG_A2 6
+
+/* services, by $v0 */
+enum {
+	SYSCALL_PRINT_INT = 1,
+	SYSCALL_PRINT_STRING = 4,
+	SYSCALL_READ_INT = 5,
+	SYSCALL_READ_STRING = 8,
+	SYSCALL_SBRK = 9,
+	SYSCALL_EXIT = 10,
+	SYSCALL_PRINT_CHAR = 11,
+	SYSCALL_OPEN = 13,
+	SYSCALL_READ = 14,
+	SYSCALL_WRITE = 15,
+	SYSCALL_CLOSE = 16,
+	SYSCALL_EXIT2 = 17
+};
+
+/***************************************************************/
+/* Write out what the program has printed so far                                     */
+/***************************************************************/
+void syscall_flush()
+{
+	FILE *fp = SYSCALL_CTX->stream != NULL ? SYSCALL_CTX->stream : stdout;
+
+	if (SYSCALL_OUT_LEN > 0) {
+		fwrite(SYSCALL_OUT, 1, SYSCALL_OUT_LEN, fp);
+		fflush(fp);
+		SYSCALL_OUT_LEN = 0;
+	}
+}
+
+/***************************************************************/
+/* Send the program's stdout to fp from now on; NULL is the                */
+/* simulator's own stdout. The caller keeps fp open.                               */
+/***************************************************************/
+void syscall_output_to(FILE *fp)
+{
+	syscall_flush();
+	SYSCALL_CTX->stream = fp;
+}
+
+/***************************************************************/
+/* Queue len bytes for stdout, writing the buffer out each time it fills */
+/***************************************************************/
+static void syscall_output(const char *data, uint32_t len)
+{
+	uint32_t n;
+
+	if (SYSCALL_OUT == NULL && (SYSCALL_OUT = malloc(SYSCALL_BUFFER)) == NULL) {
+		error_fatal("Out of memory for the program's output buffer\n");
+	}
+	SYSCALL_CTX->output += len;
+	while (len > 0) {
+		n = SYSCALL_BUFFER - SYSCALL_OUT_LEN;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(SYSCALL_OUT + SYSCALL_OUT_LEN, data, n);
+		SYSCALL_OUT_LEN += n;
+		data += n;
+		len -= n;
+		if (SYSCALL_OUT_LEN == SYSCALL_BUFFER) {
+			syscall_flush();
+		}
+	}
+}
+
+/***************************************************************/
+/* Close the program's files; the standard three stay open                   */
+/***************************************************************/
+static void syscall_close_files()
+{
+	int fd;
+
+	for (fd = 3; fd < SYSCALL_FILES; fd++) {
+		if (SYSCALL_FILE[fd] != NULL) {
+			fclose(SYSCALL_FILE[fd]);
+			SYSCALL_FILE[fd] = NULL;
+		}
+	}
+}
+
+/***************************************************************/
+/* The host stream behind descriptor fd, NULL if it is not open              */
+/***************************************************************/
+static FILE *syscall_file(uint32_t fd)
+{
+	switch (fd) {
+		case 0:
+			return stdin;
+		case 1:
+			return stdout;
+		case 2:
+			return stderr;
+	}
+	return fd < SYSCALL_FILES ? SYSCALL_FILE[fd] : NULL;
+}
+
+/***************************************************************/
+/* Start a program whose image ends at end: no files open, the heap   */
+/* just past the image or at SYSCALL_HEAP_BEGIN, whichever is higher  */
+/***************************************************************/
+void syscall_start(uint32_t end)
+{
+	syscall_flush();
+	syscall_close_files();
+	end = (end + 7) & ~7u;
+	SYSCALL_CTX->heap_begin = end > SYSCALL_HEAP_BEGIN ? end : SYSCALL_HEAP_BEGIN;
+	SYSCALL_BRK = SYSCALL_CTX->heap_begin;
+	SYSCALL_CTX->exited = FALSE;
+	SYSCALL_CTX->exit_code = 0;
+	SYSCALL_CTX->calls = 0;
+	SYSCALL_CTX->output = 0;
+	SYSCALL_HELD = 0;
+}
+
+/***************************************************************/
+/* Print the NUL-ended string at address                                                */
+/***************************************************************/
+static void syscall_print_string(uint32_t address)
+{
+	char chunk[SYSCALL_CHUNK];
+	uint32_t n = 0;
+
+	while ((chunk[n] = mem_read_8(address++)) != '\0') {
+		if (++n == sizeof(chunk)) {
+			syscall_output(chunk, n);
+			n = 0;
+		}
+	}
+	syscall_output(chunk, n);
+}
+
+/***************************************************************/
+/* An integer from the next line of stdin, 0 if there is none                 */
+/***************************************************************/
+static uint32_t syscall_read_int()
+{
+	char line[SYSCALL_PATH];
+	size_t n;
+	int c;
+
+	syscall_flush();
+	if (fgets(line, sizeof(line), stdin) == NULL) {
+		return 0;
+	}
+	n = strlen(line);
+	if (n > 0 && line[n - 1] != '\n') {
+		/* the rest of an overlong line goes with it */
+		while ((c = getc(stdin)) != EOF && c != '\n') {
+		}
+	}
+	return (uint32_t)strtol(line, NULL, 10);
+}
+
+/***************************************************************/
+/* Read a line from stdin into the size bytes at address like fgets(): at */
+/* most size - 1 characters, newline included, then a NUL                    */
+/***************************************************************/
+static void syscall_read_string(uint32_t address, int32_t size)
+{
+	char chunk[SYSCALL_CHUNK];
+	uint32_t n;
+
+	if (size < 1) {
+		return;
+	}
+	syscall_flush();
+	while (size > 1) {
+		if (fgets(chunk, size < (int32_t)sizeof(chunk) ? size : (int32_t)sizeof(chunk), stdin) == NULL) {
+			break;
+		}
+		n = strlen(chunk);
+		mem_write_block(address, (const uint8_t *)chunk, n);
+		address += n;
+		size -= n;
+		if (n > 0 && chunk[n - 1] == '\n') {
+			break;
+		}
+	}
+	mem_write_8(address, 0);
+}
+
+/***************************************************************/
+/* Move the heap break by increment bytes, kept 8-byte aligned; the old */
+/* break, or -1 if the new one would leave the data segment                 */
+/***************************************************************/
+static uint32_t syscall_sbrk(int32_t increment)
+{
+	uint32_t old = SYSCALL_BRK;
+	int64_t brk = (int64_t)old + increment;
+
+	if (brk < SYSCALL_CTX->heap_begin || brk > MEM_DATA_END) {
+		return (uint32_t)-1;
+	}
+	SYSCALL_BRK = ((uint32_t)brk + 7) & ~7u;
+	return old;
+}
+
+/***************************************************************/
+/* Open the file named at address: flags 0 reads, 1 writes and 9        */
+/* appends, as in MARS. The descriptor, or -1.                                           */
+/***************************************************************/
+static uint32_t syscall_open(uint32_t address, uint32_t flags)
+{
+	char name[SYSCALL_PATH];
+	const char *mode;
+	uint32_t i;
+
+	for (i = 0; i < sizeof(name) && (name[i] = mem_read_8(address + i)) != '\0'; i++) {
+	}
+	if (i == sizeof(name)) {
+		return (uint32_t)-1;
+	}
+	mode = flags == 0 ? "rb" : flags == 1 ? "wb" : flags == 9 ? "ab" : NULL;
+	if (mode == NULL) {
+		return (uint32_t)-1;
+	}
+	for (i = 3; i < SYSCALL_FILES && SYSCALL_FILE[i] != NULL; i++) {
+	}
+	if (i == SYSCALL_FILES || (SYSCALL_FILE[i] = fopen(name, mode)) == NULL) {
+		return (uint32_t)-1;
+	}
+	return i;
+}
+
+/***************************************************************/
+/* Read up to len bytes from fd into address: the bytes read, 0 at the  */
+/* end of the file, or -1. stdin gives a line at a time, like a terminal. */
+/***************************************************************/
+static uint32_t syscall_read(uint32_t fd, uint32_t address, uint32_t len)
+{
+	char chunk[SYSCALL_CHUNK];
+	FILE *fp = syscall_file(fd);
+	uint32_t done = 0, want;
+	size_t n;
+	int c;
+
+	if (fp == NULL || fp == stdout || fp == stderr) {
+		return (uint32_t)-1;
+	}
+	if (fp == stdin) {
+		syscall_flush();
+		while (done < len && (c = getc(stdin)) != EOF) {
+			mem_write_8(address + done++, c);
+			if (c == '\n') {
+				break;
+			}
+		}
+		return done;
+	}
+	while (done < len) {
+		want = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+		n = fread(chunk, 1, want, fp);
+		mem_write_block(address + done, (const uint8_t *)chunk, n);
+		done += n;
+		if (n < want) {
+			return ferror(fp) ? (uint32_t)-1 : done;
+		}
+	}
+	return done;
+}
+
+/***************************************************************/
+/* Write len bytes at address to fd: the bytes written, or -1. stdout    */
+/* goes through the buffer; stderr first writes out what is in it.        */
+/***************************************************************/
+static uint32_t syscall_write(uint32_t fd, uint32_t address, uint32_t len)
+{
+	char chunk[SYSCALL_CHUNK];
+	FILE *fp = syscall_file(fd);
+	uint32_t done = 0, i, n;
+
+	if (fp == NULL || fp == stdin) {
+		return (uint32_t)-1;
+	}
+	if (fp == stderr) {
+		syscall_flush();
+	}
+	while (done < len) {
+		n = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+		for (i = 0; i < n; i++) {
+			chunk[i] = mem_read_8(address + done + i);
+		}
+		if (fp == stdout) {
+			syscall_output(chunk, n);
+		}else if (fwrite(chunk, 1, n, fp) != n) {
+			return (uint32_t)-1;
+		}
+		done += n;
+	}
+	return done;
+}
+
+/***************************************************************/
+/* Stop the run: the program has exited                                                   */
+/***************************************************************/
+static void syscall_exit(uint32_t code)
+{
+	syscall_flush();
+	SYSCALL_CTX->exited = TRUE;
+	SYSCALL_CTX->exit_code = code;
+	RUN_FLAG = FALSE;
+}
+
+/***************************************************************/
+/* Carry out the SYSCALL at pc against the register file regs, which    */
+/* holds everything older and takes the result                                      */
+/***************************************************************/
+void syscall_run(uint32_t pc, uint32_t *regs)
+{
+	char text[16];
+	int n;
+
+	SYSCALL_CTX->calls++;
+	switch (regs[REG_V0]) {
+		case SYSCALL_PRINT_INT:
+			n = snprintf(text, sizeof(text), "%d", (int32_t)regs[REG_A0]);
+			syscall_output(text, n);
+			break;
+		case SYSCALL_PRINT_STRING:
+			syscall_print_string(regs[REG_A0]);
+			break;
+		case SYSCALL_PRINT_CHAR:
+			text[0] = regs[REG_A0] & 0xFF;
+			syscall_output(text, 1);
+			break;
+		case SYSCALL_READ_INT:
+			regs[REG_V0] = syscall_read_int();
+			break;
+		case SYSCALL_READ_STRING:
+			syscall_read_string(regs[REG_A0], regs[REG_A1]);
+			break;
+		case SYSCALL_SBRK:
+			regs[REG_V0] = syscall_sbrk(regs[REG_A0]);
+			break;
+		case SYSCALL_EXIT:
+			syscall_exit(0);
+			break;
+		case SYSCALL_EXIT2:
+			syscall_exit(regs[REG_A0]);
+			break;
+		case SYSCALL_OPEN:
+			regs[REG_V0] = syscall_open(regs[REG_A0], regs[REG_A1]);
+			break;
+		case SYSCALL_READ:
+			regs[REG_V0] = syscall_read(regs[REG_A0], regs[REG_A1], regs[REG_A2]);
+			break;
+		case SYSCALL_WRITE:
+			regs[REG_V0] = syscall_write(regs[REG_A0], regs[REG_A1], regs[REG_A2]);
+			break;
+		case SYSCALL_CLOSE:
+			if (regs[REG_A0] >= 3 && regs[REG_A0] < SYSCALL_FILES && SYSCALL_FILE[regs[REG_A0]] != NULL) {
+				fclose(SYSCALL_FILE[regs[REG_A0]]);
+				SYSCALL_FILE[regs[REG_A0]] = NULL;
+			}
+			break;
+		default:
+			syscall_flush();
+			error_report("Unknown syscall %u at 0x%08x\n", regs[REG_V0], pc);
+			RUN_FLAG = FALSE;
+			break;
+	}
+}
+
+void syscall_register_counters()
+{
+	stats_register("syscall.calls", &SYSCALL_CTX->calls);
+	stats_register("syscall.output", &SYSCALL_CTX->output);
+	stats_register("stall.syscall", &SYSCALL_HELD);
+}
+
+/***************************************************************/
+/* Report the calls made, once there have been any                                */
+/***************************************************************/
+void syscall_print()
+{
+	if (SYSCALL_CTX->calls == 0) {
+		return;
+	}
+	printf("# Syscalls\t: %u, %u bytes output, heap 0x%08x-0x%08x, issue held %u cycles",
+		SYSCALL_CTX->calls, SYSCALL_CTX->output, SYSCALL_CTX->heap_begin, SYSCALL_BRK, SYSCALL_HELD);
+	if (SYSCALL_CTX->exited) {
+		printf(", exited with code %d", (int32_t)SYSCALL_CTX->exit_code);
+	}
+	printf("\n");
+}
+
+void syscall_print_json(FILE *fp)
+{
+	if (SYSCALL_CTX->calls == 0) {
+		fprintf(fp, "null");
+		return;
+	}
+	fprintf(fp, "{ \"calls\": %u, \"output\": %u, \"heap_begin\": %u, \"brk\": %u, \"held\": %u, ",
+		SYSCALL_CTX->calls, SYSCALL_CTX->output, SYSCALL_CTX->heap_begin, SYSCALL_BRK, SYSCALL_HELD);
+	if (SYSCALL_CTX->exited) {
+		fprintf(fp, "\"exit_code\": %d }", (int32_t)SYSCALL_CTX->exit_code);
+	}else {
+		fprintf(fp, "\"exit_code\": null }");
+	}
+}
+
+/***************************************************************/
+/* Checkpoint the heap, exit status and counters as little-endian words. */
+/* Pending output is written out first; open files are not saved.         */
+/***************************************************************/
+void syscall_save(FILE *fp)
+{
+	syscall_flush();
+	ckpt_put(fp, SYSCALL_CTX->heap_begin);
+	ckpt_put(fp, SYSCALL_BRK);
+	ckpt_put(fp, SYSCALL_CTX->exited);
+	ckpt_put(fp, SYSCALL_CTX->exit_code);
+	ckpt_put(fp, SYSCALL_CTX->calls);
+	ckpt_put(fp, SYSCALL_CTX->output);
+	ckpt_put(fp, SYSCALL_HELD);
+}
+
+/***************************************************************/
+/* Restore what syscall_save() wrote; -1 if the file is short or the      */
+/* heap is out of range. The program's files are closed.                          */
+/***************************************************************/
+int syscall_load(FILE *fp)
+{
+	uint32_t heap_begin, brk;
+	int ok = 1;
+
+	heap_begin = ckpt_get(fp, &ok);
+	brk = ckpt_get(fp, &ok);
+	if (!ok || heap_begin > brk || brk > MEM_DATA_END) {
+		return -1;
+	}
+	syscall_flush();
+	syscall_close_files();
+	SYSCALL_CTX->heap_begin = heap_begin;
+	SYSCALL_BRK = brk;
+	SYSCALL_CTX->exited = ckpt_get(fp, &ok) != 0;
+	SYSCALL_CTX->exit_code = ckpt_get(fp, &ok);
+	SYSCALL_CTX->calls = ckpt_get(fp, &ok);
+	SYSCALL_CTX->output = ckpt_get(fp, &ok);
+	SYSCALL_HELD = ckpt_get(fp, &ok);
+	return ok ? 0 : -1;
+}
+
+/***************************************************************/
+/* Write out pending output, close the files and drop the buffer        */
+/***************************************************************/
+void syscall_free()
+{
+	syscall_flush();
+	syscall_close_files();
+	free(SYSCALL_OUT);
+	SYSCALL_OUT = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef MU_SYSCALL_H
+#define MU_SYSCALL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* System calls                                                                                                                                     */
+/******************************************************************************/
+/* SYSCALL runs the SPIM/MARS service numbered by $v0 on the host, with its
+ * arguments in $a0-$a2 and any result in $v0:
+ *   1  print the integer $a0          11 print the character $a0
+ *   4  print the string at $a0        5  read an integer from a line of input
+ *   8  read a line into $a0, at most $a1 - 1 characters, NUL ended
+ *   9  sbrk: grow the heap by $a0 bytes, the old break in $v0
+ *   10 exit                                  17 exit with the code in $a0
+ *   13 open the file named at $a0, $a1 0 to read, 1 to write, 9 to append;
+ *      a descriptor or -1
+ *   14 read, 15 write $a2 bytes between descriptor $a0 and $a1; the bytes
+ *      moved, or -1
+ *   16 close descriptor $a0
+ * Descriptors 0-2 are the simulator's stdin, stdout and stderr, though
+ * syscall_output_to() can send the program's stdout elsewhere (batch mode
+ * keeps it off the JSON result). What the program writes to it collects in
+ * a SYSCALL_BUFFER byte buffer and goes out in one write when it fills,
+ * before the program reads its input, when it exits and when a run
+ * returns. Any other service stops the run.
+ *
+ * The call happens as the SYSCALL retires, after everything older and
+ * before anything younger has read a register: WB in the pipeline, which
+ * holds younger instructions in ID until then, retirement in the
+ * out-of-order core, which fetches nothing behind it until then. */
+#define SYSCALL_BUFFER   (64 * 1024)
+#define SYSCALL_FILES     16	/* descriptors, the standard three included */
+#define SYSCALL_PATH      256	/* longest file name, NUL included */
+#define SYSCALL_HEAP_BEGIN 0x10040000	/* first break, unless the program ends beyond it */
+
+/* one simulator instance's services; SYSCALL_CTX is per thread, like MEM_CTX */
+typedef struct {
+	char *out;	/* stdout buffer, allocated on first use */
+	uint32_t out_len;
+	FILE *stream;	/* where it goes; NULL for the simulator's stdout */
+	uint32_t brk;	/* current heap break */
+	uint32_t heap_begin;
+	FILE *files[SYSCALL_FILES];	/* the program's open files from 3 up */
+	int exited;	/* the program called exit */
+	uint32_t exit_code;
+
+	/* statistics */
+	uint32_t calls;
+	uint32_t output;	/* bytes written to stdout */
+	uint32_t held;	/* cycles ID (out of order: fetch) waited on a SYSCALL ahead */
+} syscall_ctx_t;
+
+extern __thread syscall_ctx_t *SYSCALL_CTX;
+
+#define SYSCALL_HELD (SYSCALL_CTX->held)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void syscall_start(uint32_t end);
+void syscall_run(uint32_t pc, uint32_t *regs);
+void syscall_flush();
+void syscall_output_to(FILE *fp);
+void syscall_register_counters();
+void syscall_print();
+void syscall_print_json(FILE *fp);
+void syscall_save(FILE *fp);
+int syscall_load(FILE *fp);
+void syscall_free();
+
+#endif
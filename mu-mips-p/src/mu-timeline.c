@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-decode.h"
+#include "mu-disasm.h"
+#include "mu-timeline.h"
+
+const char *TIMELINE_STAGE_NAMES[] = { "IF", "ID", "EX", "MEM", "WB" };
+
+static timeline_ctx_t TIMELINE_DEFAULT;
+__thread timeline_ctx_t *TIMELINE_CTX = &TIMELINE_DEFAULT;
+
+#define TIMELINE_LANES 64	/* well above the instructions in flight */
+
+#define TIMELINE_RING         (TIMELINE_CTX->ring)
+#define TIMELINE_CAPACITY (TIMELINE_CTX->capacity)
+#define TIMELINE_NEXT         (TIMELINE_CTX->next)
+#define TIMELINE_COUNT       (TIMELINE_CTX->count)
+
+/***************************************************************/
+/* Keep the last cycles cycles from now on; 0 turns recording off.      */
+/* Anything recorded so far is dropped.                                                          */
+/***************************************************************/
+void timeline_enable(uint32_t cycles)
+{
+	free(TIMELINE_RING);
+	TIMELINE_RING = NULL;
+	TIMELINE_CAPACITY = cycles;
+	TIMELINE_NEXT = 0;
+	TIMELINE_COUNT = 0;
+	TIMELINE_ON = cycles > 0;
+	if (cycles > 0 && (TIMELINE_RING = malloc((size_t)cycles * sizeof(timeline_entry_t))) == NULL) {
+		error_fatal("Out of memory allocating a %u cycle timeline\n", cycles);
+	}
+}
+
+/***************************************************************/
+/* Drop what has been recorded, keeping the capacity                           */
+/***************************************************************/
+void timeline_clear()
+{
+	TIMELINE_NEXT = 0;
+	TIMELINE_COUNT = 0;
+}
+
+void timeline_record(uint32_t cycle, const timeline_slot_t *slots)
+{
+	timeline_entry_t *e = &TIMELINE_RING[TIMELINE_NEXT];
+
+	e->cycle = cycle;
+	memcpy(e->slot, slots, sizeof(e->slot));
+	if (++TIMELINE_NEXT == TIMELINE_CAPACITY) {
+		TIMELINE_NEXT = 0;
+	}
+	if (TIMELINE_COUNT < TIMELINE_CAPACITY) {
+		TIMELINE_COUNT++;
+	}
+}
+
+/***************************************************************/
+/* Record a cycle in which nothing moved (the pipeline is frozen)         */
+/***************************************************************/
+void timeline_repeat(uint32_t cycle)
+{
+	timeline_slot_t empty[TIMELINE_SLOTS];
+
+	if (TIMELINE_COUNT == 0) {
+		memset(empty, 0, sizeof(empty));
+		timeline_record(cycle, empty);
+		return;
+	}
+	timeline_record(cycle, TIMELINE_RING[(TIMELINE_NEXT + TIMELINE_CAPACITY - 1) % TIMELINE_CAPACITY].slot);
+}
+
+uint32_t timeline_cycles()
+{
+	return TIMELINE_COUNT;
+}
+
+static int timeline_stage_of(const timeline_entry_t *e, uint32_t seq)
+{
+	int s;
+	for (s = 0; s < TIMELINE_SLOTS; s++) {
+		if (e->slot[s].seq == seq) {
+			return s / TIMELINE_WIDTH;
+		}
+	}
+	return -1;
+}
+
+/***************************************************************/
+/* Write the recorded cycles to file as a Kanata log. Instructions      */
+/* still in flight at the last cycle are left open. Returns -1 if the    */
+/* file can't be written.                                                                                  */
+/***************************************************************/
+int timeline_dump(const char *file)
+{
+	FILE *fp = fopen(file, "w");
+	timeline_entry_t none, *prev = &none, *e;
+	uint32_t i, seq, id, retired = 0, next_id = 0;
+	uint32_t lanes[TIMELINE_LANES];	/* Kanata id of each in-flight seq */
+	decoded_inst_t d;
+	char text[DISASM_LEN];
+	int s, from;
+
+	if (fp == NULL) {
+		error_report("Can't open timeline file %s\n", file);
+		return -1;
+	}
+	memset(&none, 0, sizeof(none));
+	fprintf(fp, "Kanata\t0004\n");
+	for (i = 0; i < TIMELINE_COUNT; i++) {
+		e = &TIMELINE_RING[(TIMELINE_NEXT + TIMELINE_CAPACITY - TIMELINE_COUNT + i) % TIMELINE_CAPACITY];
+		if (i == 0) {
+			fprintf(fp, "C=\t%u\n", e->cycle);
+		}else {
+			fprintf(fp, "C\t%u\n", e->cycle - prev->cycle);
+		}
+		/* gone since the last cycle: retired from WB or squashed */
+		for (s = 0; s < TIMELINE_SLOTS; s++) {
+			seq = prev->slot[s].seq;
+			if (seq != 0 && timeline_stage_of(e, seq) < 0) {
+				id = lanes[seq % TIMELINE_LANES];
+				if (s / TIMELINE_WIDTH == TIMELINE_STAGES - 1) {
+					fprintf(fp, "R\t%u\t%u\t0\n", id, retired++);
+				}else {
+					fprintf(fp, "R\t%u\t0\t1\n", id);
+				}
+			}
+		}
+		for (s = 0; s < TIMELINE_SLOTS; s++) {
+			seq = e->slot[s].seq;
+			if (seq == 0) {
+				continue;
+			}
+			from = i > 0 ? timeline_stage_of(prev, seq) : -1;
+			if (from < 0) {
+				id = lanes[seq % TIMELINE_LANES] = next_id++;
+				decode_inst(e->slot[s].ir, &d);
+				disasm(&d, e->slot[s].pc, NULL, text, sizeof(text));
+				fprintf(fp, "I\t%u\t%u\t0\n", id, seq);
+				fprintf(fp, "L\t%u\t0\t%08x: %s\n", id, e->slot[s].pc, text);
+				fprintf(fp, "L\t%u\t1\tIR 0x%08x\n", id, e->slot[s].ir);
+				fprintf(fp, "S\t%u\t0\t%s\n", id, TIMELINE_STAGE_NAMES[s / TIMELINE_WIDTH]);
+			}else if (from != s / TIMELINE_WIDTH) {
+				fprintf(fp, "S\t%u\t0\t%s\n", lanes[seq % TIMELINE_LANES], TIMELINE_STAGE_NAMES[s / TIMELINE_WIDTH]);
+			}
+		}
+		prev = e;
+	}
+	if (fclose(fp) != 0) {
+		error_report("Can't write timeline file %s\n", file);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef MU_TIMELINE_H
+#define MU_TIMELINE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Pipeline occupancy timeline                                                                                                            */
+/******************************************************************************/
+/* While enabled, every pipeline-mode cycle records which instructions sit
+ * in each of the five stages, TIMELINE_WIDTH slots per stage, identified
+ * by their fetch sequence numbers (0 for a bubble). Only the last TIMELINE
+ * capacity cycles are kept, so the recording can stay on for long runs. timeline_dump() writes the kept
+ * cycles as a Kanata 0004 log, the format the Konata viewer reads:
+ * instructions that leave WB retire, any others that vanish were
+ * squashed. */
+#define TIMELINE_STAGES 5	/* IF, ID, EX, MEM, WB */
+#define TIMELINE_WIDTH    4	/* slots per stage, the widest issue group */
+#define TIMELINE_SLOTS     (TIMELINE_STAGES * TIMELINE_WIDTH)	/* stage s, slot i at s * TIMELINE_WIDTH + i */
+
+typedef struct {
+	uint32_t seq;	/* 0 when the stage is empty */
+	uint32_t pc, ir;
+} timeline_slot_t;
+
+typedef struct {
+	uint32_t cycle;
+	timeline_slot_t slot[TIMELINE_SLOTS];
+} timeline_entry_t;
+
+/* one simulator instance's ring; TIMELINE_CTX is per thread, like MEM_CTX */
+typedef struct {
+	int on;
+	timeline_entry_t *ring;
+	uint32_t capacity;
+	uint32_t next;	/* slot the next cycle goes in */
+	uint32_t count;	/* cycles held, at most the capacity */
+} timeline_ctx_t;
+
+extern __thread timeline_ctx_t *TIMELINE_CTX;
+
+#define TIMELINE_ON (TIMELINE_CTX->on)
+extern const char *TIMELINE_STAGE_NAMES[];
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+void timeline_enable(uint32_t cycles);
+void timeline_clear();
+void timeline_record(uint32_t cycle, const timeline_slot_t *slots);
+void timeline_repeat(uint32_t cycle);
+uint32_t timeline_cycles();
+int timeline_dump(const char *file);
+
+#endif
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-error.h"
+#include "mu-mem.h"
+#include "mu-trace.h"
+
+static trace_ctx_t TRACE_DEFAULT;
+__thread trace_ctx_t *TRACE_CTX = &TRACE_DEFAULT;
+
+#define TRACE_FILE       (TRACE_CTX->file)
+#define TRACE_PIPE       (TRACE_CTX->pipe)
+#define TRACE_BUF         (TRACE_CTX->buf)
+#define TRACE_LEN         (TRACE_CTX->len)
+#define TRACE_STATE     (TRACE_CTX->state)
+
+static uint8_t *trace_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static uint32_t trace_zigzag(uint32_t delta)
+{
+	return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static void trace_flush()
+{
+	if (TRACE_LEN > 0 && fwrite(TRACE_BUF, TRACE_LEN, 1, TRACE_FILE) != 1) {
+		error_report("Trace write failed, tracing stopped\n");
+		TRACE_LEN = 0;
+		trace_close();
+		return;
+	}
+	TRACE_LEN = 0;
+}
+
+/***************************************************************/
+/* Start a trace in file, or piped to a command if file starts with |.     */
+/* Any trace already open is closed first. Returns -1 on error.            */
+/***************************************************************/
+int trace_open(const char *file)
+{
+	trace_close();
+	if (file[0] == '|') {
+		TRACE_FILE = popen(file + 1, "w");
+		TRACE_PIPE = 1;
+	}else {
+		TRACE_FILE = fopen(file, "wb");
+		TRACE_PIPE = 0;
+	}
+	if (TRACE_FILE == NULL) {
+		error_report("Can't open trace %s\n", file);
+		return -1;
+	}
+	/* records are collected in TRACE_BUF and written in large blocks */
+	setvbuf(TRACE_FILE, NULL, _IONBF, 0);
+	if (TRACE_BUF == NULL && (TRACE_BUF = malloc(TRACE_BUFFER)) == NULL) {
+		error_fatal("Out of memory allocating the trace buffer\n");
+	}
+	memset(&TRACE_STATE, 0, sizeof(TRACE_STATE));
+	mem_store_le32(TRACE_BUF, TRACE_MAGIC);
+	mem_store_le32(TRACE_BUF + 4, TRACE_VERSION);
+	TRACE_LEN = 8;
+	TRACE_ON = 1;
+	return 0;
+}
+
+/***************************************************************/
+/* Write out what is buffered and close the trace                                 */
+/***************************************************************/
+void trace_close()
+{
+	FILE *fp = TRACE_FILE;
+
+	if (fp == NULL) {
+		return;
+	}
+	if (TRACE_ON) {
+		TRACE_ON = 0;
+		trace_flush();
+	}
+	TRACE_FILE = NULL;
+	if (TRACE_PIPE) {
+		pclose(fp);
+	}else {
+		fclose(fp);
+	}
+}
+
+/***************************************************************/
+/* Append one retired instruction                                                              */
+/***************************************************************/
+void trace_write(const trace_record_t *r)
+{
+	uint8_t flags = r->flags, *p;
+
+	if (TRACE_LEN > TRACE_BUFFER - TRACE_MAX_RECORD) {
+		trace_flush();
+		if (!TRACE_ON) {
+			return;
+		}
+	}
+	if (r->pc != TRACE_STATE.pc + 4) {
+		flags |= TRACE_JUMP;
+	}
+	p = TRACE_BUF + TRACE_LEN;
+	*p++ = flags;
+	p = trace_varint(p, r->cycle - TRACE_STATE.cycle);
+	if (flags & TRACE_JUMP) {
+		p = trace_varint(p, trace_zigzag(r->pc - (TRACE_STATE.pc + 4)));
+	}
+	mem_store_le32(p, r->ir);
+	p += 4;
+	if (flags & TRACE_DEST) {
+		*p++ = r->dest;
+		p = trace_varint(p, trace_zigzag(r->value - TRACE_STATE.regs[r->dest & 31]));
+		TRACE_STATE.regs[r->dest & 31] = r->value;
+	}
+	if (flags & TRACE_MEM) {
+		p = trace_varint(p, trace_zigzag(r->address - TRACE_STATE.address));
+		TRACE_STATE.address = r->address;
+	}
+	if (flags & TRACE_STORE) {
+		p = trace_varint(p, r->data);
+	}
+	TRACE_STATE.cycle = r->cycle;
+	TRACE_STATE.pc = r->pc;
+	TRACE_LEN = p - TRACE_BUF;
+}
+
+/***************************************************************/
+/* Decoder side: check the header, then read records in order with     */
+/* a zeroed state. trace_read() returns 0 at end of stream, -1 if the  */
+/* stream is cut short.                                                                                   */
+/***************************************************************/
+int trace_read_header(FILE *fp)
+{
+	uint8_t b[8];
+
+	if (fread(b, 8, 1, fp) != 1 || mem_load_le32(b) != TRACE_MAGIC || mem_load_le32(b + 4) != TRACE_VERSION) {
+		return -1;
+	}
+	return 0;
+}
+
+static int trace_get_varint(FILE *fp, uint32_t *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do {
+		if ((c = getc(fp)) == EOF || shift > 28) {
+			return -1;
+		}
+		*v |= (uint32_t)(c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+static uint32_t trace_unzigzag(uint32_t v)
+{
+	return (v >> 1) ^ -(v & 1);
+}
+
+int trace_read(FILE *fp, trace_state_t *s, trace_record_t *r)
+{
+	uint32_t v;
+	uint8_t b[4];
+	int c;
+
+	if ((c = getc(fp)) == EOF) {
+		return 0;
+	}
+	memset(r, 0, sizeof(*r));
+	r->flags = c;
+	if (trace_get_varint(fp, &v) != 0) {
+		return -1;
+	}
+	r->cycle = s->cycle + v;
+	r->pc = s->pc + 4;
+	if (r->flags & TRACE_JUMP) {
+		if (trace_get_varint(fp, &v) != 0) {
+			return -1;
+		}
+		r->pc += trace_unzigzag(v);
+	}
+	if (fread(b, 4, 1, fp) != 1) {
+		return -1;
+	}
+	r->ir = mem_load_le32(b);
+	if (r->flags & TRACE_DEST) {
+		if ((c = getc(fp)) == EOF || trace_get_varint(fp, &v) != 0) {
+			return -1;
+		}
+		r->dest = c & 31;
+		r->value = s->regs[r->dest] + trace_unzigzag(v);
+		s->regs[r->dest] = r->value;
+	}
+	if (r->flags & TRACE_MEM) {
+		if (trace_get_varint(fp, &v) != 0) {
+			return -1;
+		}
+		r->address = s->address + trace_unzigzag(v);
+		s->address = r->address;
+	}
+	if ((r->flags & TRACE_STORE) && trace_get_varint(fp, &r->data) != 0) {
+		return -1;
+	}
+	s->cycle = r->cycle;
+	s->pc = r->pc;
+	return 1;
+}
@@ -0,0 +1,71 @@
+#ifndef MU_TRACE_H
+#define MU_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* Retirement trace                                                                                                                                */
+/******************************************************************************/
+/* A binary stream with one record per retired instruction. The stream
+ * starts with the magic and version as little-endian words; each record is
+ * a flags byte followed by
+ *   varint   cycles since the previous record
+ *   varint   zigzag(PC - (previous PC + 4))        if TRACE_JUMP
+ *   4 bytes IR, little-endian
+ *   byte      destination register                          if TRACE_DEST
+ *   varint   zigzag(value - last value of that register)  if TRACE_DEST
+ *   varint   zigzag(address - previous address)     if TRACE_MEM
+ *   varint   data stored                                           if TRACE_STORE
+ * Varints are little-endian base 128. Writer and reader keep the same
+ * history, so a straight-line loop costs about six bytes per record. */
+#define TRACE_MAGIC     0x5254554D	/* "MUTR" */
+#define TRACE_VERSION  1
+#define TRACE_BUFFER    (1 << 20)	/* bytes collected before each write */
+#define TRACE_MAX_RECORD 32
+
+#define TRACE_DEST     0x01	/* writes a register */
+#define TRACE_MEM      0x02	/* load or store */
+#define TRACE_STORE    0x04
+#define TRACE_JUMP     0x08	/* PC does not follow the previous record */
+
+typedef struct {
+	uint32_t cycle;            /* retire cycle */
+	uint32_t pc, ir;
+	uint8_t flags;
+	uint8_t dest;
+	uint32_t value;           /* written to dest */
+	uint32_t address;        /* effective address of a load or store */
+	uint32_t data;             /* register value a store wrote */
+} trace_record_t;
+
+/* delta history shared by the writer and the decoder */
+typedef struct {
+	uint32_t cycle, pc, address;
+	uint32_t regs[32];
+} trace_state_t;
+
+/* one simulator instance's writer; TRACE_CTX is per thread, like MEM_CTX */
+typedef struct {
+	int on;
+	FILE *file;
+	int pipe;	/* file came from popen() */
+	uint8_t *buf;
+	uint32_t len;
+	trace_state_t state;
+} trace_ctx_t;
+
+extern __thread trace_ctx_t *TRACE_CTX;
+
+#define TRACE_ON (TRACE_CTX->on)
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+int trace_open(const char *file);
+void trace_close();
+void trace_write(const trace_record_t *r);
+int trace_read_header(FILE *fp);
+int trace_read(FILE *fp, trace_state_t *s, trace_record_t *r);
+
+#endif
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#include "mu-mips.h"
+#include "mumips.h"
+
+#define MUMIPS_BUFFER_NAME "<buffer>"	/* prog_file of a program loaded from memory */
+
+struct mumips {
+	sim_t *sim;
+	int loaded;	/* a program is in memory */
+	int broken;	/* a fatal error left the instance half updated */
+	char error[ERROR_LEN];
+};
+
+/***************************************************************/
+/* Every call selects its instance and sets a recovery point, so an    */
+/* error_fatal() inside the simulator returns MUMIPS_ERR_FATAL from  */
+/* the call instead of exiting. MUMIPS_ENTER declares the jmp_buf in  */
+/* the caller, which setjmp() needs; leave with mumips_leave().           */
+/***************************************************************/
+#define MUMIPS_ENTER(m) \
+	jmp_buf recover; \
+	if (mumips_enter(m) != 0) { \
+		return MUMIPS_ERR_STATE; \
+	} \
+	if (setjmp(recover) != 0) { \
+		return mumips_leave(m, MUMIPS_ERR_FATAL); \
+	} \
+	ERROR_JMP = &recover
+
+static int mumips_enter(mumips_t *m)
+{
+	if (m->broken) {
+		snprintf(m->error, sizeof(m->error), "instance is unusable after a fatal error");
+		return -1;
+	}
+	sim_select(m->sim);
+	error_clear();
+	ERROR_SILENT = QUIET;
+	return 0;
+}
+
+static int mumips_leave(mumips_t *m, int code)
+{
+	/* the program's output reaches stdout before the call returns */
+	syscall_flush();
+	ERROR_JMP = NULL;
+	ERROR_SILENT = 0;
+	if (code == MUMIPS_ERR_FATAL) {
+		m->broken = 1;
+	}
+	if (code < 0 && error_last()[0] != '\0') {
+		snprintf(m->error, sizeof(m->error), "%s", error_last());
+	}else if (code >= 0) {
+		m->error[0] = '\0';
+	}
+	return code;
+}
+
+static int mumips_fail(mumips_t *m, int code, const char *message)
+{
+	error_report("%s\n", message);
+	return mumips_leave(m, code);
+}
+
+/***************************************************************/
+/* A quiet instance with nothing loaded; NULL if out of memory             */
+/***************************************************************/
+mumips_t *mumips_create()
+{
+	mumips_t *m = calloc(1, sizeof(mumips_t));
+	jmp_buf recover;
+
+	if (m == NULL) {
+		return NULL;
+	}
+	ERROR_SILENT = 1;
+	if (setjmp(recover) != 0) {
+		/* what initialize() allocated before failing is lost */
+		ERROR_JMP = NULL;
+		ERROR_SILENT = 0;
+		free(m);
+		return NULL;
+	}
+	ERROR_JMP = &recover;
+	m->sim = sim_create();
+	ERROR_JMP = NULL;
+	ERROR_SILENT = 0;
+	if (m->sim == NULL) {
+		free(m);
+		return NULL;
+	}
+	QUIET = TRUE;
+	return m;
+}
+
+void mumips_destroy(mumips_t *m)
+{
+	if (m == NULL) {
+		return;
+	}
+	sim_destroy(m->sim);
+	SIM = NULL;
+	free(m);
+}
+
+/***************************************************************/
+/* Load a program and reset the instance to its entry point                  */
+/***************************************************************/
+int mumips_load_file(mumips_t *m, const char *file)
+{
+	MUMIPS_ENTER(m);
+	if (file == NULL || strlen(file) >= sizeof(prog_file)) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "program path is missing or too long");
+	}
+	free(SIM->prog_data);
+	SIM->prog_data = NULL;
+	SIM->prog_size = 0;
+	strcpy(prog_file, file);
+	m->loaded = reset() == 0;
+	return mumips_leave(m, m->loaded ? MUMIPS_OK : MUMIPS_ERR_LOAD);
+}
+
+int mumips_load_buffer(mumips_t *m, const void *data, size_t size)
+{
+	uint8_t *copy;
+
+	MUMIPS_ENTER(m);
+	if (data == NULL || size == 0) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "program buffer is empty");
+	}
+	copy = malloc(size);
+	if (copy == NULL) {
+		return mumips_fail(m, MUMIPS_ERR_LOAD, "out of memory copying the program");
+	}
+	memcpy(copy, data, size);
+	free(SIM->prog_data);
+	SIM->prog_data = copy;
+	SIM->prog_size = size;
+	strcpy(prog_file, MUMIPS_BUFFER_NAME);
+	m->loaded = reset() == 0;
+	return mumips_leave(m, m->loaded ? MUMIPS_OK : MUMIPS_ERR_LOAD);
+}
+
+int mumips_reset(mumips_t *m)
+{
+	MUMIPS_ENTER(m);
+	if (!m->loaded) {
+		return mumips_fail(m, MUMIPS_ERR_STATE, "no program loaded");
+	}
+	m->loaded = reset() == 0;
+	return mumips_leave(m, m->loaded ? MUMIPS_OK : MUMIPS_ERR_LOAD);
+}
+
+/***************************************************************/
+/* Run simulator commands, as typed at the prompt, from a string. All of */
+/* them run; MUMIPS_ERR_ARG if any reported an error                            */
+/***************************************************************/
+int mumips_command(mumips_t *m, const char *commands)
+{
+	MUMIPS_ENTER(m);
+	if (commands == NULL) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no commands");
+	}
+	CMD_INPUT = fmemopen((void *)commands, strlen(commands), "r");
+	if (CMD_INPUT == NULL) {
+		CMD_INPUT = stdin;
+		return mumips_fail(m, MUMIPS_ERR_ARG, "can't read the commands");
+	}
+	while (handle_command());
+	fclose(CMD_INPUT);
+	CMD_INPUT = stdin;
+	return mumips_leave(m, error_last()[0] != '\0' ? MUMIPS_ERR_ARG : MUMIPS_OK);
+}
+
+void mumips_set_verbose(mumips_t *m, int verbose)
+{
+	sim_select(m->sim);
+	VERBOSE = verbose;
+	QUIET = verbose == 0;
+}
+
+/***************************************************************/
+/* Step n cycles (instructions in fast mode); MUMIPS_STOPPED once the */
+/* program has finished                                                                                  */
+/***************************************************************/
+int mumips_step(mumips_t *m, uint32_t n)
+{
+	MUMIPS_ENTER(m);
+	if (!m->loaded) {
+		return mumips_fail(m, MUMIPS_ERR_STATE, "no program loaded");
+	}
+	if (SIM_MODE == MODE_FAST) {
+		fast_run(n);
+	}else {
+		while (n > 0 && RUN_FLAG) {
+			cycle();
+			n--;
+		}
+	}
+	return mumips_leave(m, RUN_FLAG ? MUMIPS_OK : MUMIPS_STOPPED);
+}
+
+/***************************************************************/
+/* Step until the next instruction to fetch is at pc, at most max_steps  */
+/* steps (0: no limit). MUMIPS_OK at pc, MUMIPS_STOPPED if the program */
+/* finished first, MUMIPS_LIMIT if the steps ran out.                           */
+/***************************************************************/
+int mumips_run_until_pc(mumips_t *m, uint32_t pc, uint32_t max_steps)
+{
+	uint32_t steps = 0;
+
+	MUMIPS_ENTER(m);
+	if (!m->loaded) {
+		return mumips_fail(m, MUMIPS_ERR_STATE, "no program loaded");
+	}
+	while (CURRENT_STATE.PC != pc) {
+		if (!RUN_FLAG) {
+			return mumips_leave(m, MUMIPS_STOPPED);
+		}
+		if (max_steps > 0 && steps == max_steps) {
+			return mumips_leave(m, MUMIPS_LIMIT);
+		}
+		cycle();
+		steps++;
+	}
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+/***************************************************************/
+/* Step until the cycle count reaches cycle_count                                     */
+/***************************************************************/
+int mumips_run_until_cycle(mumips_t *m, uint32_t cycle_count)
+{
+	MUMIPS_ENTER(m);
+	if (!m->loaded) {
+		return mumips_fail(m, MUMIPS_ERR_STATE, "no program loaded");
+	}
+	while (RUN_FLAG && (int32_t)(cycle_count - CYCLE_COUNT) > 0) {
+		cycle();
+	}
+	return mumips_leave(m, RUN_FLAG ? MUMIPS_OK : MUMIPS_STOPPED);
+}
+
+int mumips_running(mumips_t *m)
+{
+	sim_select(m->sim);
+	return m->loaded && !m->broken && RUN_FLAG;
+}
+
+/***************************************************************/
+/* Architected registers: GPRs 0-31, then MUMIPS_REG_HI/LO/PC.          */
+/* Setting the PC empties the pipeline so fetch starts over there.        */
+/***************************************************************/
+int mumips_get_reg(mumips_t *m, int reg, uint32_t *value)
+{
+	MUMIPS_ENTER(m);
+	if (reg < 0 || reg > MUMIPS_REG_PC || value == NULL) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no such register");
+	}
+	if (reg < MIPS_REGS) {
+		*value = CURRENT_STATE.REGS[reg];
+	}else if (reg == MUMIPS_REG_HI) {
+		*value = CURRENT_STATE.HI;
+	}else if (reg == MUMIPS_REG_LO) {
+		*value = CURRENT_STATE.LO;
+	}else {
+		*value = CURRENT_STATE.PC;
+	}
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+int mumips_set_reg(mumips_t *m, int reg, uint32_t value)
+{
+	MUMIPS_ENTER(m);
+	if (reg < 0 || reg > MUMIPS_REG_PC) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no such register");
+	}
+	if (reg == 0) {
+		value = 0;
+	}
+	if (reg < MIPS_REGS) {
+		CURRENT_STATE.REGS[reg] = value;
+		NEXT_STATE.REGS[reg] = value;
+	}else if (reg == MUMIPS_REG_HI) {
+		CURRENT_STATE.HI = value;
+		NEXT_STATE.HI = value;
+	}else if (reg == MUMIPS_REG_LO) {
+		CURRENT_STATE.LO = value;
+		NEXT_STATE.LO = value;
+	}else {
+		pipeline_clear();
+		if (SIM_MODE == MODE_OOO) {
+			ooo_squash();
+		}
+		CURRENT_STATE.PC = value;
+		NEXT_STATE.PC = value;
+	}
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+/***************************************************************/
+/* Copy memory out of or into the instance; unmapped bytes read as 0 */
+/* and writes to them are dropped, as for the simulated program         */
+/***************************************************************/
+int mumips_read_mem(mumips_t *m, uint32_t address, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	size_t i;
+
+	MUMIPS_ENTER(m);
+	if (buf == NULL && len > 0) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no buffer");
+	}
+	for (i = 0; i < len; i++) {
+		p[i] = mem_read_8(address + i);
+	}
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+int mumips_write_mem(mumips_t *m, uint32_t address, const void *buf, size_t len)
+{
+	MUMIPS_ENTER(m);
+	if ((buf == NULL && len > 0) || len > UINT32_MAX) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no buffer or too long");
+	}
+	mem_write_block(address, buf, len);
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+/***************************************************************/
+/* Performance counters by name or index, as the stats command lists   */
+/***************************************************************/
+int mumips_stat(mumips_t *m, const char *name, uint32_t *value)
+{
+	MUMIPS_ENTER(m);
+	if (name == NULL || value == NULL || stats_find(name, value) != 0) {
+		return mumips_fail(m, MUMIPS_ERR_ARG, "no such counter");
+	}
+	return mumips_leave(m, MUMIPS_OK);
+}
+
+int mumips_num_stats(mumips_t *m)
+{
+	sim_select(m->sim);
+	return stats_counters();
+}
+
+const char *mumips_stat_name(mumips_t *m, int i)
+{
+	sim_select(m->sim);
+	return stats_counter_name(i);
+}
+
+/***************************************************************/
+/* Why the instance's last failing call failed, "" after a success         */
+/***************************************************************/
+const char *mumips_error(mumips_t *m)
+{
+	return m->error;
+}
+
+const char *mumips_strerror(int code)
+{
+	switch (code) {
+		case MUMIPS_OK: return "ok";
+		case MUMIPS_STOPPED: return "program finished";
+		case MUMIPS_LIMIT: return "step limit reached";
+		case MUMIPS_ERR_ARG: return "bad argument";
+		case MUMIPS_ERR_LOAD: return "can't load program";
+		case MUMIPS_ERR_STATE: return "no program loaded or instance unusable";
+		case MUMIPS_ERR_FATAL: return "simulation failed";
+		default: return "unknown error";
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef MUMIPS_H
+#define MUMIPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************/
+/* libmumips                                                                                                                                         */
+/******************************************************************************/
+/* The simulator as a library. Each mumips_t is a separate instance with
+ * its own memory, pipeline, caches and counters, and calls on different
+ * instances may run on different threads at once; one instance must not be
+ * used by two threads at a time. Nothing here exits the process: every
+ * call returns MUMIPS_OK or a positive outcome, or one of the negative
+ * MUMIPS_ERR_* codes with the reason in mumips_error(). After
+ * MUMIPS_ERR_FATAL (the simulator ran out of memory part way through) the
+ * instance only accepts mumips_destroy().
+ *
+ * Instances are quiet: they print nothing of their own. Commands passed to
+ * mumips_command() and the dumps they ask for still print to stdout. */
+typedef struct mumips mumips_t;
+
+#define MUMIPS_OK               0
+#define MUMIPS_STOPPED      1	/* the program has finished; nothing more runs */
+#define MUMIPS_LIMIT           2	/* run_until gave up before reaching its target */
+#define MUMIPS_ERR_ARG      -1	/* bad register, counter or argument */
+#define MUMIPS_ERR_LOAD    -2	/* the program can't be read or parsed */
+#define MUMIPS_ERR_STATE   -3	/* no program loaded, or the instance is unusable */
+#define MUMIPS_ERR_FATAL   -4	/* the simulation can't continue */
+
+/* register numbers beyond the 32 GPRs */
+#define MUMIPS_REG_HI 32
+#define MUMIPS_REG_LO 33
+#define MUMIPS_REG_PC 34
+
+/***************************************************************/
+/* Function Declerations.                                                                                                */
+/***************************************************************/
+mumips_t *mumips_create();
+void mumips_destroy(mumips_t *m);
+
+/* a hex listing or ELF executable; the buffer is copied */
+int mumips_load_file(mumips_t *m, const char *file);
+int mumips_load_buffer(mumips_t *m, const void *data, size_t size);
+int mumips_reset(mumips_t *m);
+int mumips_command(mumips_t *m, const char *commands);
+void mumips_set_verbose(mumips_t *m, int verbose);
+
+/* step in cycles, or instructions in fast mode */
+int mumips_step(mumips_t *m, uint32_t n);
+int mumips_run_until_pc(mumips_t *m, uint32_t pc, uint32_t max_steps);
+int mumips_run_until_cycle(mumips_t *m, uint32_t cycle_count);
+int mumips_running(mumips_t *m);
+
+int mumips_get_reg(mumips_t *m, int reg, uint32_t *value);
+int mumips_set_reg(mumips_t *m, int reg, uint32_t value);
+int mumips_read_mem(mumips_t *m, uint32_t address, void *buf, size_t len);
+int mumips_write_mem(mumips_t *m, uint32_t address, const void *buf, size_t len);
+
+/* cycles, instructions and every registered performance counter */
+int mumips_stat(mumips_t *m, const char *name, uint32_t *value);
+int mumips_num_stats(mumips_t *m);
+const char *mumips_stat_name(mumips_t *m, int i);
+
+const char *mumips_error(mumips_t *m);
+const char *mumips_strerror(int code);
+
+#endif
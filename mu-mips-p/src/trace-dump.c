@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-trace.h"
+
+/***************************************************************/
+/* Print a retirement trace written by mu-mips as text, one line     */
+/* per instruction: cycle, PC, IR, then the register written and the  */
+/* memory access if any                                                                                  */
+/***************************************************************/
+int main(int argc, char *argv[]) {
+	FILE *fp = stdin;
+	trace_state_t state;
+	trace_record_t r;
+	uint32_t records = 0;
+	int status;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
+		printf("Usage: %s [trace file]\t(reads stdin without one)\n", argv[0]);
+		return 1;
+	}
+	if (argc == 2 && strcmp(argv[1], "-") != 0 && (fp = fopen(argv[1], "rb")) == NULL) {
+		printf("Error: Can't open trace %s\n", argv[1]);
+		return 1;
+	}
+	if (trace_read_header(fp) != 0) {
+		printf("Error: Not a version %d trace\n", TRACE_VERSION);
+		return 1;
+	}
+	memset(&state, 0, sizeof(state));
+	while ((status = trace_read(fp, &state, &r)) > 0) {
+		printf("%10u 0x%08x 0x%08x", r.cycle, r.pc, r.ir);
+		if (r.flags & TRACE_DEST) {
+			printf(" R%u=0x%08x", r.dest, r.value);
+		}
+		if (r.flags & TRACE_STORE) {
+			printf(" [0x%08x]<-0x%08x", r.address, r.data);
+		}else if (r.flags & TRACE_MEM) {
+			printf(" [0x%08x]", r.address);
+		}
+		printf("\n");
+		records++;
+	}
+	if (status < 0) {
+		printf("Error: Trace is truncated after %u records\n", records);
+		return 1;
+	}
+	printf("# %u records\n", records);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Batch mode must keep what the program prints off the JSON result on stdout.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/syscall-print.in
+
+printf -- '-42\nHi\n' > "$TMP/expected"
+
+"$SIM" --sim --dump-regs "$PROG" > "$TMP/sim.json" 2> "$TMP/sim.err"
+parses "$TMP/sim.json"
+check "--sim result parses" $?
+cmp -s "$TMP/sim.err" "$TMP/expected"
+check "--sim program output on stderr" $?
+
+"$SIM" --sim --stdout "$TMP/sim.out" "$PROG" > "$TMP/out.json"
+parses "$TMP/out.json"
+check "--sim --stdout result parses" $?
+cmp -s "$TMP/sim.out" "$TMP/expected"
+check "--stdout file holds the program output" $?
+
+printf '%s ; mode pipe ; sim\n%s ; mode fast ; sim\n%s ; mode ooo ; sim\n' \
+	"$PROG" "$PROG" "$PROG" > "$TMP/jobs"
+"$SIM" --farm "$TMP/jobs" --stdout "$TMP/farm.out" > "$TMP/farm.json"
+parses "$TMP/farm.json"
+check "--farm result parses" $?
+cat "$TMP/expected" "$TMP/expected" "$TMP/expected" > "$TMP/expected3"
+cmp -s "$TMP/farm.out" "$TMP/expected3"
+check "--farm --stdout file holds every job's output" $?
+
+exit $FAIL
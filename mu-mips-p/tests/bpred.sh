@@ -0,0 +1,19 @@
+#!/bin/sh
+# Each predictor, starting cold, mispredicts a 1000-pass loop branch the
+# expected number of times, in the pipeline and in fast mode.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/bpred-loop.in
+
+for mode in pipe fast; do
+	for pair in nottaken:999 bimodal:2 gshare:14 tournament:2 btb:2; do
+		kind=${pair%:*}
+		batch "$TMP/r.json" "mode $mode\nbpred $kind\nrun 10000\n" "$PROG" --dump-regs
+		expect "$mode $kind: program finished" "$TMP/r.json" "d['running']" False
+		expect "$mode $kind: branches" "$TMP/r.json" "d['bpred']['branches']" 1000
+		expect "$mode $kind: mispredicts" "$TMP/r.json" "d['bpred']['mispredicts']" "${pair#*:}"
+	done
+done
+
+exit $FAIL
@@ -0,0 +1,21 @@
+#!/bin/sh
+# The cache models count the hits, misses, evictions and writebacks of
+# a known access pattern, in every mode.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/cache-walk.in
+SETUP="cache i 1024 2 16 lru wb 1 10\ncache d 1024 2 16 lru wb 1 10\n"
+
+for mode in pipe fast ooo; do
+	batch "$TMP/r.json" "mode $mode\n${SETUP}run 10000\n" "$PROG" --dump-regs
+	expect "$mode: program finished" "$TMP/r.json" "d['running']" False
+	expect "$mode: data accesses" "$TMP/r.json" "d['dcache']['accesses']" 132
+	expect "$mode: data hits" "$TMP/r.json" "d['dcache']['hits']" 113
+	expect "$mode: data misses" "$TMP/r.json" "d['dcache']['misses']" 19
+	expect "$mode: data evictions" "$TMP/r.json" "d['dcache']['evictions']" 2
+	expect "$mode: data writebacks" "$TMP/r.json" "d['dcache']['writebacks']" 1
+	expect "$mode: text misses" "$TMP/r.json" "d['icache']['misses']" 5
+done
+
+exit $FAIL
@@ -0,0 +1,27 @@
+#!/bin/sh
+# A run checkpointed part way and restored in a new simulator finishes
+# exactly as the run that took the checkpoint. The pipeline and fast
+# mode also match a run that was never interrupted; the out-of-order
+# core drains before saving, so there only the program's results do.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/jit-loop.in
+SETUP="cache d 1024 2 16 lru wb 1 10\nbpred gshare\n"
+
+for mode in pipe fast ooo; do
+	batch "$TMP/whole.json" "mode $mode\n${SETUP}run 100000\n" "$PROG" --dump-regs
+	batch "$TMP/taken.json" "mode $mode\n${SETUP}run 7777\ncheckpoint $TMP/ckpt\nrun 100000\n" "$PROG" --dump-regs
+	batch "$TMP/restored.json" "restore $TMP/ckpt\nrun 100000\n" "$PROG" --dump-regs
+	expect "$mode: restored run finished" "$TMP/restored.json" "d['running']" False
+	same "$mode: restored run matches the saving run" "$TMP/taken.json" "$TMP/restored.json"
+	if [ "$mode" = ooo ]; then
+		for key in regs hi lo pc instructions; do
+			expect "$mode: $key as uninterrupted" "$TMP/restored.json" "d['$key']" "$(field "$TMP/whole.json" "d['$key']")"
+		done
+	else
+		same "$mode: restored run matches an uninterrupted one" "$TMP/whole.json" "$TMP/restored.json"
+	fi
+done
+
+exit $FAIL
@@ -0,0 +1,63 @@
+# Sourced by every test: the simulator and inputs directory from the
+# arguments, a scratch directory, and PASS/FAIL reporting. A test exits
+# non-zero when any of its checks failed.
+# Usage: <test>.sh <mu-mips binary> <inputs directory>
+
+SIM=$1
+INPUTS=$2
+TMP=${TMPDIR:-/tmp}/mu-test.$$
+FAIL=0
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+check() {
+	if [ "$2" -eq 0 ]; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		FAIL=1
+	fi
+}
+
+parses() {
+	python3 -c 'import json, sys; json.load(sys.stdin)' < "$1"
+}
+
+# field <result file> <expression>: a value from a JSON result, d being
+# the result, e.g. "d['regs'][16]" or "d['stalls']['load_use']"
+field() {
+	python3 -c 'import json, sys; d = json.load(open(sys.argv[1])); print(eval(sys.argv[2]))' "$1" "$2" 2> /dev/null
+}
+
+# expect <name> <result file> <expression> <value>
+expect() {
+	got=$(field "$2" "$3")
+	if [ "$got" = "$4" ]; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1: $3 is $got, expected $4"
+		FAIL=1
+	fi
+}
+
+# batch <result file> <commands> <program> [options]: run the commands
+# as a script and keep the JSON result
+batch() {
+	out=$1
+	printf '%b' "$2" > "$TMP/script"
+	shift 2
+	prog=$1
+	shift
+	"$SIM" --script "$TMP/script" "$@" "$prog" > "$out" 2> /dev/null
+}
+
+# same <name> <result file> <result file>: two JSON results agree
+same() {
+	if python3 -c 'import json, sys; sys.exit(json.load(open(sys.argv[1])) != json.load(open(sys.argv[2])))' "$2" "$3" 2> /dev/null; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		FAIL=1
+	fi
+}
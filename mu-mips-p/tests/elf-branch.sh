@@ -0,0 +1,17 @@
+#!/bin/sh
+# A toolchain-built ELF program branches from PC + 4, in every core.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/elf-branch.elf
+
+for setup in "mode pipe" "mode fast" "mode fast\njit off" "mode ooo"; do
+	name=$(printf '%b' "$setup" | tr '\n' ' ')
+	batch "$TMP/r.json" "$setup\nrun 10000\n" "$PROG" --dump-regs
+	expect "$name: program finished" "$TMP/r.json" "d['running']" False
+	expect "$name: loop sum doubled" "$TMP/r.json" "d['regs'][16]" 110
+	expect "$name: stored and loaded back" "$TMP/r.json" "d['regs'][17]" 110
+	expect "$name: no branch went wrong" "$TMP/r.json" "d['regs'][18]" 0
+done
+
+exit $FAIL
@@ -0,0 +1,22 @@
+#!/bin/sh
+# A load used by the next instruction costs one bubble with forwarding;
+# without it every dependent pair waits for writeback.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/load-use.in
+
+for setup in "forward on" "mode fast"; do
+	batch "$TMP/r.json" "$setup\nrun 1000\n" "$PROG" --dump-regs
+	expect "$setup: program finished" "$TMP/r.json" "d['running']" False
+	expect "$setup: one load-use bubble" "$TMP/r.json" "d['stalls']['load_use']" 1
+	expect "$setup: no other data stall" "$TMP/r.json" "d['stalls']['data']" 0
+	expect "$setup: loaded values used" "$TMP/r.json" "(d['regs'][10], d['regs'][13])" "(42, 22)"
+done
+
+batch "$TMP/r.json" "forward off\nrun 1000\n" "$PROG" --dump-regs
+expect "forward off: no load-use bubble" "$TMP/r.json" "d['stalls']['load_use']" 0
+expect "forward off: waits for writeback" "$TMP/r.json" "d['stalls']['data']" 8
+expect "forward off: loaded values used" "$TMP/r.json" "(d['regs'][10], d['regs'][13])" "(42, 22)"
+
+exit $FAIL
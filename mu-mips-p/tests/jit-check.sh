@@ -0,0 +1,17 @@
+#!/bin/sh
+# Fast mode gives the same result with hot blocks translated as it does
+# interpreting every instruction.
+
+. "$(dirname "$0")/common.sh"
+
+PROG=$INPUTS/jit-loop.in
+
+batch "$TMP/on.json" "mode fast\njit on\nrun 100000\n" "$PROG" --dump-regs
+batch "$TMP/off.json" "mode fast\njit off\nrun 100000\n" "$PROG" --dump-regs
+expect "jit on: program finished" "$TMP/on.json" "d['running']" False
+expect "jit on: text store ran" "$TMP/on.json" "d['regs'][22]" 600
+expect "jit off: program finished" "$TMP/off.json" "d['running']" False
+expect "jit off: text store ran" "$TMP/off.json" "d['regs'][22]" 600
+same "jit on and off agree" "$TMP/on.json" "$TMP/off.json"
+
+exit $FAIL